@@ -0,0 +1,133 @@
+// block_texture.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "block_texture.h"
+
+#include <limits.h>
+#include <stdbool.h>
+
+#define BLOCK_SIZE 4
+
+size_t block_texture_size(int width, int height) {
+    return (size_t)((width + BLOCK_SIZE - 1) / BLOCK_SIZE) * (size_t)((height + BLOCK_SIZE - 1) / BLOCK_SIZE) *
+           BLOCK_TEXTURE_WORDS;
+}
+
+static bool is_transparent(uint16_t texel) { return (texel >> 12) < 8; }
+
+// RGB565 endpoint of an ARGB4444 texel, which decodes back to the texel when opaque
+static uint16_t endpoint(uint16_t texel) {
+    int r = (texel >> 8) & 0xF, g = (texel >> 4) & 0xF, b = texel & 0xF;
+    return (uint16_t)((((r << 1) | (r >> 3)) << 11) | (((g << 2) | (g >> 2)) << 5) | ((b << 1) | (b >> 3)));
+}
+
+// Squared distance between the colors of two ARGB4444 texels
+static int distance(uint16_t a, uint16_t b) {
+    int d = 0;
+    for (int shift = 0; shift < 12; shift += 4) {
+        int c = ((a >> shift) & 0xF) - ((b >> shift) & 0xF);
+        d += c * c;
+    }
+    return d;
+}
+
+// Indices of the texels to the nearest colors of the endpoints, the transparent texels to the transparent black.
+// Returns the total distance.
+static int encode_indices(const uint16_t texels[16], uint16_t c0, uint16_t c1, uint16_t block[BLOCK_TEXTURE_WORDS]) {
+    // colors of the indices, from a block which has the indices 0 to 3 in its first row
+    const uint16_t palette_block[BLOCK_TEXTURE_WORDS] = {c0, c1, 0xE4, 0};
+    uint16_t colors[4];
+    for (int i = 0; i < 4; ++i) colors[i] = block_texture_texel(palette_block, i, 0);
+
+    block[0] = c0;
+    block[1] = c1;
+    block[2] = block[3] = 0;
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int index = 3;
+        if (!is_transparent(texels[i])) {
+            int best = INT_MAX;
+            for (int j = 0; j < 4; ++j) {
+                if (is_transparent(colors[j])) continue;
+                int d = distance(texels[i], colors[j]);
+                if (d < best) {
+                    best = d;
+                    index = j;
+                }
+            }
+            total += best;
+        }
+        block[2 + (i >> 3)] |= (uint16_t)(index << ((i & 7) << 1));
+    }
+    return total;
+}
+
+// The endpoints are either the two most distant colors or the corners of the bounding box of the colors, whichever is
+// closer to the texels. With a transparent texel, the endpoints are ordered for the 3 color mode.
+static void encode_block(const uint16_t texels[16], uint16_t block[BLOCK_TEXTURE_WORDS]) {
+    bool has_transparent = false;
+    uint16_t opaque[16];
+    int nb_opaque = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (is_transparent(texels[i]))
+            has_transparent = true;
+        else
+            opaque[nb_opaque++] = texels[i];
+    }
+    if (nb_opaque == 0) {
+        block[0] = block[1] = 0;
+        block[2] = block[3] = 0xFFFF;
+        return;
+    }
+
+    uint16_t ends[2][2] = {{opaque[0], opaque[0]}, {0xF000, 0xF000}};
+    int max_distance = 0;
+    for (int i = 0; i < nb_opaque; ++i)
+        for (int j = i + 1; j < nb_opaque; ++j) {
+            int d = distance(opaque[i], opaque[j]);
+            if (d > max_distance) {
+                max_distance = d;
+                ends[0][0] = opaque[i];
+                ends[0][1] = opaque[j];
+            }
+        }
+    for (int shift = 0; shift < 12; shift += 4) {
+        int low = 0xF, high = 0;
+        for (int i = 0; i < nb_opaque; ++i) {
+            int c = (opaque[i] >> shift) & 0xF;
+            if (c < low) low = c;
+            if (c > high) high = c;
+        }
+        ends[1][0] |= (uint16_t)(low << shift);
+        ends[1][1] |= (uint16_t)(high << shift);
+    }
+
+    int best = INT_MAX;
+    for (int i = 0; i < 2; ++i) {
+        uint16_t e0 = endpoint(ends[i][0]), e1 = endpoint(ends[i][1]);
+        uint16_t low = e0 < e1 ? e0 : e1, high = e0 < e1 ? e1 : e0;
+        uint16_t candidate[BLOCK_TEXTURE_WORDS];
+        int d = has_transparent ? encode_indices(texels, low, high, candidate)
+                                : encode_indices(texels, high, low, candidate);
+        if (d < best) {
+            best = d;
+            for (int j = 0; j < BLOCK_TEXTURE_WORDS; ++j) block[j] = candidate[j];
+        }
+    }
+}
+
+void block_texture_encode(const uint16_t* texels, int width, int height, uint16_t* blocks) {
+    for (int by = 0; by < height; by += BLOCK_SIZE)
+        for (int bx = 0; bx < width; bx += BLOCK_SIZE) {
+            // the padding repeats the last column and row
+            uint16_t block_texels[16];
+            for (int y = 0; y < BLOCK_SIZE; ++y)
+                for (int x = 0; x < BLOCK_SIZE; ++x) {
+                    int tx = bx + x < width ? bx + x : width - 1, ty = by + y < height ? by + y : height - 1;
+                    block_texels[y * BLOCK_SIZE + x] = texels[ty * width + tx];
+                }
+            encode_block(block_texels, blocks);
+            blocks += BLOCK_TEXTURE_WORDS;
+        }
+}
@@ -0,0 +1,53 @@
+// block_texture.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Block compressed textures at 4 bits per texel, in the BC1 format. The texels are cut in blocks of 4x4, in rows, and
+// each block is four 16-bit words: two RGB565 endpoints c0 and c1, then the 2-bit indices of its 16 texels in rows,
+// texel 0 in the low bits of the third word. When c0 > c1, the indices select c0, c1, (2 c0 + c1) / 3 and
+// (c0 + 2 c1) / 3, otherwise c0, c1, (c0 + c1) / 2 and a transparent black. The texels are decoded to ARGB4444 like the
+// uncompressed textures: a transparent black texel is discarded by the alpha test, in software and in the RTL, and
+// drawn black without it. A texture under 4 texels wide or high is padded to a block.
+
+#ifndef BLOCK_TEXTURE_H
+#define BLOCK_TEXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOCK_TEXTURE_WORDS 4  // 16-bit words of a block
+
+// 16-bit words of a compressed texture of width x height texels
+size_t block_texture_size(int width, int height);
+
+// Compress ARGB4444 texels in rows into blocks in rows. The texels with an alpha under 8 become transparent, the other
+// ones opaque.
+void block_texture_encode(const uint16_t* texels, int width, int height, uint16_t* blocks);
+
+// ARGB4444 texel at (x, y) of a block, x and y in [0, 3]. The thirds are exact, the channels are truncated to 4 bits.
+static inline uint16_t block_texture_texel(const uint16_t* block, int x, int y) {
+    uint16_t c0 = block[0], c1 = block[1];
+    int index = (block[2 + (y >> 1)] >> ((((y & 1) << 2) | x) << 1)) & 3;
+    if (index < 2) {
+        uint16_t c = index ? c1 : c0;
+        return (uint16_t)(0xF000 | ((c >> 12) << 8) | (((c >> 7) & 0xF) << 4) | ((c >> 1) & 0xF));
+    }
+    if (c0 <= c1 && index == 3) return 0;
+    int r0 = c0 >> 11, g0 = (c0 >> 5) & 0x3F, b0 = c0 & 0x1F;
+    int r1 = c1 >> 11, g1 = (c1 >> 5) & 0x3F, b1 = c1 & 0x1F;
+    int r, g, b;
+    if (c0 > c1) {
+        // index 2: 2/3 c0 + 1/3 c1, index 3: 1/3 c0 + 2/3 c1
+        int w0 = 4 - index, w1 = index - 1;
+        r = (w0 * r0 + w1 * r1) / 3;
+        g = (w0 * g0 + w1 * g1) / 3;
+        b = (w0 * b0 + w1 * b1) / 3;
+    } else {
+        r = (r0 + r1) >> 1;
+        g = (g0 + g1) >> 1;
+        b = (b0 + b1) >> 1;
+    }
+    return (uint16_t)(0xF000 | ((r >> 1) << 8) | ((g >> 2) << 4) | (b >> 1));
+}
+
+#endif
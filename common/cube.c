@@ -54,8 +54,10 @@ face_t faces[] = {
     {{5, 0, 3}, {1, 2, 3}, {1, 2, 3}, {-1, -1, -1}}};
 
 static model_t g_model;
+#if SORT_TRIANGLES
 // note: clipping can produce an additional triangle
-static triangle_t g_triangles_to_raster[2 * sizeof(faces) / sizeof(face_t)];
+static raster_triangle_t g_triangles_to_raster[2 * sizeof(faces) / sizeof(face_t)];
+#endif
 
 model_t* load_cube() {
     g_model.mesh.nb_faces = sizeof(faces) / sizeof(face_t);
@@ -68,7 +70,11 @@ model_t* load_cube() {
     g_model.mesh.texcoords = texcoords;
     g_model.mesh.colors = colors;
     g_model.mesh.normals = NULL;
+#if SORT_TRIANGLES
     g_model.triangles_to_raster = g_triangles_to_raster;
+#else
+    g_model.triangles_to_raster = NULL;
+#endif
 
     return &g_model;
 }
@@ -0,0 +1,325 @@
+// dynamic_mesh.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "dynamic_mesh.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    vec3d p;
+    int index;
+} weld_entry_t;
+
+static int compare_weld_entries(const void* a, const void* b) {
+    const weld_entry_t* ea = (const weld_entry_t*)a;
+    const weld_entry_t* eb = (const weld_entry_t*)b;
+    if (ea->p.x != eb->p.x) return ea->p.x < eb->p.x ? -1 : 1;
+    if (ea->p.y != eb->p.y) return ea->p.y < eb->p.y ? -1 : 1;
+    if (ea->p.z != eb->p.z) return ea->p.z < eb->p.z ? -1 : 1;
+    return ea->index - eb->index;
+}
+
+static void bounds_expand(aabb_t* box, vec3d* p) {
+    if (p->x < box->min.x) box->min.x = p->x;
+    if (p->y < box->min.y) box->min.y = p->y;
+    if (p->z < box->min.z) box->min.z = p->z;
+    if (p->x > box->max.x) box->max.x = p->x;
+    if (p->y > box->max.y) box->max.y = p->y;
+    if (p->z > box->max.z) box->max.z = p->z;
+}
+
+static bool is_on_bounds(aabb_t* box, vec3d* p) {
+    return p->x == box->min.x || p->y == box->min.y || p->z == box->min.z || p->x == box->max.x ||
+           p->y == box->max.y || p->z == box->max.z;
+}
+
+static void range_add(size_t* first, size_t* last, size_t range_first, size_t count, size_t size) {
+    size_t range_last = range_first + count;
+    if (range_last > size) range_last = size;
+    if (range_first >= range_last) return;
+    if (*first >= *last) {
+        *first = range_first;
+        *last = range_last;
+    } else {
+        if (range_first < *first) *first = range_first;
+        if (range_last > *last) *last = range_last;
+    }
+}
+
+static bool weld_vertices(dynamic_mesh_t* dm) {
+    mesh_t* mesh = &dm->model.mesh;
+    weld_entry_t* entries = (weld_entry_t*)malloc(mesh->nb_vertices * sizeof(weld_entry_t));
+    if (!entries) return false;
+    for (size_t i = 0; i < mesh->nb_vertices; ++i) entries[i] = (weld_entry_t){mesh->vertices[i], (int)i};
+    qsort(entries, mesh->nb_vertices, sizeof(weld_entry_t), compare_weld_entries);
+
+    // the first vertex of a run of identical positions has the lowest index
+    for (size_t i = 0; i < mesh->nb_vertices; ++i) {
+        bool same = i > 0 && entries[i].p.x == entries[i - 1].p.x && entries[i].p.y == entries[i - 1].p.y &&
+                    entries[i].p.z == entries[i - 1].p.z;
+        dm->welded[entries[i].index] = same ? dm->welded[entries[i - 1].index] : entries[i].index;
+    }
+    free(entries);
+    return true;
+}
+
+static bool build_vertex_faces(dynamic_mesh_t* dm) {
+    mesh_t* mesh = &dm->model.mesh;
+    int* offsets = dm->vertex_face_offsets;
+    memset(offsets, 0, (mesh->nb_vertices + 1) * sizeof(int));
+    for (size_t i = 0; i < mesh->nb_faces; ++i)
+        for (int j = 0; j < 3; ++j) offsets[dm->welded[mesh->faces[i].indices[j]] + 1]++;
+    for (size_t i = 0; i < mesh->nb_vertices; ++i) offsets[i + 1] += offsets[i];
+
+    dm->vertex_faces = (int*)malloc(3 * mesh->nb_faces * sizeof(int));
+    int* fill = (int*)malloc(mesh->nb_vertices * sizeof(int));
+    if (!dm->vertex_faces || !fill) {
+        free(fill);
+        return false;
+    }
+    memcpy(fill, offsets, mesh->nb_vertices * sizeof(int));
+    for (size_t i = 0; i < mesh->nb_faces; ++i)
+        for (int j = 0; j < 3; ++j) dm->vertex_faces[fill[dm->welded[mesh->faces[i].indices[j]]]++] = (int)i;
+    free(fill);
+    return true;
+}
+
+dynamic_mesh_t* dynamic_mesh_create(mesh_t* mesh) {
+    dynamic_mesh_t* dm = (dynamic_mesh_t*)calloc(1, sizeof(dynamic_mesh_t));
+    if (!dm) return NULL;
+
+    mesh_t* dst = &dm->model.mesh;
+    *dst = *mesh;
+    size_t nb_vertices = mesh->nb_vertices, nb_faces = mesh->nb_faces;
+    dst->vertices = (vec3d*)malloc(nb_vertices * sizeof(vec3d));
+    dst->faces = (face_t*)malloc(nb_faces * sizeof(face_t));
+    dst->normals = (vec3d*)calloc(nb_vertices, sizeof(vec3d));
+    dst->nb_normals = nb_vertices;
+    dm->cached_vertices = (vec3d*)malloc(nb_vertices * sizeof(vec3d));
+    dm->face_normals = (vec3d*)malloc(nb_faces * sizeof(vec3d));
+    dm->welded = (int*)malloc(nb_vertices * sizeof(int));
+    dm->vertex_face_offsets = (int*)malloc((nb_vertices + 1) * sizeof(int));
+    dm->face_stamps = (unsigned int*)calloc(nb_faces, sizeof(unsigned int));
+    dm->lit_stamps = (unsigned int*)calloc(nb_faces, sizeof(unsigned int));
+    dm->vertex_stamps = (unsigned int*)calloc(nb_vertices, sizeof(unsigned int));
+    dm->face_list = (int*)malloc(nb_faces * sizeof(int));
+    dm->lit_list = (int*)malloc(nb_faces * sizeof(int));
+    dm->vertex_list = (int*)malloc(nb_vertices * sizeof(int));
+
+    // the lit model shares the vertices and has a color per face corner
+    mesh_t* lit = &dm->lit_model.mesh;
+    *lit = *dst;
+    lit->nb_normals = 0;
+    lit->normals = NULL;
+    lit->nb_colors = 3 * nb_faces;
+    lit->colors = (vec3d*)malloc(lit->nb_colors * sizeof(vec3d));
+    lit->faces = (face_t*)malloc(nb_faces * sizeof(face_t));
+
+#if SORT_TRIANGLES
+    // note: clipping can produce an additional triangle
+    dm->model.triangles_to_raster = (raster_triangle_t*)malloc(2 * nb_faces * sizeof(raster_triangle_t));
+    dm->lit_model.triangles_to_raster = dm->model.triangles_to_raster;
+#endif
+
+    if (!dst->vertices || !dst->faces || !dst->normals || !dm->cached_vertices || !dm->face_normals || !dm->welded ||
+        !dm->vertex_face_offsets || !dm->face_stamps || !dm->lit_stamps || !dm->vertex_stamps || !dm->face_list ||
+        !dm->lit_list || !dm->vertex_list || !lit->colors || !lit->faces) {
+        dynamic_mesh_free(dm);
+        return NULL;
+    }
+
+    memcpy(dst->vertices, mesh->vertices, nb_vertices * sizeof(vec3d));
+    memcpy(dm->cached_vertices, mesh->vertices, nb_vertices * sizeof(vec3d));
+    memcpy(dst->faces, mesh->faces, nb_faces * sizeof(face_t));
+
+    if (!weld_vertices(dm) || !build_vertex_faces(dm)) {
+        dynamic_mesh_free(dm);
+        return NULL;
+    }
+
+    // the normals are indexed by the welded vertices
+    for (size_t i = 0; i < nb_faces; ++i) {
+        face_t* face = &dst->faces[i];
+        face_t* lit_face = &lit->faces[i];
+        *lit_face = *face;
+        for (int j = 0; j < 3; ++j) {
+            face->norm_indices[j] = dm->welded[face->indices[j]];
+            lit_face->norm_indices[j] = -1;
+            lit_face->col_indices[j] = (int)(3 * i + j);
+        }
+    }
+
+    dm->bounds = mesh_bounds(dst);
+    dynamic_mesh_touch_faces(dm, 0, nb_faces);
+    dynamic_mesh_refresh(dm);
+
+    return dm;
+}
+
+void dynamic_mesh_free(dynamic_mesh_t* dm) {
+    if (!dm) return;
+    free(dm->model.mesh.vertices);
+    free(dm->model.mesh.faces);
+    free(dm->model.mesh.normals);
+#if SORT_TRIANGLES
+    free(dm->model.triangles_to_raster);
+#endif
+    free(dm->lit_model.mesh.colors);
+    free(dm->lit_model.mesh.faces);
+    free(dm->cached_vertices);
+    free(dm->face_normals);
+    free(dm->welded);
+    free(dm->vertex_face_offsets);
+    free(dm->vertex_faces);
+    free(dm->face_stamps);
+    free(dm->lit_stamps);
+    free(dm->vertex_stamps);
+    free(dm->face_list);
+    free(dm->lit_list);
+    free(dm->vertex_list);
+    free(dm->lights);
+    free(dm);
+}
+
+void dynamic_mesh_set_vertices(dynamic_mesh_t* dm, size_t first, size_t count, vec3d* vertices) {
+    if (first >= dm->model.mesh.nb_vertices) return;
+    if (count > dm->model.mesh.nb_vertices - first) count = dm->model.mesh.nb_vertices - first;
+    memcpy(&dm->model.mesh.vertices[first], vertices, count * sizeof(vec3d));
+    dynamic_mesh_touch_vertices(dm, first, count);
+}
+
+void dynamic_mesh_touch_vertices(dynamic_mesh_t* dm, size_t first, size_t count) {
+    range_add(&dm->dirty_vertices_first, &dm->dirty_vertices_last, first, count, dm->model.mesh.nb_vertices);
+}
+
+void dynamic_mesh_touch_faces(dynamic_mesh_t* dm, size_t first, size_t count) {
+    range_add(&dm->dirty_faces_first, &dm->dirty_faces_last, first, count, dm->model.mesh.nb_faces);
+}
+
+static void light_face(dynamic_mesh_t* dm, int face_index) {
+    mesh_t* mesh = &dm->model.mesh;
+    face_t* face = &mesh->faces[face_index];
+
+    for (int j = 0; j < 3; ++j) {
+        vec3d base = {FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+        if (mesh->colors) base = mesh->colors[face->col_indices[j]];
+        vec3d* lit = &dm->lit_model.mesh.colors[3 * face_index + j];
+        if (dm->nb_lights == 0) {
+            *lit = base;
+            continue;
+        }
+
+        // same as the Gouraud shading of draw_model
+        vec3d n = matrix_multiply_vector(&dm->mat_normal, &mesh->normals[face->norm_indices[j]]);
+        vec3d color = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+        for (size_t light_index = 0; light_index < dm->nb_lights; ++light_index) {
+            fx32 dp = -vector_dot_product(&dm->lights[light_index].direction, &n);
+            if (dp < FX(0.0f)) dp = FX(0.0f);
+            vec3d diffuse_color = vector_mul(&dm->lights[light_index].diffuse_color, dp);
+            color = vector_add(&color, &dm->lights[light_index].ambient_color);
+            color = vector_add(&color, &diffuse_color);
+        }
+        color = vector_clamp(&color);
+        *lit = (vec3d){MUL(base.x, color.x), MUL(base.y, color.y), MUL(base.z, color.z), base.w};
+    }
+}
+
+void dynamic_mesh_set_lighting(dynamic_mesh_t* dm, mat4x4* mat_normal, light_t* lights, size_t nb_lights) {
+    if (dm->is_lit && dm->nb_lights == nb_lights && memcmp(&dm->mat_normal, mat_normal, sizeof(mat4x4)) == 0 &&
+        memcmp(dm->lights, lights, nb_lights * sizeof(light_t)) == 0)
+        return;
+
+    light_t* copy = (light_t*)realloc(dm->lights, (nb_lights ? nb_lights : 1) * sizeof(light_t));
+    if (!copy) return;
+    memcpy(copy, lights, nb_lights * sizeof(light_t));
+    dm->lights = copy;
+    dm->nb_lights = nb_lights;
+    dm->mat_normal = *mat_normal;
+    dm->is_lit = true;
+
+    for (size_t i = 0; i < dm->model.mesh.nb_faces; ++i) light_face(dm, (int)i);
+}
+
+size_t dynamic_mesh_refresh(dynamic_mesh_t* dm) {
+    mesh_t* mesh = &dm->model.mesh;
+    size_t nb_faces = 0, nb_vertices = 0, nb_lit = 0;
+
+    if (++dm->stamp == 0) {
+        memset(dm->face_stamps, 0, mesh->nb_faces * sizeof(unsigned int));
+        memset(dm->lit_stamps, 0, mesh->nb_faces * sizeof(unsigned int));
+        memset(dm->vertex_stamps, 0, mesh->nb_vertices * sizeof(unsigned int));
+        dm->stamp = 1;
+    }
+    unsigned int stamp = dm->stamp;
+
+    // the vertices which actually moved, and the faces around them
+    bool is_bounds_shrunk = false;
+    for (size_t i = dm->dirty_vertices_first; i < dm->dirty_vertices_last; ++i) {
+        vec3d* p = &mesh->vertices[i];
+        vec3d* cached = &dm->cached_vertices[i];
+        if (p->x == cached->x && p->y == cached->y && p->z == cached->z) continue;
+
+        // the bounds can only be grown unless a vertex leaves them
+        if (is_on_bounds(&dm->bounds, cached)) is_bounds_shrunk = true;
+        bounds_expand(&dm->bounds, p);
+        *cached = *p;
+
+        int v = dm->welded[i];
+        for (int k = dm->vertex_face_offsets[v]; k < dm->vertex_face_offsets[v + 1]; ++k) {
+            int f = dm->vertex_faces[k];
+            if (dm->face_stamps[f] == stamp) continue;
+            dm->face_stamps[f] = stamp;
+            dm->face_list[nb_faces++] = f;
+        }
+    }
+    if (is_bounds_shrunk) dm->bounds = mesh_bounds(mesh);
+
+    for (size_t i = dm->dirty_faces_first; i < dm->dirty_faces_last; ++i) {
+        if (dm->face_stamps[i] == stamp) continue;
+        dm->face_stamps[i] = stamp;
+        dm->face_list[nb_faces++] = (int)i;
+    }
+
+    // face normals, like the flat shading of draw_model
+    for (size_t i = 0; i < nb_faces; ++i) {
+        face_t* face = &mesh->faces[dm->face_list[i]];
+        vec3d line1 = vector_sub(&mesh->vertices[face->indices[1]], &mesh->vertices[face->indices[0]]);
+        vec3d line2 = vector_sub(&mesh->vertices[face->indices[2]], &mesh->vertices[face->indices[0]]);
+        vec3d normal = vector_cross_product(&line1, &line2);
+        normal = vector_mul(&normal, FXI(16));  // to fix precision issue with small triangles in fixed point
+        dm->face_normals[dm->face_list[i]] = vector_normalize(&normal);
+
+        for (int j = 0; j < 3; ++j) {
+            int v = dm->welded[face->indices[j]];
+            if (dm->vertex_stamps[v] == stamp) continue;
+            dm->vertex_stamps[v] = stamp;
+            dm->vertex_list[nb_vertices++] = v;
+        }
+    }
+
+    // smooth normals of the welded vertices of these faces, and the faces whose lighting depends on them
+    for (size_t i = 0; i < nb_vertices; ++i) {
+        int v = dm->vertex_list[i];
+        vec3d sum = {FX(0.0f), FX(0.0f), FX(0.0f), FX(0.0f)};
+        for (int k = dm->vertex_face_offsets[v]; k < dm->vertex_face_offsets[v + 1]; ++k) {
+            int f = dm->vertex_faces[k];
+            sum = vector_add(&sum, &dm->face_normals[f]);
+            if (dm->lit_stamps[f] != stamp) {
+                dm->lit_stamps[f] = stamp;
+                dm->lit_list[nb_lit++] = f;
+            }
+        }
+        mesh->normals[v] = vector_normalize(&sum);
+        mesh->normals[v].w = FX(0.0f);
+    }
+
+    if (dm->is_lit)
+        for (size_t i = 0; i < nb_lit; ++i) light_face(dm, dm->lit_list[i]);
+
+    dm->dirty_vertices_first = dm->dirty_vertices_last = 0;
+    dm->dirty_faces_first = dm->dirty_faces_last = 0;
+
+    return nb_faces;
+}
@@ -0,0 +1,59 @@
+// dynamic_mesh.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Meshes edited in place, e.g. for deformations or morphs. The edits mark ranges of vertices or faces dirty and
+// dynamic_mesh_refresh() only updates the data derived from the mesh around them: the bounds, the face normals, the
+// smooth normals of the welded vertices and the baked lighting. A small edit costs in proportion to its size instead
+// of the size of the mesh.
+
+#ifndef DYNAMIC_MESH_H
+#define DYNAMIC_MESH_H
+
+#include "graphite.h"
+
+typedef struct {
+    model_t model;        // copy of the vertices and faces of the mesh, with the smooth normal of each welded vertex
+    model_t lit_model;    // same vertices with the lighting baked into per-corner colors, to draw without lights
+    aabb_t bounds;        // in model space
+    vec3d* face_normals;  // unit normal of each face, in model space
+    int* welded;          // for each vertex, the first vertex at the same position when the mesh was created
+
+    // dirty ranges since the last refresh, empty if first >= last
+    size_t dirty_vertices_first, dirty_vertices_last;
+    size_t dirty_faces_first, dirty_faces_last;
+
+    // Internal buffers
+    vec3d* cached_vertices;   // positions the derived data was computed from
+    int* vertex_face_offsets; // faces around each welded vertex, indexed by the first vertex of the weld
+    int* vertex_faces;
+    unsigned int *face_stamps, *vertex_stamps, *lit_stamps;
+    unsigned int stamp;
+    int *face_list, *vertex_list, *lit_list;
+    bool is_lit;
+    mat4x4 mat_normal;
+    light_t* lights;
+    size_t nb_lights;
+} dynamic_mesh_t;
+
+// Copy the vertices and faces of the mesh and compute its derived data. The texture coordinates and the colors stay
+// shared with the mesh. The vertices at the same position are welded for the smooth normals.
+// Returns NULL on error.
+dynamic_mesh_t* dynamic_mesh_create(mesh_t* mesh);
+void dynamic_mesh_free(dynamic_mesh_t* mesh);
+
+// Replace count vertices starting at first
+void dynamic_mesh_set_vertices(dynamic_mesh_t* mesh, size_t first, size_t count, vec3d* vertices);
+// Mark vertices of model.mesh.vertices edited in place
+void dynamic_mesh_touch_vertices(dynamic_mesh_t* mesh, size_t first, size_t count);
+// Mark faces whose derived data must be refreshed, e.g. when the colors they reference changed
+void dynamic_mesh_touch_faces(dynamic_mesh_t* mesh, size_t first, size_t count);
+
+// Bake the lighting of draw_model with Gouraud shading into lit_model. Only the dirty parts are lit again by the next
+// refreshes, unless the normal matrix or the lights change.
+void dynamic_mesh_set_lighting(dynamic_mesh_t* mesh, mat4x4* mat_normal, light_t* lights, size_t nb_lights);
+
+// Update the derived data of the dirty ranges. Returns the number of faces whose normal was computed again.
+size_t dynamic_mesh_refresh(dynamic_mesh_t* mesh);
+
+#endif
@@ -0,0 +1,122 @@
+// dynamic_resolution.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "dynamic_resolution.h"
+
+#include <math.h>
+#include <string.h>
+
+#define RESOLUTION_ALIGNMENT 8     // of the render width and height
+#define AVERAGE_WEIGHT 0.25f       // of the last frame in the average frame time
+#define MAX_SCALE_STEP_UP 0.1f     // largest increase of the scale per frame
+#define MAX_SCALE_STEP_DOWN 0.3f   // largest decrease of the scale per frame
+#define MIN_PIXEL_FRACTION 0.2f    // of the frame time, below it the estimate is too noisy to be useful
+
+// a frame over the target lowers the resolution right away, the resolution is only raised once the average frame time
+// is below the low threshold, and a change aims at a frame time of the set point, so that the variations of the frame
+// time do not cross the target
+#define LOW_THRESHOLD 0.7f
+#define SET_POINT 0.85f
+#define HIGH_THRESHOLD 1.0f
+
+static int aligned(float x, int max) {
+    int n = ((int)(x + 0.5f) + RESOLUTION_ALIGNMENT / 2) / RESOLUTION_ALIGNMENT * RESOLUTION_ALIGNMENT;
+    if (n < RESOLUTION_ALIGNMENT) n = RESOLUTION_ALIGNMENT;
+    return n > max ? max : n;
+}
+
+void dynamic_resolution_init(dynamic_resolution_t* dr, int max_width, int max_height, float min_scale,
+                             float target_frame_time) {
+    memset(dr, 0, sizeof(dynamic_resolution_t));
+    dr->max_width = max_width;
+    dr->max_height = max_height;
+    dr->min_scale = min_scale;
+    dr->target_frame_time = target_frame_time;
+    dr->scale = 1.0f;
+    dr->pixel_fraction = 1.0f;
+    dr->width = max_width;
+    dr->height = max_height;
+}
+
+static bool set_scale(dynamic_resolution_t* dr, float scale, float frame_time) {
+    if (scale < dr->min_scale) scale = dr->min_scale;
+    if (scale > 1.0f) scale = 1.0f;
+    int width = aligned(scale * dr->max_width, dr->max_width);
+    int height = aligned(scale * dr->max_height, dr->max_height);
+    if (width == dr->width && height == dr->height) return false;
+
+    dr->previous_scale = dr->scale;
+    dr->previous_frame_time = frame_time;
+    dr->scale = scale;
+    dr->width = width;
+    dr->height = height;
+    // the next frames are rendered with a different cost
+    dr->average_frame_time = 0.0f;
+    return true;
+}
+
+bool dynamic_resolution_update(dynamic_resolution_t* dr, float frame_time) {
+    if (frame_time <= 0.0f) return false;
+
+    // first frame at a new resolution: t = t_previous * (1 - f + f * pixels / pixels_previous)
+    if (dr->average_frame_time == 0.0f && dr->previous_frame_time > 0.0f) {
+        float pixels = (dr->scale * dr->scale) / (dr->previous_scale * dr->previous_scale);
+        float f = (1.0f - frame_time / dr->previous_frame_time) / (1.0f - pixels);
+        if (f < MIN_PIXEL_FRACTION) f = MIN_PIXEL_FRACTION;
+        if (f > 1.0f) f = 1.0f;
+        dr->pixel_fraction += 0.5f * (f - dr->pixel_fraction);
+    }
+
+    dr->average_frame_time = dr->average_frame_time > 0.0f
+                                 ? dr->average_frame_time + AVERAGE_WEIGHT * (frame_time - dr->average_frame_time)
+                                 : frame_time;
+
+    float t;
+    if (frame_time > HIGH_THRESHOLD * dr->target_frame_time) {
+        t = frame_time;
+    } else if (dr->average_frame_time < LOW_THRESHOLD * dr->target_frame_time && dr->scale < 1.0f) {
+        t = dr->average_frame_time;
+    } else {
+        return false;
+    }
+
+    // ratio of the number of pixels which brings the frame time to the set point, 0 if it is out of reach
+    float pixels = 1.0f - (1.0f - SET_POINT * dr->target_frame_time / t) / dr->pixel_fraction;
+    float ratio = pixels > 0.0f ? sqrtf(pixels) : 0.0f;
+    if (ratio < 1.0f - MAX_SCALE_STEP_DOWN) ratio = 1.0f - MAX_SCALE_STEP_DOWN;
+    if (ratio > 1.0f + MAX_SCALE_STEP_UP) ratio = 1.0f + MAX_SCALE_STEP_UP;
+    return set_scale(dr, dr->scale * ratio, t);
+}
+
+bool dynamic_resolution_idle(dynamic_resolution_t* dr) {
+    bool is_changed = set_scale(dr, 1.0f, 0.0f);
+    // the next frames start a new load
+    dr->average_frame_time = 0.0f;
+    dr->previous_frame_time = 0.0f;
+    return is_changed;
+}
+
+void dynamic_resolution_upscale(const uint16_t* src, int src_width, int src_height, int src_pitch, uint16_t* dst,
+                                int dst_width, int dst_height, int dst_pitch) {
+    // 16.16 steps through the source
+    uint32_t step_x = ((uint32_t)src_width << 16) / dst_width;
+    uint32_t step_y = ((uint32_t)src_height << 16) / dst_height;
+
+    int previous_row = -1;
+    uint32_t sy = 0;
+    for (int y = 0; y < dst_height; ++y, sy += step_y) {
+        int row = (int)(sy >> 16);
+        uint16_t* d = dst + y * dst_pitch;
+        if (row == previous_row) {
+            // same source row
+            memcpy(d, d - dst_pitch, dst_width * sizeof(uint16_t));
+            continue;
+        }
+        previous_row = row;
+
+        const uint16_t* s = src + row * src_pitch;
+        uint32_t sx = 0;
+        for (int x = 0; x < dst_width; ++x, sx += step_x) d[x] = s[sx >> 16];
+    }
+}
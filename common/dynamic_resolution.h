@@ -0,0 +1,42 @@
+// dynamic_resolution.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Dynamic resolution scaling. The controller measures the frame time and adjusts the resolution at which the next
+// frames are rendered, within bounds, to keep the frame time under a target. The frame time is modeled as a part
+// proportional to the number of pixels plus a fixed part, e.g. the geometry, whose ratio is estimated from the frame
+// times before and after each change of resolution. The rendered frames are then upscaled to the display resolution.
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    int max_width, max_height;  // display resolution
+    float min_scale;            // of the width and height
+    float target_frame_time;    // in any unit, e.g. ms or clock cycles
+
+    float scale;
+    float average_frame_time;
+    float pixel_fraction;  // estimated part of the frame time proportional to the number of pixels
+    float previous_scale, previous_frame_time;  // before the last change of resolution, 0 if none
+    int width, height;                          // render resolution of the next frame
+} dynamic_resolution_t;
+
+void dynamic_resolution_init(dynamic_resolution_t* dr, int max_width, int max_height, float min_scale,
+                             float target_frame_time);
+
+// Record the time of the last frame rendered at the current resolution. Returns true if the resolution changed.
+bool dynamic_resolution_update(dynamic_resolution_t* dr, float frame_time);
+
+// Record a frame which was not rendered, e.g. because nothing changed: the displayed frame is rendered again at the
+// display resolution, there is time for it. Returns true if the resolution changed.
+bool dynamic_resolution_idle(dynamic_resolution_t* dr);
+
+// Nearest neighbor upscale of a RGB565 frame, with integer arithmetic only. The pitches are in pixels.
+void dynamic_resolution_upscale(const uint16_t* src, int src_width, int src_height, int src_pitch, uint16_t* dst,
+                                int dst_width, int dst_height, int dst_pitch);
+
+#endif
@@ -0,0 +1,51 @@
+// frame_state.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "frame_state.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void frame_state_init(frame_state_t* state) {
+    memset(state, 0, sizeof(frame_state_t));
+    frame_state_invalidate(state);
+}
+
+void frame_state_free(frame_state_t* state) {
+    free(state->data);
+    memset(state, 0, sizeof(frame_state_t));
+}
+
+void frame_state_begin(frame_state_t* state) { state->offset = 0; }
+
+void frame_state_track(frame_state_t* state, const void* input, size_t size) {
+    size_t end = state->offset + size;
+    if (end > state->capacity) {
+        size_t capacity = state->capacity ? 2 * state->capacity : 256;
+        while (capacity < end) capacity *= 2;
+        unsigned char* data = (unsigned char*)realloc(state->data, capacity);
+        if (!data) {
+            // without a record, every frame is rendered
+            state->changed = true;
+            return;
+        }
+        state->data = data;
+        state->capacity = capacity;
+    }
+
+    if (end > state->size || memcmp(state->data + state->offset, input, size) != 0) {
+        memcpy(state->data + state->offset, input, size);
+        state->changed = true;
+    }
+    state->offset = end;
+}
+
+bool frame_state_end(frame_state_t* state) {
+    bool changed = state->changed || state->offset != state->size;
+    state->size = state->offset;
+    state->changed = false;
+    return changed;
+}
+
+void frame_state_invalidate(frame_state_t* state) { state->changed = true; }
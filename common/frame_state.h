@@ -0,0 +1,33 @@
+// frame_state.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Change tracking of the inputs of a frame (camera, matrices, lights, render flags...). The inputs are recorded
+// between frame_state_begin() and frame_state_end() and compared with the ones of the previous frame, so that a frame
+// identical to the previous one can be skipped and the previous framebuffer presented again.
+
+#ifndef FRAME_STATE_H
+#define FRAME_STATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    unsigned char* data;  // inputs of the last frame
+    size_t size, capacity;
+    size_t offset;  // of the next input of the current frame
+    bool changed;
+} frame_state_t;
+
+void frame_state_init(frame_state_t* state);
+void frame_state_free(frame_state_t* state);
+
+void frame_state_begin(frame_state_t* state);
+void frame_state_track(frame_state_t* state, const void* input, size_t size);
+// Returns true if the inputs differ from the ones of the previous frame
+bool frame_state_end(frame_state_t* state);
+
+// Force the next frame to be rendered, e.g. when something which is not tracked changed
+void frame_state_invalidate(frame_state_t* state);
+
+#endif
@@ -12,12 +12,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define SORT_TRIANGLES 0
-
 #define MAX_NB_TRIANGLES    16      // maximum number of triangles produced by the clipping
+// each clipping adds at most two vertices and the screen edges need at most MAX_NB_TRIANGLES - 1 clippings
+#define MAX_NB_VERTICES     (3 + 2 * (MAX_NB_TRIANGLES - 1))
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
 
 void xd_draw_triangle(vec3d p[3], vec2d t[3], vec3d c[3], texture_t* tex, bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y,
-                      bool depth_test, bool perspective_correct);
+                      bool depth_test, bool perspective_correct, bool alpha_test);
 
 vec3d matrix_multiply_vector(mat4x4* m, vec3d* i) {
     vec3d r = {MUL(i->x, m->m[0][0]) + MUL(i->y, m->m[1][0]) + MUL(i->z, m->m[2][0]) + m->m[3][0],
@@ -80,83 +86,61 @@ vec3d vector_clamp(vec3d* v) {
     return r;
 }
 
-vec3d vector_intersect_plane(vec3d* plane_p, vec3d* plane_n, vec3d* line_start, vec3d* line_end, fx32* t) {
-    fx32 plane_d = -vector_dot_product(plane_n, plane_p);
-    fx32 ad = vector_dot_product(line_start, plane_n);
-    fx32 bd = vector_dot_product(line_end, plane_n);
-    *t = DIV(-plane_d - ad, bd - ad);
-    vec3d line_start_to_end = vector_sub(line_end, line_start);
-    vec3d line_to_intersect = vector_mul(&line_start_to_end, *t);
-    return vector_add(line_start, &line_to_intersect);
-}
-
-// return signed shortest distance from point to plane, plane normal must be normalized
-fx32 dist_point_to_plane(vec3d* plane_p, vec3d* plane_n, vec3d* p) {
-    return (MUL(plane_n->x, p->x) + MUL(plane_n->y, p->y) + MUL(plane_n->z, p->z) -
-            vector_dot_product(plane_n, plane_p));
-}
-
-int triangle_clip_against_plane(vec3d plane_p, vec3d plane_n, triangle_t* in_tri, triangle_t* out_tri1,
-                                triangle_t* out_tri2) {
-    // create two temporary storage arrays to classify points either side of the plane
-    // if distance sign is positive, point lies on the inside of plane
-    vec3d* inside_points[3];
-    int nb_inside_points = 0;
-    vec3d* outside_points[3];
-    int nb_outside_points = 0;
-    vec2d* inside_texcoords[3];
-    int nb_inside_texcoords = 0;
-    vec2d* outside_texcoords[3];
-    int nb_outside_texcoords = 0;
-    vec3d* inside_colors[3];
-    int nb_inside_colors = 0;
-    vec3d* outside_colors[3];
-    int nb_outside_colors = 0;
-    vec3d* inside_normals[3];
-    int nb_inside_normals = 0;
-    vec3d* outside_normals[3];
-    int nb_outside_normals = 0;
-
-    // get signed distance of each point in triangle to plane
-    fx32 d0 = dist_point_to_plane(&plane_p, &plane_n, &in_tri->p[0]);
-    fx32 d1 = dist_point_to_plane(&plane_p, &plane_n, &in_tri->p[1]);
-    fx32 d2 = dist_point_to_plane(&plane_p, &plane_n, &in_tri->p[2]);
-
-    if (d0 >= FX(0.0f)) {
-        inside_points[nb_inside_points++] = &in_tri->p[0];
-        inside_texcoords[nb_inside_texcoords++] = &in_tri->t[0];
-        inside_colors[nb_inside_colors++] = &in_tri->c[0];
-        inside_normals[nb_inside_normals++] = &in_tri->n[0];
+// Append to the pool the vertex where the edge going from the inside vertex to the outside vertex crosses the
+// clipping plane, given their signed distances to the plane. Attributes which are known to be identical on both
+// vertices are copied instead of interpolated.
+static ALWAYS_INLINE int raster_vertex_intersect(raster_vertex_t* pool, int* nb_vertices, int in, fx32 d_in, int out,
+                                                 fx32 d_out, const bool varying_uv, const bool varying_rgba) {
+    raster_vertex_t* a = &pool[in];
+    raster_vertex_t* b = &pool[out];
+    raster_vertex_t* r = &pool[*nb_vertices];
+    fx32 t = DIV(-d_in, d_out - d_in);
+
+    r->x = MUL(b->x - a->x, t) + a->x;
+    r->y = MUL(b->y - a->y, t) + a->y;
+    r->z = MUL(b->z - a->z, t) + a->z;
+    if (varying_uv) {
+        r->u = MUL(b->u - a->u, t) + a->u;
+        r->v = MUL(b->v - a->v, t) + a->v;
     } else {
-        outside_points[nb_outside_points++] = &in_tri->p[0];
-        outside_texcoords[nb_outside_texcoords++] = &in_tri->t[0];
-        outside_colors[nb_outside_colors++] = &in_tri->c[0];
-        outside_normals[nb_outside_normals++] = &in_tri->n[0];
+        r->u = a->u;
+        r->v = a->v;
     }
-    if (d1 >= FX(0.0f)) {
-        inside_points[nb_inside_points++] = &in_tri->p[1];
-        inside_texcoords[nb_inside_texcoords++] = &in_tri->t[1];
-        inside_colors[nb_inside_colors++] = &in_tri->c[1];
-        inside_normals[nb_inside_normals++] = &in_tri->n[1];
+    if (varying_rgba) {
+        r->r = MUL(b->r - a->r, t) + a->r;
+        r->g = MUL(b->g - a->g, t) + a->g;
+        r->b = MUL(b->b - a->b, t) + a->b;
+        r->a = MUL(b->a - a->a, t) + a->a;
     } else {
-        outside_points[nb_outside_points++] = &in_tri->p[1];
-        outside_texcoords[nb_outside_texcoords++] = &in_tri->t[1];
-        outside_colors[nb_outside_colors++] = &in_tri->c[1];
-        outside_normals[nb_outside_normals++] = &in_tri->n[1];
-    }
-    if (d2 >= FX(0.0f)) {
-        inside_points[nb_inside_points++] = &in_tri->p[2];
-        inside_texcoords[nb_inside_texcoords++] = &in_tri->t[2];
-        inside_colors[nb_inside_colors++] = &in_tri->c[2];
-        inside_normals[nb_inside_normals++] = &in_tri->n[2];
-    } else {
-        outside_points[nb_outside_points++] = &in_tri->p[2];
-        outside_texcoords[nb_outside_texcoords] = &in_tri->t[2];
-        outside_colors[nb_outside_colors++] = &in_tri->c[2];
-        outside_normals[nb_outside_normals++] = &in_tri->n[2];
+        r->r = a->r;
+        r->g = a->g;
+        r->b = a->b;
+        r->a = a->a;
     }
 
-    // classify triangle points and break the input triangle into smaller output triangles if required
+    return (*nb_vertices)++;
+}
+
+// Clip the triangle made of the pool vertices in_tri against a plane, given the signed distance d of each vertex to
+// the plane (positive means inside). New vertices are appended to the pool and the resulting triangles are returned as
+// vertex indices.
+static ALWAYS_INLINE int triangle_clip_against_plane(raster_vertex_t* pool, int* nb_vertices, const int in_tri[3],
+                                                     const fx32 d[3], int out_tri1[3], int out_tri2[3],
+                                                     const bool varying_uv, const bool varying_rgba) {
+    // classify points either side of the plane
+    int inside_points[3], outside_points[3];
+    fx32 inside_dists[3], outside_dists[3];
+    int nb_inside_points = 0, nb_outside_points = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] >= FX(0.0f)) {
+            inside_points[nb_inside_points] = in_tri[i];
+            inside_dists[nb_inside_points++] = d[i];
+        } else {
+            outside_points[nb_outside_points] = in_tri[i];
+            outside_dists[nb_outside_points++] = d[i];
+        }
+    }
 
     if (nb_inside_points == 0) {
         // all points lie on the outside of the plane, so clip whole triangle
@@ -165,106 +149,37 @@ int triangle_clip_against_plane(vec3d plane_p, vec3d plane_n, triangle_t* in_tri
 
     if (nb_inside_points == 3) {
         // all points lie in the inside of plane, so do nothing and allow the triangle to simply pass through
-        *out_tri1 = *in_tri;
-
+        out_tri1[0] = in_tri[0];
+        out_tri1[1] = in_tri[1];
+        out_tri1[2] = in_tri[2];
         return 1;  // just the one returned original triangle is valid
     }
 
-    if (nb_inside_points == 1 && nb_outside_points == 2) {
-        // Triangle should be clipped. As two points lie outside the plane, the triangle simply becomes a smaller
-        // triangle.
-
-        // the inside point is valid, so keep that
-        out_tri1->p[0] = *inside_points[0];
-        out_tri1->t[0] = *inside_texcoords[0];
-        out_tri1->c[0] = *inside_colors[0];
-        out_tri1->n[0] = *inside_normals[0];
-
-        // but the two new points are at the location where the original sides of the triangle (lines) intersect with
-        // the plane
-        fx32 t;
-        out_tri1->p[1] = vector_intersect_plane(&plane_p, &plane_n, inside_points[0], outside_points[0], &t);
-        out_tri1->t[1].u = MUL(t, outside_texcoords[0]->u - inside_texcoords[0]->u) + inside_texcoords[0]->u;
-        out_tri1->t[1].v = MUL(t, outside_texcoords[0]->v - inside_texcoords[0]->v) + inside_texcoords[0]->v;
-        out_tri1->t[1].w = MUL(t, outside_texcoords[0]->w - inside_texcoords[0]->w) + inside_texcoords[0]->w;
-        out_tri1->c[1].x = MUL(t, outside_colors[0]->x - inside_colors[0]->x) + inside_colors[0]->x;
-        out_tri1->c[1].y = MUL(t, outside_colors[0]->y - inside_colors[0]->y) + inside_colors[0]->y;
-        out_tri1->c[1].z = MUL(t, outside_colors[0]->z - inside_colors[0]->z) + inside_colors[0]->z;
-        out_tri1->c[1].w = MUL(t, outside_colors[0]->w - inside_colors[0]->w) + inside_colors[0]->w;
-        out_tri1->n[1].x = MUL(t, outside_normals[0]->x - inside_normals[0]->x) + inside_normals[0]->x;
-        out_tri1->n[1].y = MUL(t, outside_normals[0]->y - inside_normals[0]->y) + inside_normals[0]->y;
-        out_tri1->n[1].z = MUL(t, outside_normals[0]->z - inside_normals[0]->z) + inside_normals[0]->z;
-        out_tri1->n[1].w = MUL(t, outside_normals[0]->w - inside_normals[0]->w) + inside_normals[0]->w;
-
-        out_tri1->p[2] = vector_intersect_plane(&plane_p, &plane_n, inside_points[0], outside_points[1], &t);
-        out_tri1->t[2].u = MUL(t, outside_texcoords[1]->u - inside_texcoords[0]->u) + inside_texcoords[0]->u;
-        out_tri1->t[2].v = MUL(t, outside_texcoords[1]->v - inside_texcoords[0]->v) + inside_texcoords[0]->v;
-        out_tri1->t[2].w = MUL(t, outside_texcoords[1]->w - inside_texcoords[0]->w) + inside_texcoords[0]->w;
-        out_tri1->c[2].x = MUL(t, outside_colors[1]->x - inside_colors[0]->x) + inside_colors[0]->x;
-        out_tri1->c[2].y = MUL(t, outside_colors[1]->y - inside_colors[0]->y) + inside_colors[0]->y;
-        out_tri1->c[2].z = MUL(t, outside_colors[1]->z - inside_colors[0]->z) + inside_colors[0]->z;
-        out_tri1->c[2].w = MUL(t, outside_colors[1]->w - inside_colors[0]->w) + inside_colors[0]->w;
-        out_tri1->n[2].x = MUL(t, outside_normals[1]->x - inside_normals[0]->x) + inside_normals[0]->x;
-        out_tri1->n[2].y = MUL(t, outside_normals[1]->y - inside_normals[0]->y) + inside_normals[0]->y;
-        out_tri1->n[2].z = MUL(t, outside_normals[1]->z - inside_normals[0]->z) + inside_normals[0]->z;
-        out_tri1->n[2].w = MUL(t, outside_normals[1]->w - inside_normals[0]->w) + inside_normals[0]->w;
-
+    if (nb_inside_points == 1) {
+        // As two points lie outside the plane, the triangle simply becomes a smaller triangle. The inside point is
+        // kept and the two new points are at the location where the original sides of the triangle intersect with the
+        // plane.
+        out_tri1[0] = inside_points[0];
+        out_tri1[1] = raster_vertex_intersect(pool, nb_vertices, inside_points[0], inside_dists[0], outside_points[0],
+                                              outside_dists[0], varying_uv, varying_rgba);
+        out_tri1[2] = raster_vertex_intersect(pool, nb_vertices, inside_points[0], inside_dists[0], outside_points[1],
+                                              outside_dists[1], varying_uv, varying_rgba);
         return 1;  // return the newly formed single triangle
     }
 
-    if (nb_inside_points == 2 && nb_outside_points == 1) {
-        // Triangle should be clipped. As two points lie inside the plane, the clipped triangle becomes a "quad".
-        // Fortunately, we can represent a quad with two new triangles.
-
-        fx32 t;
-
-        // The first triangle consists of the two inside points and a new point determined by the location where one
-        // side of the triangle intersects with the plane
-        out_tri1->p[0] = *inside_points[0];
-        out_tri1->t[0] = *inside_texcoords[0];
-        out_tri1->c[0] = *inside_colors[0];
-        out_tri1->p[1] = *inside_points[1];
-        out_tri1->t[1] = *inside_texcoords[1];
-        out_tri1->c[1] = *inside_colors[1];
-        out_tri1->p[2] = vector_intersect_plane(&plane_p, &plane_n, inside_points[0], outside_points[0], &t);
-        out_tri1->t[2].u = MUL(t, outside_texcoords[0]->u - inside_texcoords[0]->u) + inside_texcoords[0]->u;
-        out_tri1->t[2].v = MUL(t, outside_texcoords[0]->v - inside_texcoords[0]->v) + inside_texcoords[0]->v;
-        out_tri1->t[2].w = MUL(t, outside_texcoords[0]->w - inside_texcoords[0]->w) + inside_texcoords[0]->w;
-        out_tri1->c[2].x = MUL(t, outside_colors[0]->x - inside_colors[0]->x) + inside_colors[0]->x;
-        out_tri1->c[2].y = MUL(t, outside_colors[0]->y - inside_colors[0]->y) + inside_colors[0]->y;
-        out_tri1->c[2].z = MUL(t, outside_colors[0]->z - inside_colors[0]->z) + inside_colors[0]->z;
-        out_tri1->c[2].w = MUL(t, outside_colors[0]->w - inside_colors[0]->w) + inside_colors[0]->w;
-        out_tri1->n[2].x = MUL(t, outside_normals[0]->x - inside_normals[0]->x) + inside_normals[0]->x;
-        out_tri1->n[2].y = MUL(t, outside_normals[0]->y - inside_normals[0]->y) + inside_normals[0]->y;
-        out_tri1->n[2].z = MUL(t, outside_normals[0]->z - inside_normals[0]->z) + inside_normals[0]->z;
-        out_tri1->n[2].w = MUL(t, outside_normals[0]->w - inside_normals[0]->w) + inside_normals[0]->w;
-
-        // The second triangle is composed of one the the inside points, a new point determined by the intersection
-        // of the other side of the triangle and the plane, and the newly created point above
-        out_tri2->p[0] = *inside_points[1];
-        out_tri2->t[0] = *inside_texcoords[1];
-        out_tri2->c[0] = *inside_colors[1];
-        out_tri2->p[1] = vector_intersect_plane(&plane_p, &plane_n, inside_points[1], outside_points[0], &t);
-        out_tri2->t[1].u = MUL(t, outside_texcoords[0]->u - inside_texcoords[1]->u) + inside_texcoords[1]->u;
-        out_tri2->t[1].v = MUL(t, outside_texcoords[0]->v - inside_texcoords[1]->v) + inside_texcoords[1]->v;
-        out_tri2->t[1].w = MUL(t, outside_texcoords[0]->w - inside_texcoords[1]->w) + inside_texcoords[1]->w;
-        out_tri2->c[1].x = MUL(t, outside_colors[0]->x - inside_colors[1]->x) + inside_colors[1]->x;
-        out_tri2->c[1].y = MUL(t, outside_colors[0]->y - inside_colors[1]->y) + inside_colors[1]->y;
-        out_tri2->c[1].z = MUL(t, outside_colors[0]->z - inside_colors[1]->z) + inside_colors[1]->z;
-        out_tri2->c[1].w = MUL(t, outside_colors[0]->w - inside_colors[1]->w) + inside_colors[1]->w;
-        out_tri2->n[1].x = MUL(t, outside_normals[0]->x - inside_normals[1]->x) + inside_normals[1]->x;
-        out_tri2->n[1].y = MUL(t, outside_normals[0]->y - inside_normals[1]->y) + inside_normals[1]->y;
-        out_tri2->n[1].z = MUL(t, outside_normals[0]->z - inside_normals[1]->z) + inside_normals[1]->z;
-        out_tri2->n[1].w = MUL(t, outside_normals[0]->w - inside_normals[1]->w) + inside_normals[1]->w;
-        out_tri2->p[2] = out_tri1->p[2];
-        out_tri2->t[2] = out_tri1->t[2];
-        out_tri2->c[2] = out_tri1->c[2];
-        out_tri2->n[2] = out_tri1->n[2];
-
-        return 2;  // return two newly formed triangles which form a quad
-    }
+    // As two points lie inside the plane, the clipped triangle becomes a "quad" represented by two triangles sharing
+    // the intersection point of the first inside side.
+    out_tri1[0] = inside_points[0];
+    out_tri1[1] = inside_points[1];
+    out_tri1[2] = raster_vertex_intersect(pool, nb_vertices, inside_points[0], inside_dists[0], outside_points[0],
+                                          outside_dists[0], varying_uv, varying_rgba);
+
+    out_tri2[0] = inside_points[1];
+    out_tri2[1] = raster_vertex_intersect(pool, nb_vertices, inside_points[1], inside_dists[1], outside_points[0],
+                                          outside_dists[0], varying_uv, varying_rgba);
+    out_tri2[2] = out_tri1[2];
 
-    return 0;  // should not happen
+    return 2;  // return two newly formed triangles which form a quad
 }
 
 mat4x4 matrix_make_identity() {
@@ -322,6 +237,7 @@ mat4x4 matrix_make_rotation_y(float theta) {
     mat_rot_y.m[1][1] = FX(1.0f);
     mat_rot_y.m[2][0] = FX(sinf(theta));
     mat_rot_y.m[2][2] = FX(cosf(theta));
+    mat_rot_y.m[3][3] = FX(1.0f);
 
     return mat_rot_y;
 }
@@ -433,17 +349,75 @@ mat4x4 matrix_quick_inverse(mat4x4* m) {
     return mat;
 }
 
+aabb_t mesh_bounds(mesh_t* mesh) {
+    aabb_t box = {{FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)}, {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)}};
+    for (size_t i = 0; i < mesh->nb_vertices; ++i) {
+        vec3d* v = &mesh->vertices[i];
+        if (i == 0 || v->x < box.min.x) box.min.x = v->x;
+        if (i == 0 || v->y < box.min.y) box.min.y = v->y;
+        if (i == 0 || v->z < box.min.z) box.min.z = v->z;
+        if (i == 0 || v->x > box.max.x) box.max.x = v->x;
+        if (i == 0 || v->y > box.max.y) box.max.y = v->y;
+        if (i == 0 || v->z > box.max.z) box.max.z = v->z;
+    }
+    return box;
+}
+
+// bounds of the transformed corners of a box
+aabb_t aabb_transform(aabb_t* box, mat4x4* m) {
+    aabb_t r;
+    for (int i = 0; i < 8; ++i) {
+        vec3d corner = {(i & 1) ? box->max.x : box->min.x, (i & 2) ? box->max.y : box->min.y,
+                        (i & 4) ? box->max.z : box->min.z, FX(1.0f)};
+        vec3d p = matrix_multiply_vector(m, &corner);
+        if (i == 0 || p.x < r.min.x) r.min.x = p.x;
+        if (i == 0 || p.y < r.min.y) r.min.y = p.y;
+        if (i == 0 || p.z < r.min.z) r.min.z = p.z;
+        if (i == 0 || p.x > r.max.x) r.max.x = p.x;
+        if (i == 0 || p.y > r.max.y) r.max.y = p.y;
+        if (i == 0 || p.z > r.max.z) r.max.z = p.z;
+    }
+    r.min.w = r.max.w = FX(1.0f);
+    return r;
+}
+
+// Conservative visibility test of a box against the view frustum (near plane, screen edges and, if view_distance is
+// not zero, far plane). The box is only rejected when all its corners lie outside of the same clipping plane in clip
+// space.
+bool aabb_is_visible_within(aabb_t* box, mat4x4* mat_world_view_proj, fx32 view_distance) {
+    int nb_outside[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 8; ++i) {
+        vec3d corner = {(i & 1) ? box->max.x : box->min.x, (i & 2) ? box->max.y : box->min.y,
+                        (i & 4) ? box->max.z : box->min.z, FX(1.0f)};
+        vec3d p = matrix_multiply_vector(mat_world_view_proj, &corner);
+        if (p.w < FX(0.1f)) nb_outside[0]++;
+        if (p.x < -p.w) nb_outside[1]++;
+        if (p.x > p.w) nb_outside[2]++;
+        if (p.y < -p.w) nb_outside[3]++;
+        if (p.y > p.w) nb_outside[4]++;
+        if (view_distance > FX(0.0f) && p.w > view_distance) nb_outside[5]++;
+    }
+    for (int j = 0; j < 6; ++j)
+        if (nb_outside[j] == 8) return false;
+    return true;
+}
+
+bool aabb_is_visible(aabb_t* box, mat4x4* mat_world_view_proj) {
+    return aabb_is_visible_within(box, mat_world_view_proj, FX(0.0f));
+}
+
 #if SORT_TRIANGLES
 
-void swap_triangle(triangle_t* a, triangle_t* b) {
-    triangle_t c = *a;
+void swap_triangle(raster_triangle_t* a, raster_triangle_t* b) {
+    raster_triangle_t c = *a;
     *a = *b;
     *b = c;
 }
 
-fx32 triangle_depth(triangle_t* tri) { return DIV(tri->p[0].z + tri->p[1].z + tri->p[2].z, FX(3.0f)); }
+// the vertices hold 1/w, so negate it to get a depth growing with the distance
+fx32 triangle_depth(raster_triangle_t* tri) { return -DIV(tri->v[0].z + tri->v[1].z + tri->v[2].z, FX(3.0f)); }
 
-size_t sort_triangles_partition(triangle_t triangles[], size_t nb_triangles, size_t l, size_t h) {
+size_t sort_triangles_partition(raster_triangle_t triangles[], size_t nb_triangles, size_t l, size_t h) {
     size_t i, j;
     fx32 pivot;
     pivot = triangle_depth(&triangles[l]);
@@ -465,7 +439,7 @@ size_t sort_triangles_partition(triangle_t triangles[], size_t nb_triangles, siz
     return j;
 }
 
-void sort_triangles_lh(triangle_t triangles[], size_t nb_triangles, size_t l, size_t h) {
+void sort_triangles_lh(raster_triangle_t triangles[], size_t nb_triangles, size_t l, size_t h) {
     size_t j;
 
     if (l < h) {
@@ -475,7 +449,7 @@ void sort_triangles_lh(triangle_t triangles[], size_t nb_triangles, size_t l, si
     }
 }
 
-void sort_triangles(triangle_t triangles[], size_t nb_triangles) {
+void sort_triangles(raster_triangle_t triangles[], size_t nb_triangles) {
     sort_triangles_lh(triangles, nb_triangles, 0, nb_triangles);
 }
 #endif // SORT_TRIANGLES
@@ -525,7 +499,7 @@ void draw_line(vec3d v0, vec3d v1, vec2d uv0, vec2d uv1, vec3d c0, vec3d c1, fx3
         {c1.x, c1.y, c1.z, c1.w}
     };
 
-    xd_draw_triangle(pp0, tt0, cc0, texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, false, perspective_correct);
+    xd_draw_triangle(pp0, tt0, cc0, texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, false, perspective_correct, false);
 
     vec3d pp1[3] = {
         {vv1.x, vv1.y, vv1.z, FX(0.0)},
@@ -545,105 +519,247 @@ void draw_line(vec3d v0, vec3d v1, vec2d uv0, vec2d uv1, vec3d c0, vec3d c1, fx3
         {c1.x, c1.y, c1.z, c1.w}
     };    
 
-    xd_draw_triangle(pp1, tt1, cc1, texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, false, perspective_correct);
+    xd_draw_triangle(pp1, tt1, cc1, texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, false, perspective_correct, false);
 }
 
-void draw_model(int viewport_width, int viewport_height, vec3d* vec_camera, model_t* model, mat4x4* mat_world,
-                mat4x4* mat_normal, mat4x4* mat_proj, mat4x4* mat_view, light_t* lights, size_t nb_lights, bool is_wireframe, texture_t* texture,
-                bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y, bool perspective_correct) {
-    size_t triangle_to_raster_index = 0;
+static ALWAYS_INLINE void raster_vertex_project(raster_vertex_t* v, mat4x4* mat_proj, fx32 half_width,
+                                                fx32 half_height, const bool perspective_correct,
+                                                const bool varying_uv) {
+    // project from 3D to 2D
+    vec3d p = {v->x, v->y, v->z, FX(1.0f)};
+    p = matrix_multiply_vector(mat_proj, &p);
 
-    // draw faces
-    for (size_t i = 0; i < model->mesh.nb_faces; ++i) {
-        face_t* face = &model->mesh.faces[i];
-        triangle_t tri;
-        tri.p[0] = model->mesh.vertices[face->indices[0]];
-        tri.p[1] = model->mesh.vertices[face->indices[1]];
-        tri.p[2] = model->mesh.vertices[face->indices[2]];
-        if (model->mesh.texcoords) {
-            tri.t[0] = model->mesh.texcoords[face->tex_indices[0]];
-            tri.t[1] = model->mesh.texcoords[face->tex_indices[1]];
-            tri.t[2] = model->mesh.texcoords[face->tex_indices[2]];
-        } else {
-            tri.t[0] = (vec2d){FX(0.0f), FX(0.0f)};
-            tri.t[1] = (vec2d){FX(0.0f), FX(0.0f)};
-            tri.t[2] = (vec2d){FX(0.0f), FX(0.0f)};
+    fx32 recip_w = DIV(FX(1.0f), p.w);
+
+    if (perspective_correct) {
+        // texture coordinates are zero when the mesh has none
+        if (varying_uv) {
+            v->u = MUL(v->u, recip_w);
+            v->v = MUL(v->v, recip_w);
         }
-        if (model->mesh.colors) {
-            tri.c[0] = model->mesh.colors[face->col_indices[0]];
-            tri.c[1] = model->mesh.colors[face->col_indices[1]];
-            tri.c[2] = model->mesh.colors[face->col_indices[2]];
-        } else {
-            tri.c[0] = (vec3d){FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
-            tri.c[1] = (vec3d){FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
-            tri.c[2] = (vec3d){FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+        v->r = MUL(v->r, recip_w);
+        v->g = MUL(v->g, recip_w);
+        v->b = MUL(v->b, recip_w);
+        v->a = MUL(v->a, recip_w);
+    }
+
+    // scale into view, invert the y value to account for flipped screen y coordinate and offset into visible
+    // normalized space
+    v->x = MUL(MUL(p.x, recip_w) + FX(1.0f), half_width);
+    v->y = MUL(-MUL(p.y, recip_w) + FX(1.0f), half_height);
+    v->z = recip_w;
+}
+
+// signed distance to the screen edge p, positive when inside the viewport
+static fx32 raster_vertex_screen_distance(raster_vertex_t* v, int p, int viewport_width, int viewport_height) {
+    switch (p) {
+        case 0:
+            return v->y;
+        case 1:
+            return FXI(viewport_height - 1) - v->y;
+        case 2:
+            return v->x;
+        default:
+            return FXI(viewport_width - 1) - v->x;
+    }
+}
+
+// arguments of draw_model shared by all its variants
+typedef struct {
+    int viewport_width, viewport_height;
+    vec3d* vec_camera;
+    model_t* model;
+    mat4x4* mat_world;
+    mat4x4* mat_normal;
+    mat4x4* mat_proj;
+    mat4x4* mat_view;
+    light_t* lights;
+    size_t nb_lights;
+    texture_t* texture;
+    bool clamp_s, clamp_t;
+    int texture_scale_x, texture_scale_y;
+    bool alpha_test;  // discard the fragments of the transparent texels
+} draw_model_params_t;
+
+enum { LIGHTING_NONE, LIGHTING_FLAT, LIGHTING_GOURAUD };
+
+static ALWAYS_INLINE void raster_triangle_draw(const draw_model_params_t* params, raster_vertex_t* v0,
+                                               raster_vertex_t* v1, raster_vertex_t* v2, const bool is_wireframe,
+                                               const bool perspective_correct) {
+    vec3d p[3] = {{v0->x, v0->y, v0->z, FX(1.0f)}, {v1->x, v1->y, v1->z, FX(1.0f)}, {v2->x, v2->y, v2->z, FX(1.0f)}};
+    vec2d t[3] = {{v0->u, v0->v, v0->z}, {v1->u, v1->v, v1->z}, {v2->u, v2->v, v2->z}};
+    vec3d c[3] = {{v0->r, v0->g, v0->b, v0->a}, {v1->r, v1->g, v1->b, v1->a}, {v2->r, v2->g, v2->b, v2->a}};
+
+    if (is_wireframe) {
+        for (int j = 0; j < 3; ++j) {
+            int k = (j + 1) % 3;
+            draw_line((vec3d){p[j].x, p[j].y, FX(0.0f), FX(0.0f)}, (vec3d){p[k].x, p[k].y, FX(0.0f), FX(0.0f)}, t[j],
+                      t[k], c[j], c[k], FX(1.0f), params->texture, params->clamp_s, params->clamp_t,
+                      params->texture_scale_x, params->texture_scale_y, perspective_correct);
         }
-        if (model->mesh.normals) {
-            tri.n[0] = model->mesh.normals[face->norm_indices[0]];
-            tri.n[1] = model->mesh.normals[face->norm_indices[1]];
-            tri.n[2] = model->mesh.normals[face->norm_indices[2]];
-        } else {
-            tri.n[0] = (vec3d){FX(0.0f), FX(0.0f), FX(0.0f), FX(0.0f)};
-            tri.n[1] = (vec3d){FX(0.0f), FX(0.0f), FX(0.0f), FX(0.0f)};
-            tri.n[2] = (vec3d){FX(0.0f), FX(0.0f), FX(0.0f), FX(0.0f)};
+    } else {
+        xd_draw_triangle(p, t, c, params->texture, params->clamp_s, params->clamp_t, params->texture_scale_x,
+                         params->texture_scale_y, true, perspective_correct, params->alpha_test);
+    }
+}
+
+// clip a projected triangle against all four screen edges and rasterize the resulting triangles
+static ALWAYS_INLINE void raster_triangle_clip_and_draw(const draw_model_params_t* params, raster_vertex_t* v0,
+                                                        raster_vertex_t* v1, raster_vertex_t* v2,
+                                                        const bool is_wireframe, const bool perspective_correct,
+                                                        const bool varying_uv, const bool varying_rgba) {
+    // clipping against the screen edges could yield a bunch of triangles
+    raster_vertex_t pool[MAX_NB_VERTICES];
+    int nb_vertices = 3;
+    pool[0] = *v0;
+    pool[1] = *v1;
+    pool[2] = *v2;
+
+    int triangles[2][MAX_NB_TRIANGLES][3] = {{{0, 1, 2}}};
+    int nb_triangles = 1;
+    int current = 0;
+
+    for (int p = 0; p < 4; ++p) {
+        int nb_clipped_triangles = 0;
+        for (int j = 0; j < nb_triangles; ++j) {
+            if (nb_clipped_triangles + 2 > MAX_NB_TRIANGLES) break;    // safety net
+
+            int* test = triangles[current][j];
+            fx32 d[3];
+            for (int k = 0; k < 3; ++k)
+                d[k] = raster_vertex_screen_distance(&pool[test[k]], p, params->viewport_width,
+                                                     params->viewport_height);
+            nb_clipped_triangles += triangle_clip_against_plane(
+                pool, &nb_vertices, test, d, triangles[!current][nb_clipped_triangles],
+                triangles[!current][nb_clipped_triangles + 1], varying_uv, varying_rgba);
         }
+        current = !current;
+        nb_triangles = nb_clipped_triangles;
+    }
 
-        triangle_t tri_viewed, tri_projected, tri_transformed;
-
-        tri_transformed.p[0] = matrix_multiply_vector(mat_world, &tri.p[0]);
-        tri_transformed.p[1] = matrix_multiply_vector(mat_world, &tri.p[1]);
-        tri_transformed.p[2] = matrix_multiply_vector(mat_world, &tri.p[2]);
-        tri_transformed.t[0] = tri.t[0];
-        tri_transformed.t[1] = tri.t[1];
-        tri_transformed.t[2] = tri.t[2];
-        tri_transformed.c[0] = tri.c[0];
-        tri_transformed.c[1] = tri.c[1];
-        tri_transformed.c[2] = tri.c[2];
-        if (mat_normal != NULL) {
-            tri_transformed.n[0] = matrix_multiply_vector(mat_normal, &tri.n[0]);
-            tri_transformed.n[1] = matrix_multiply_vector(mat_normal, &tri.n[1]);
-            tri_transformed.n[2] = matrix_multiply_vector(mat_normal, &tri.n[2]);
+    for (int j = 0; j < nb_triangles; ++j) {
+        raster_vertex_t* t0 = &pool[triangles[current][j][0]];
+        raster_vertex_t* t1 = &pool[triangles[current][j][1]];
+        raster_vertex_t* t2 = &pool[triangles[current][j][2]];
+
+        // make sure that the triangle is in clockwise order on screen
+        fx32 normal_z = MUL(t1->x - t0->x, t2->y - t0->y) - MUL(t1->y - t0->y, t2->x - t0->x);
+        if (normal_z > FX(0.0f)) {
+            raster_vertex_t* tv = t0;
+            t0 = t1;
+            t1 = tv;
         }
 
+        // rasterize triangle
+        raster_triangle_draw(params, t0, t1, t2, is_wireframe, perspective_correct);
+    }
+}
+
+// Body of draw_model. The flags are compile-time constants in each specialized variant so that the state branches and
+// the work on attributes which do not vary across the mesh are removed from the per-face loop.
+static ALWAYS_INLINE void draw_model_variant(const draw_model_params_t* params, const bool is_wireframe,
+                                             const bool perspective_correct, const int lighting,
+                                             const bool has_texcoords, const bool has_colors) {
+    model_t* model = params->model;
+    mesh_t* mesh = &model->mesh;
+    light_t* lights = params->lights;
+    size_t nb_lights = params->nb_lights;
+    fx32 half_width = FX(params->viewport_width / 2);
+    fx32 half_height = FX(params->viewport_height / 2);
+#if SORT_TRIANGLES
+    size_t triangle_to_raster_index = 0;
+#endif
+
+    // the color only varies across a triangle with per-vertex colors or lighting, or once divided by w
+    const bool varying_rgba = has_colors || lighting == LIGHTING_GOURAUD;
+    const bool varying_projected_rgba = varying_rgba || perspective_correct;
+
+    // draw faces, from the last one when they are rasterized right away, so that the ties of the depth test resolve
+    // like when the triangles were all stored and then drawn backwards
+    for (size_t f = 0; f < mesh->nb_faces; ++f) {
+#if SORT_TRIANGLES
+        size_t i = f;
+#else
+        size_t i = mesh->nb_faces - 1 - f;
+#endif
+        face_t* face = &mesh->faces[i];
+
+        // convert model space to world space, unless the vertices are already in world space
+        vec3d p[3];
+        for (int j = 0; j < 3; ++j)
+            p[j] = params->mat_world ? matrix_multiply_vector(params->mat_world, &mesh->vertices[face->indices[j]])
+                                     : mesh->vertices[face->indices[j]];
+
         // calculate the normal
         vec3d normal, line1, line2;
-        line1.x = tri_transformed.p[1].x - tri_transformed.p[0].x;
-        line1.y = tri_transformed.p[1].y - tri_transformed.p[0].y;
-        line1.z = tri_transformed.p[1].z - tri_transformed.p[0].z;
-
-        line2.x = tri_transformed.p[2].x - tri_transformed.p[0].x;
-        line2.y = tri_transformed.p[2].y - tri_transformed.p[0].y;
-        line2.z = tri_transformed.p[2].z - tri_transformed.p[0].z;
+        line1 = vector_sub(&p[1], &p[0]);
+        line2 = vector_sub(&p[2], &p[0]);
 
         // take the cross product of lines to get normal to triangle surface
         normal = vector_cross_product(&line1, &line2);
 
         // get ray from triangle to camera
-        vec3d vec_camera_ray = vector_sub(&tri_transformed.p[0], vec_camera);
+        vec3d vec_camera_ray = vector_sub(&p[0], params->vec_camera);
 
         // if ray is aligned with normal, then triangle is visible
-        if (vector_dot_product(&normal, &vec_camera_ray) < FX(0.0f)) {
-    
-            // illumination
+        if (vector_dot_product(&normal, &vec_camera_ray) >= FX(0.0f)) continue;
+
+        raster_vertex_t pool[MAX_NB_VERTICES];
+        int nb_vertices = 3;
+
+        for (int j = 0; j < 3; ++j) {
+            raster_vertex_t* v = &pool[j];
+            if (has_texcoords) {
+                v->u = mesh->texcoords[face->tex_indices[j]].u;
+                v->v = mesh->texcoords[face->tex_indices[j]].v;
+            } else {
+                v->u = FX(0.0f);
+                v->v = FX(0.0f);
+            }
+            if (has_colors) {
+                vec3d* c = &mesh->colors[face->col_indices[j]];
+                v->r = c->x;
+                v->g = c->y;
+                v->b = c->z;
+                v->a = c->w;
+            } else {
+                v->r = FX(1.0f);
+                v->g = FX(1.0f);
+                v->b = FX(1.0f);
+                v->a = FX(1.0f);
+            }
+        }
+
+        // illumination
+        if (lighting != LIGHTING_NONE) {
             vec3d color[3] = {
                 {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)},
                 {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)},
                 {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)}
             };
 
+            vec3d n[3];
+            if (lighting == LIGHTING_GOURAUD) {
+                for (int j = 0; j < 3; ++j)
+                    n[j] = matrix_multiply_vector(params->mat_normal, &mesh->normals[face->norm_indices[j]]);
+            } else {
+                // how "aligned" are light direction and triangle surface normal?
+                n[0] = vector_mul(&normal, FXI(16)); // to fix precision issue with small triangles in fixed point
+                n[0] = vector_normalize(&n[0]);
+            }
+
             for (size_t light_index = 0; light_index < nb_lights; ++light_index) {
                 vec3d light_direction = lights[light_index].direction;
                 fx32 diffuse_intensity[3];
 
-                if ((model->mesh.nb_normals > 0) && (mat_normal != NULL)) {
+                if (lighting == LIGHTING_GOURAUD) {
 
                     //
                     // Gouraud shading
                     //
 
                     for (int j = 0; j < 3; ++j) {
-                        vec3d n = tri_transformed.n[j];
-                        fx32 dp = -vector_dot_product(&light_direction, &n);
+                        fx32 dp = -vector_dot_product(&light_direction, &n[j]);
                         if (dp < FX(0.0f)) dp = FX(0.0f);
                         diffuse_intensity[j] = dp;
                     }
@@ -654,10 +770,7 @@ void draw_model(int viewport_width, int viewport_height, vec3d* vec_camera, mode
                     // Flat shading
                     //
 
-                    // how "aligned" are light direction and triangle surface normal?
-                    vec3d n = vector_mul(&normal, FXI(16)); // to fix precision issue with small triangles in fixed point
-                    n = vector_normalize(&n);
-                    fx32 dp = -vector_dot_product(&light_direction, &n);
+                    fx32 dp = -vector_dot_product(&light_direction, &n[0]);
 
                     if (dp < FX(0.0f)) dp = FX(0.0f);
 
@@ -677,225 +790,138 @@ void draw_model(int viewport_width, int viewport_height, vec3d* vec_camera, mode
                 }
             } // for each light
 
-            if (nb_lights > 0) {
-                for (int j = 0; j < 3; ++j) {
-                    color[j] = vector_clamp(&color[j]);
-                    tri_transformed.c[j].x = MUL(tri_transformed.c[j].x, color[j].x);
-                    tri_transformed.c[j].y = MUL(tri_transformed.c[j].y, color[j].y);
-                    tri_transformed.c[j].z = MUL(tri_transformed.c[j].z, color[j].z);
-                }
+            for (int j = 0; j < 3; ++j) {
+                color[j] = vector_clamp(&color[j]);
+                pool[j].r = MUL(pool[j].r, color[j].x);
+                pool[j].g = MUL(pool[j].g, color[j].y);
+                pool[j].b = MUL(pool[j].b, color[j].z);
             }
+        }
 
-            // convert world space to view space
-            tri_viewed.p[0] = matrix_multiply_vector(mat_view, &tri_transformed.p[0]);
-            tri_viewed.p[1] = matrix_multiply_vector(mat_view, &tri_transformed.p[1]);
-            tri_viewed.p[2] = matrix_multiply_vector(mat_view, &tri_transformed.p[2]);
-            tri_viewed.t[0] = tri_transformed.t[0];
-            tri_viewed.t[1] = tri_transformed.t[1];
-            tri_viewed.t[2] = tri_transformed.t[2];
-            tri_viewed.c[0] = tri_transformed.c[0];
-            tri_viewed.c[1] = tri_transformed.c[1];
-            tri_viewed.c[2] = tri_transformed.c[2];
-
-            // clip viewed triangle against near plane, this could form two additional triangles
-            int nb_clipped_triangles = 0;
-            triangle_t clipped[2];
-            const fx32 z_near = FX(0.1f);
-            vec3d plane_p = {FX(0.0f), FX(0.0f), z_near, FX(1.0f)};
-            vec3d plane_n = {FX(0.0f), FX(0.0f), FX(1.0f), FX(1.0f)};
-            nb_clipped_triangles = triangle_clip_against_plane(plane_p, plane_n, &tri_viewed, &clipped[0], &clipped[1]);
-
-            for (int n = 0; n < nb_clipped_triangles; ++n) {
-                // project triangles from 3D to 2D
-                tri_projected.p[0] = matrix_multiply_vector(mat_proj, &clipped[n].p[0]);
-                tri_projected.p[1] = matrix_multiply_vector(mat_proj, &clipped[n].p[1]);
-                tri_projected.p[2] = matrix_multiply_vector(mat_proj, &clipped[n].p[2]);
-                tri_projected.t[0] = clipped[n].t[0];
-                tri_projected.t[1] = clipped[n].t[1];
-                tri_projected.t[2] = clipped[n].t[2];
-                tri_projected.c[0] = clipped[n].c[0];
-                tri_projected.c[1] = clipped[n].c[1];
-                tri_projected.c[2] = clipped[n].c[2];
-
-                fx32 recip_w[3] = {
-                    DIV(FX(1.0f), tri_projected.p[0].w),
-                    DIV(FX(1.0f), tri_projected.p[1].w),
-                    DIV(FX(1.0f), tri_projected.p[2].w)
-                };
-
-                if (perspective_correct) {
-                    tri_projected.t[0].u = MUL(tri_projected.t[0].u, recip_w[0]);
-                    tri_projected.t[1].u = MUL(tri_projected.t[1].u, recip_w[1]);
-                    tri_projected.t[2].u = MUL(tri_projected.t[2].u, recip_w[2]);
-
-                    tri_projected.t[0].v = MUL(tri_projected.t[0].v, recip_w[0]);
-                    tri_projected.t[1].v = MUL(tri_projected.t[1].v, recip_w[1]);
-                    tri_projected.t[2].v = MUL(tri_projected.t[2].v, recip_w[2]);
-
-                    tri_projected.c[0].x = MUL(tri_projected.c[0].x, recip_w[0]);
-                    tri_projected.c[1].x = MUL(tri_projected.c[1].x, recip_w[1]);
-                    tri_projected.c[2].x = MUL(tri_projected.c[2].x, recip_w[2]);
-
-                    tri_projected.c[0].y = MUL(tri_projected.c[0].y, recip_w[0]);
-                    tri_projected.c[1].y = MUL(tri_projected.c[1].y, recip_w[1]);
-                    tri_projected.c[2].y = MUL(tri_projected.c[2].y, recip_w[2]);
-
-                    tri_projected.c[0].z = MUL(tri_projected.c[0].z, recip_w[0]);
-                    tri_projected.c[1].z = MUL(tri_projected.c[1].z, recip_w[1]);
-                    tri_projected.c[2].z = MUL(tri_projected.c[2].z, recip_w[2]);
-
-                    tri_projected.c[0].w = MUL(tri_projected.c[0].w, recip_w[0]);
-                    tri_projected.c[1].w = MUL(tri_projected.c[1].w, recip_w[1]);
-                    tri_projected.c[2].w = MUL(tri_projected.c[2].w, recip_w[2]);
-                }
+        // convert world space to view space
+        fx32 d[3];
+        const fx32 z_near = FX(0.1f);
+        for (int j = 0; j < 3; ++j) {
+            vec3d p_viewed = matrix_multiply_vector(params->mat_view, &p[j]);
+            pool[j].x = p_viewed.x;
+            pool[j].y = p_viewed.y;
+            pool[j].z = p_viewed.z;
+            d[j] = p_viewed.z - z_near;
+        }
 
-                tri_projected.t[0].w = recip_w[0];
-                tri_projected.t[1].w = recip_w[1];
-                tri_projected.t[2].w = recip_w[2];
-
-                // scale into view
-                tri_projected.p[0] = vector_mul(&tri_projected.p[0], recip_w[0]);
-                tri_projected.p[1] = vector_mul(&tri_projected.p[1], recip_w[1]);
-                tri_projected.p[2] = vector_mul(&tri_projected.p[2], recip_w[2]);
-
-                // Invert the y values to account for flipped screen y coordinate
-                tri_projected.p[0].y = -tri_projected.p[0].y;
-                tri_projected.p[1].y = -tri_projected.p[1].y;
-                tri_projected.p[2].y = -tri_projected.p[2].y;
-
-                // offset vertices into visible normalized space
-                vec3d vec_offset_view = {FX(1.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
-                tri_projected.p[0] = vector_add(&tri_projected.p[0], &vec_offset_view);
-                tri_projected.p[1] = vector_add(&tri_projected.p[1], &vec_offset_view);
-                tri_projected.p[2] = vector_add(&tri_projected.p[2], &vec_offset_view);
-
-                fx32 w = FX(viewport_width / 2);
-                fx32 h = FX(viewport_height / 2);
-                tri_projected.p[0].x = MUL(tri_projected.p[0].x, w);
-                tri_projected.p[0].y = MUL(tri_projected.p[0].y, h);
-                tri_projected.p[1].x = MUL(tri_projected.p[1].x, w);
-                tri_projected.p[1].y = MUL(tri_projected.p[1].y, h);
-                tri_projected.p[2].x = MUL(tri_projected.p[2].x, w);
-                tri_projected.p[2].y = MUL(tri_projected.p[2].y, h);
-
-                // store triangle for sorting
-                model->triangles_to_raster[triangle_to_raster_index] = tri_projected;
-                triangle_to_raster_index++;
-            }
+        // clip viewed triangle against near plane, this could form two additional triangles
+        const int tri_viewed[3] = {0, 1, 2};
+        int clipped[2][3];
+        int nb_clipped_triangles = triangle_clip_against_plane(pool, &nb_vertices, tri_viewed, d, clipped[0],
+                                                               clipped[1], has_texcoords, varying_rgba);
+
+        // project the vertices in front of the near plane
+        for (int j = 0; j < nb_vertices; ++j) {
+            if (j >= 3 || d[j] >= FX(0.0f))
+                raster_vertex_project(&pool[j], params->mat_proj, half_width, half_height, perspective_correct,
+                                      has_texcoords);
+        }
+
+#if SORT_TRIANGLES
+        // store triangles for sorting
+        for (int n = 0; n < nb_clipped_triangles; ++n) {
+            raster_triangle_t* tri_projected = &model->triangles_to_raster[triangle_to_raster_index++];
+            tri_projected->v[0] = pool[clipped[n][0]];
+            tri_projected->v[1] = pool[clipped[n][1]];
+            tri_projected->v[2] = pool[clipped[n][2]];
         }
+#else
+        // rasterize the triangles right away
+        for (int n = nb_clipped_triangles - 1; n >= 0; --n)
+            raster_triangle_clip_and_draw(params, &pool[clipped[n][0]], &pool[clipped[n][1]], &pool[clipped[n][2]],
+                                          is_wireframe, perspective_correct, has_texcoords, varying_projected_rgba);
+#endif
     }
 
 #if SORT_TRIANGLES
     // sort triangles from front to back
     sort_triangles(model->triangles_to_raster, triangle_to_raster_index);
-#endif
 
     for (size_t i = 0; i < triangle_to_raster_index; ++i) {
-        triangle_t tri_to_raster = model->triangles_to_raster[triangle_to_raster_index - i - 1];
-
-        // clip triangles against all four screen edges, this could yield a bunch of triangles
-        triangle_t clipped[2];
-        triangle_t triangles[MAX_NB_TRIANGLES];
-        int nb_triangles = 0;
-        triangles[nb_triangles++] = tri_to_raster;
-
-        int nb_new_triangles = 1;
-
-        for (int p = 0; p < 4; ++p) {
-            int nb_tris_to_add = 0;
-            while (nb_new_triangles > 0) {
-                // pop front
-                triangle_t test = triangles[0];
-                for (int j = 1; j < nb_triangles; ++j) triangles[j - 1] = triangles[j];
-                nb_triangles--;
-
-                nb_new_triangles--;
-
-                switch (p) {
-                    case 0: {
-                        vec3d p = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
-                        vec3d n = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
-                        nb_tris_to_add = triangle_clip_against_plane(p, n, &test, &clipped[0], &clipped[1]);
-                        break;
-                    }
-                    case 1: {
-                        vec3d p = {FX(0.0f), FX((float)(viewport_height - 1)), FX(0.0f), FX(1.0f)};
-                        vec3d n = {FX(0.0f), FX(-1.0f), FX(0.0f), FX(1.0f)};
-                        nb_tris_to_add = triangle_clip_against_plane(p, n, &test, &clipped[0], &clipped[1]);
-                        break;
-                    }
-                    case 2: {
-                        vec3d p = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
-                        vec3d n = {FX(1.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
-                        nb_tris_to_add = triangle_clip_against_plane(p, n, &test, &clipped[0], &clipped[1]);
-                        break;
-                    }
-                    case 3: {
-                        vec3d p = {FX((float)(viewport_width - 1)), FX(0.0f), FX(0.0f), FX(1.0f)};
-                        vec3d n = {FX(-1.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
-                        nb_tris_to_add = triangle_clip_against_plane(p, n, &test, &clipped[0], &clipped[1]);
-                        break;
-                    }
-                }
+        raster_triangle_t* tri_to_raster = &model->triangles_to_raster[triangle_to_raster_index - i - 1];
+        raster_triangle_clip_and_draw(params, &tri_to_raster->v[0], &tri_to_raster->v[1], &tri_to_raster->v[2],
+                                      is_wireframe, perspective_correct, has_texcoords, varying_projected_rgba);
+    }
+#endif
+}
 
-                // push back
-                if (nb_triangles + nb_tris_to_add > MAX_NB_TRIANGLES) break;    // safety net
-                for (int w = 0; w < nb_tris_to_add; ++w) triangles[nb_triangles++] = clipped[w];
-            }
-            nb_new_triangles = nb_triangles;
-        }
+#if SPECIALIZE_DRAW_MODEL
 
-        for (int i = 0; i < nb_triangles; ++i) {
-            triangle_t* t = &triangles[i];
-
-            // calculate the normal
-            vec3d normal, line1, line2;
-            line1.x = t->p[1].x - t->p[0].x;
-            line1.y = t->p[1].y - t->p[0].y;
-            line1.z = t->p[1].z - t->p[0].z;
-
-            line2.x = t->p[2].x - t->p[0].x;
-            line2.y = t->p[2].y - t->p[0].y;
-            line2.z = t->p[2].z - t->p[0].z;
-
-            // take the cross product of lines to get normal to triangle surface
-            normal = vector_cross_product(&line1, &line2);
-
-            if (normal.z > FX(0.0f)) {
-                vec3d tp = t->p[0];
-                vec2d tt = t->t[0];
-                vec3d tc = t->c[0];
-                t->p[0] = t->p[1];
-                t->t[0] = t->t[1];
-                t->c[0] = t->c[1];
-                t->p[1] = tp;
-                t->t[1] = tt;
-                t->c[1] = tc;
-            }
+typedef void (*draw_model_fn_t)(const draw_model_params_t* params);
 
-            // rasterize triangle
-            if (is_wireframe) {
-                draw_line((vec3d){t->p[0].x, t->p[0].y, FX(0.0f), FX(0.0f)},
-                          (vec3d){t->p[1].x, t->p[1].y, FX(0.0f), FX(0.0f)},
-                          (vec2d){t->t[0].u, t->t[0].v, t->t[0].w},
-                          (vec2d){t->t[1].u, t->t[1].v, t->t[1].w},
-                          (vec3d){t->c[0].x, t->c[0].y, t->c[0].z, t->c[0].w},
-                          (vec3d){t->c[1].x, t->c[1].y, t->c[1].z, t->c[1].w}, FX(1.0f), texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, perspective_correct);
-                draw_line((vec3d){t->p[1].x, t->p[1].y, FX(0.0f), FX(0.0f)},
-                          (vec3d){t->p[2].x, t->p[2].y, FX(0.0f), FX(0.0f)},
-                          (vec2d){t->t[1].u, t->t[1].v, t->t[1].w},
-                          (vec2d){t->t[2].u, t->t[2].v, t->t[2].w},
-                          (vec3d){t->c[1].x, t->c[1].y, t->c[1].z, t->c[1].w},
-                          (vec3d){t->c[2].x, t->c[2].y, t->c[2].z, t->c[2].w}, FX(1.0f), texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, perspective_correct);
-                draw_line((vec3d){t->p[2].x, t->p[2].y, FX(0.0f), FX(0.0f)},
-                          (vec3d){t->p[0].x, t->p[0].y, FX(0.0f), FX(0.0f)},
-                          (vec2d){t->t[2].u, t->t[2].v, t->t[2].w},
-                          (vec2d){t->t[0].u, t->t[0].v, t->t[0].w},
-                          (vec3d){t->c[2].x, t->c[2].y, t->c[2].z, t->c[2].w},
-                          (vec3d){t->c[0].x, t->c[0].y, t->c[0].z, t->c[0].w}, FX(1.0f), texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, perspective_correct);
-            } else {
-                xd_draw_triangle(t->p, t->t, t->c, texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, true, perspective_correct);
-            }
-        }
+// X-macro enumerating every combination of wireframe, perspective correction, lighting, texture coordinates and
+// colors, in the order of the index computed by draw_model
+#define DRAW_MODEL_VARIANTS_COL(wf, pc, li, tc) DRAW_MODEL_VARIANT(wf, pc, li, tc, 0) DRAW_MODEL_VARIANT(wf, pc, li, tc, 1)
+#define DRAW_MODEL_VARIANTS_TC(wf, pc, li) DRAW_MODEL_VARIANTS_COL(wf, pc, li, 0) DRAW_MODEL_VARIANTS_COL(wf, pc, li, 1)
+#define DRAW_MODEL_VARIANTS_LI(wf, pc) \
+    DRAW_MODEL_VARIANTS_TC(wf, pc, 0) DRAW_MODEL_VARIANTS_TC(wf, pc, 1) DRAW_MODEL_VARIANTS_TC(wf, pc, 2)
+#define DRAW_MODEL_VARIANTS_PC(wf) DRAW_MODEL_VARIANTS_LI(wf, 0) DRAW_MODEL_VARIANTS_LI(wf, 1)
+#define DRAW_MODEL_VARIANTS DRAW_MODEL_VARIANTS_PC(0) DRAW_MODEL_VARIANTS_PC(1)
+
+#define DRAW_MODEL_VARIANT(wf, pc, li, tc, col)                                    \
+    static void draw_model_##wf##pc##li##tc##col(const draw_model_params_t* params) { \
+        draw_model_variant(params, wf, pc, li, tc, col);                           \
     }
-}
\ No newline at end of file
+DRAW_MODEL_VARIANTS
+#undef DRAW_MODEL_VARIANT
+
+#define DRAW_MODEL_VARIANT(wf, pc, li, tc, col) draw_model_##wf##pc##li##tc##col,
+static const draw_model_fn_t g_draw_model_variants[] = {DRAW_MODEL_VARIANTS};
+#undef DRAW_MODEL_VARIANT
+
+#endif  // SPECIALIZE_DRAW_MODEL
+
+void draw_model(int viewport_width, int viewport_height, vec3d* vec_camera, model_t* model, mat4x4* mat_world,
+                mat4x4* mat_normal, mat4x4* mat_proj, mat4x4* mat_view, light_t* lights, size_t nb_lights, bool is_wireframe, texture_t* texture,
+                bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y, bool perspective_correct) {
+    draw_model_params_t params = {viewport_width, viewport_height, vec_camera, model, mat_world, mat_normal, mat_proj,
+                                  mat_view, lights, nb_lights, texture, clamp_s, clamp_t, texture_scale_x,
+                                  texture_scale_y, false};
+
+    int lighting = LIGHTING_NONE;
+    if (nb_lights > 0) lighting = (model->mesh.nb_normals > 0 && mat_normal != NULL) ? LIGHTING_GOURAUD : LIGHTING_FLAT;
+    bool has_texcoords = model->mesh.texcoords != NULL;
+    bool has_colors = model->mesh.colors != NULL;
+
+#if SPECIALIZE_DRAW_MODEL
+    int index = (((((is_wireframe ? 1 : 0) * 2 + (perspective_correct ? 1 : 0)) * 3 + lighting) * 2 +
+                  (has_texcoords ? 1 : 0)) * 2) + (has_colors ? 1 : 0);
+    g_draw_model_variants[index](&params);
+#else
+    draw_model_variant(&params, is_wireframe, perspective_correct, lighting, has_texcoords, has_colors);
+#endif
+}
+
+void draw_billboard(int viewport_width, int viewport_height, vec3d* center, fx32 half_width, fx32 half_height,
+                    vec2d* uv_min, vec2d* uv_max, mat4x4* mat_proj, texture_t* texture, int texture_scale_x,
+                    int texture_scale_y, bool perspective_correct) {
+    // the quad is parallel to the screen, so it is either entirely in front of the near plane or not drawn
+    if (center->z < FX(0.1f)) return;
+
+    draw_model_params_t params = {viewport_width, viewport_height, NULL, NULL, NULL, NULL, mat_proj, NULL, NULL, 0,
+                                  texture, true, true, texture_scale_x, texture_scale_y, true};
+    fx32 half_viewport_width = FX(viewport_width / 2);
+    fx32 half_viewport_height = FX(viewport_height / 2);
+
+    // top left, top right, bottom right, bottom left, in view space (y up)
+    raster_vertex_t v[4];
+    for (int i = 0; i < 4; ++i) {
+        bool right = i == 1 || i == 2;
+        bool bottom = i >= 2;
+        v[i] = (raster_vertex_t){center->x + (right ? half_width : -half_width),
+                                 center->y + (bottom ? -half_height : half_height),
+                                 center->z,
+                                 right ? uv_max->u : uv_min->u,
+                                 bottom ? uv_max->v : uv_min->v,
+                                 FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+        raster_vertex_project(&v[i], mat_proj, half_viewport_width, half_viewport_height, perspective_correct, true);
+    }
+
+    raster_triangle_clip_and_draw(&params, &v[0], &v[1], &v[2], false, perspective_correct, true, perspective_correct);
+    raster_triangle_clip_and_draw(&params, &v[0], &v[2], &v[3], false, perspective_correct, true, perspective_correct);
+}
@@ -74,6 +74,22 @@ typedef float fx32;
 
 #endif
 
+// Sort the triangles of a model from back to front before rasterizing them. Otherwise, each triangle is rasterized as
+// soon as it is projected and clipped, without any intermediate buffer.
+#ifndef SORT_TRIANGLES
+#define SORT_TRIANGLES 0
+#endif
+
+// Generate a specialized draw_model for each combination of render state and mesh attributes. This is only worth its
+// code size in builds optimized for speed.
+#ifndef SPECIALIZE_DRAW_MODEL
+#if defined(__OPTIMIZE__) && !defined(__OPTIMIZE_SIZE__)
+#define SPECIALIZE_DRAW_MODEL 1
+#else
+#define SPECIALIZE_DRAW_MODEL 0
+#endif
+#endif
+
 typedef struct {
     fx32 u, v, w;
 } vec2d;
@@ -100,6 +116,19 @@ typedef struct {
     vec3d n[3];
 } triangle_t;
 
+// Compact vertex used once the lighting is applied. Before the projection, (x, y, z) is the position in view space.
+// After the projection, (x, y) is the position on screen and z is 1/w. The texture coordinates and the color are
+// divided by w when the perspective correction is enabled.
+typedef struct {
+    fx32 x, y, z;
+    fx32 u, v;
+    fx32 r, g, b, a;
+} raster_vertex_t;
+
+typedef struct {
+    raster_vertex_t v[3];
+} raster_triangle_t;
+
 typedef struct {
     size_t nb_vertices;
     size_t nb_texcoords;
@@ -117,7 +146,7 @@ typedef struct {
     mesh_t mesh;
 
     // Internal buffers
-    triangle_t* triangles_to_raster;
+    raster_triangle_t* triangles_to_raster;  // only used when SORT_TRIANGLES is enabled
 } model_t;
 
 typedef struct {
@@ -125,6 +154,10 @@ typedef struct {
     unsigned char* data;
 } texture_t;
 
+typedef struct {
+    vec3d min, max;
+} aabb_t;
+
 typedef struct {
     vec3d direction;
     vec3d ambient_color;
@@ -153,11 +186,23 @@ mat4x4 matrix_multiply_matrix(mat4x4* m1, mat4x4* m2);
 mat4x4 matrix_point_at(vec3d* pos, vec3d* target, vec3d* up);
 mat4x4 matrix_quick_inverse(mat4x4* m);
 
+aabb_t mesh_bounds(mesh_t* mesh);
+aabb_t aabb_transform(aabb_t* box, mat4x4* m);
+bool aabb_is_visible(aabb_t* box, mat4x4* mat_world_view_proj);
+bool aabb_is_visible_within(aabb_t* box, mat4x4* mat_world_view_proj, fx32 view_distance);
+
 void draw_line(vec3d v0, vec3d v1, vec2d uv0, vec2d uv1, vec3d c0, vec3d c1, fx32 thickness, texture_t* texture,
                 bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y, bool perspective_correct);
 
+// mat_world is NULL if the vertices are already in world space, mat_normal is NULL for flat shading
 void draw_model(int viewport_width, int viewport_height, vec3d* vec_camera, model_t* model, mat4x4* mat_world,
                 mat4x4* mat_normal, mat4x4* mat_projection, mat4x4* mat_view, light_t* lights, size_t nb_lights, bool is_wireframe, texture_t* texture,
                 bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y, bool perspective_correct);
 
+// Draw a textured quad parallel to the screen, centered on a point in view space. The texture is clamped and its
+// transparent texels are not drawn, neither their depth.
+void draw_billboard(int viewport_width, int viewport_height, vec3d* center, fx32 half_width, fx32 half_height,
+                    vec2d* uv_min, vec2d* uv_max, mat4x4* mat_proj, texture_t* texture, int texture_scale_x,
+                    int texture_scale_y, bool perspective_correct);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,187 @@
+// impostor.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "impostor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_FOV 30.0f
+
+typedef struct {
+    bool valid;
+    vec3d direction;  // in model space, toward the camera the cell was captured from
+} impostor_cell_t;
+
+struct impostor {
+    model_t* model;
+    vec3d center;  // of the bounds, in model space
+    fx32 radius;   // of the bounding sphere
+
+    int nb_views;
+    int cell_size;
+    int nb_columns;
+    fx32 cos_threshold;
+    texture_t atlas;
+    int texture_scale_x, texture_scale_y;
+    impostor_cell_t* cells;
+
+    impostor_render_fn_t render_fn;
+    void* user_data;
+
+    int nb_refreshes_left;
+    impostor_stats_t stats;
+};
+
+static int next_power_of_two(int x) {
+    int p = 1;
+    while (p < x) p <<= 1;
+    return p;
+}
+
+// texture scale of the back ends for a texture size, relative to 32 texels
+static int texture_scale(int size) {
+    int scale = 0;
+    while ((32 << scale) < size) scale++;
+    return scale;
+}
+
+impostor_t* impostor_create(model_t* model, int nb_views, int cell_size, float threshold_angle,
+                            impostor_render_fn_t render_fn, void* user_data) {
+    if (nb_views <= 0 || cell_size <= 0) return NULL;
+
+    impostor_t* impostor = (impostor_t*)calloc(1, sizeof(impostor_t));
+    if (!impostor) return NULL;
+
+    aabb_t bounds = mesh_bounds(&model->mesh);
+    vec3d extent = vector_sub(&bounds.max, &bounds.min);
+    impostor->model = model;
+    impostor->center = vector_add(&bounds.min, &bounds.max);
+    impostor->center = vector_mul(&impostor->center, FX(0.5f));
+    impostor->center.w = FX(1.0f);
+    impostor->radius = MUL(vector_length(&extent), FX(0.5f));
+
+    // power of two atlas
+    impostor->nb_views = nb_views;
+    impostor->cell_size = cell_size;
+    impostor->nb_columns = next_power_of_two((int)ceilf(sqrtf((float)nb_views)));
+    int nb_rows = next_power_of_two((nb_views + impostor->nb_columns - 1) / impostor->nb_columns);
+    impostor->atlas.width = next_power_of_two(impostor->nb_columns * cell_size);
+    impostor->atlas.height = next_power_of_two(nb_rows * cell_size);
+    impostor->texture_scale_x = texture_scale((int)impostor->atlas.width);
+    impostor->texture_scale_y = texture_scale((int)impostor->atlas.height);
+    impostor->cos_threshold = FX(cosf(threshold_angle / 180.0f * 3.14159f));
+
+    impostor->render_fn = render_fn;
+    impostor->user_data = user_data;
+
+    impostor->atlas.data = (unsigned char*)calloc(impostor->atlas.width * impostor->atlas.height, sizeof(uint16_t));
+    impostor->cells = (impostor_cell_t*)calloc(nb_views, sizeof(impostor_cell_t));
+    if (!impostor->atlas.data || !impostor->cells) {
+        printf("Unable to allocate an impostor atlas of %zu x %zu\n", impostor->atlas.width, impostor->atlas.height);
+        impostor_free(impostor);
+        return NULL;
+    }
+
+    return impostor;
+}
+
+void impostor_free(impostor_t* impostor) {
+    if (!impostor) return;
+    free(impostor->atlas.data);
+    free(impostor->cells);
+    free(impostor);
+}
+
+texture_t* impostor_atlas(impostor_t* impostor) { return &impostor->atlas; }
+
+int impostor_cell_size(impostor_t* impostor) { return impostor->cell_size; }
+
+impostor_stats_t impostor_stats(impostor_t* impostor) { return impostor->stats; }
+
+void impostor_begin_frame(impostor_t* impostor, int max_refreshes) {
+    impostor->nb_refreshes_left = max_refreshes;
+    impostor->stats.nb_drawn = 0;
+    impostor->stats.nb_refreshed = 0;
+}
+
+void impostor_invalidate(impostor_t* impostor) {
+    for (int i = 0; i < impostor->nb_views; ++i) impostor->cells[i].valid = false;
+}
+
+static void render_cell(impostor_t* impostor, int index, vec3d* direction) {
+    int x = (index % impostor->nb_columns) * impostor->cell_size;
+    int y = (index / impostor->nb_columns) * impostor->cell_size;
+
+    uint16_t* pixels = (uint16_t*)impostor->atlas.data;
+    for (int j = 0; j < impostor->cell_size; ++j)
+        memset(&pixels[(y + j) * impostor->atlas.width + x], 0, impostor->cell_size * sizeof(uint16_t));
+
+    // the bounding sphere fits the field of view of the capture
+    fx32 distance = DIV(impostor->radius, FX(sinf(CAPTURE_FOV * 0.5f / 180.0f * 3.14159f)));
+    vec3d offset = vector_mul(direction, distance);
+    vec3d vec_camera = vector_add(&impostor->center, &offset);
+    vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
+    if (direction->y > FX(0.99f) || direction->y < FX(-0.99f)) vec_up = (vec3d){FX(0.0f), FX(0.0f), FX(1.0f), FX(1.0f)};
+    mat4x4 mat_camera = matrix_point_at(&vec_camera, &impostor->center, &vec_up);
+    mat4x4 mat_view = matrix_quick_inverse(&mat_camera);
+    mat4x4 mat_proj = matrix_make_projection(impostor->cell_size, impostor->cell_size, CAPTURE_FOV);
+    mat4x4 mat_world = matrix_make_identity();
+
+    impostor->render_fn(impostor, x, y, &mat_world, &mat_view, &mat_proj, impostor->user_data);
+
+    impostor->cells[index].valid = true;
+    impostor->cells[index].direction = *direction;
+    impostor->stats.nb_refreshed++;
+}
+
+void draw_impostor(int viewport_width, int viewport_height, vec3d* vec_camera, impostor_t* impostor,
+                   mat4x4* mat_world, mat4x4* mat_view, mat4x4* mat_proj, bool perspective_correct) {
+    vec3d center = matrix_multiply_vector(mat_world, &impostor->center);
+
+    // direction toward the camera in model space, with the transposed rotation of the world matrix
+    vec3d d = vector_sub(vec_camera, &center);
+    vec3d direction;
+    direction.x = MUL(mat_world->m[0][0], d.x) + MUL(mat_world->m[0][1], d.y) + MUL(mat_world->m[0][2], d.z);
+    direction.y = MUL(mat_world->m[1][0], d.x) + MUL(mat_world->m[1][1], d.y) + MUL(mat_world->m[1][2], d.z);
+    direction.z = MUL(mat_world->m[2][0], d.x) + MUL(mat_world->m[2][1], d.y) + MUL(mat_world->m[2][2], d.z);
+    direction = vector_normalize(&direction);
+    direction.w = FX(0.0f);
+
+    // one cell per sector of azimuth
+    float azimuth = atan2f(FLT(direction.x), FLT(direction.z));
+    int index = (int)((azimuth + 3.14159f) / (2.0f * 3.14159f) * impostor->nb_views);
+    if (index < 0) index = 0;
+    if (index >= impostor->nb_views) index = impostor->nb_views - 1;
+
+    impostor_cell_t* cell = &impostor->cells[index];
+    if (!cell->valid) {
+        render_cell(impostor, index, &direction);
+    } else if (impostor->nb_refreshes_left > 0 &&
+               vector_dot_product(&direction, &cell->direction) < impostor->cos_threshold) {
+        render_cell(impostor, index, &direction);
+        impostor->nb_refreshes_left--;
+    }
+
+    // quad covering the field of view of the capture at the center of the model
+    vec3d scale_row = {mat_world->m[0][0], mat_world->m[0][1], mat_world->m[0][2], FX(0.0f)};
+    fx32 half_size = MUL(impostor->radius, vector_length(&scale_row));
+    half_size = DIV(half_size, FX(cosf(CAPTURE_FOV * 0.5f / 180.0f * 3.14159f)));
+    vec3d center_view = matrix_multiply_vector(mat_view, &center);
+
+    // inset by half a texel so that the neighbor cells are never sampled
+    fx32 texel_u = DIV(FX(0.5f), FXI(impostor->atlas.width));
+    fx32 texel_v = DIV(FX(0.5f), FXI(impostor->atlas.height));
+    vec2d uv_min = {DIV(FXI((index % impostor->nb_columns) * impostor->cell_size), FXI(impostor->atlas.width)) + texel_u,
+                    DIV(FXI((index / impostor->nb_columns) * impostor->cell_size), FXI(impostor->atlas.height)) + texel_v,
+                    FX(1.0f)};
+    vec2d uv_max = {uv_min.u + DIV(FXI(impostor->cell_size), FXI(impostor->atlas.width)) - 2 * texel_u,
+                    uv_min.v + DIV(FXI(impostor->cell_size), FXI(impostor->atlas.height)) - 2 * texel_v, FX(1.0f)};
+
+    draw_billboard(viewport_width, viewport_height, &center_view, half_size, half_size, &uv_min, &uv_max, mat_proj,
+                   &impostor->atlas, impostor->texture_scale_x, impostor->texture_scale_y, perspective_correct);
+    impostor->stats.nb_drawn++;
+}
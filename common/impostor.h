@@ -0,0 +1,45 @@
+// impostor.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Impostors of a model for its distant instances. The model is rendered offscreen into the cells of a texture atlas,
+// one cell per sector of azimuth around the model, and each instance is then drawn as a single textured quad facing
+// the camera. A cell is rendered again when the direction from which an instance is seen drifts from the direction
+// the cell was captured from by more than a threshold angle. The lighting is baked in model space.
+
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "graphite.h"
+
+typedef struct impostor impostor_t;
+
+// Render the model into the atlas cell at (x, y) of impostor_cell_size() pixels. The cell is cleared beforehand to a
+// zero alpha, which the fragment shader discards. The offscreen rendering is specific to each back end.
+typedef void (*impostor_render_fn_t)(impostor_t* impostor, int x, int y, mat4x4* mat_world, mat4x4* mat_view,
+                                     mat4x4* mat_proj, void* user_data);
+
+typedef struct {
+    size_t nb_drawn;      // instances drawn as impostors since the last impostor_begin_frame
+    size_t nb_refreshed;  // atlas cells rendered since the last impostor_begin_frame
+} impostor_stats_t;
+
+// The atlas holds nb_views cells of cell_size x cell_size pixels. Returns NULL on error.
+impostor_t* impostor_create(model_t* model, int nb_views, int cell_size, float threshold_angle,
+                            impostor_render_fn_t render_fn, void* user_data);
+void impostor_free(impostor_t* impostor);
+
+texture_t* impostor_atlas(impostor_t* impostor);
+int impostor_cell_size(impostor_t* impostor);
+impostor_stats_t impostor_stats(impostor_t* impostor);
+
+// Allow up to max_refreshes cells to be rendered again during the frame
+void impostor_begin_frame(impostor_t* impostor, int max_refreshes);
+// Force all the cells to be rendered again, e.g. when the lights change
+void impostor_invalidate(impostor_t* impostor);
+
+// Draw an instance of the model. The world matrix may only rotate, uniformly scale and translate the model.
+void draw_impostor(int viewport_width, int viewport_height, vec3d* vec_camera, impostor_t* impostor,
+                   mat4x4* mat_world, mat4x4* mat_view, mat4x4* mat_proj, bool perspective_correct);
+
+#endif
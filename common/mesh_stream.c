@@ -0,0 +1,521 @@
+// mesh_stream.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Chunked mesh file layout (little endian):
+//
+//   header:      char magic[4] = "GCMS", uint32 version, uint32 nb_chunks, uint32 reserved, float bounds[6]
+//   chunk table: nb_chunks x {uint64 offset, uint32 nb_vertices, nb_texcoords, nb_colors, nb_normals, nb_faces,
+//                             uint32 reserved, float bounds[6]}
+//   chunks:      float vertices[nb_vertices][3], float texcoords[nb_texcoords][2], float colors[nb_colors][4],
+//                float normals[nb_normals][3], int32 faces[nb_faces][12] (same layout as face_t, local indices)
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mesh_stream.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define CHUNKED_MESH_MAGIC "GCMS"
+#define CHUNKED_MESH_VERSION 1
+#define CHUNKED_MESH_HEADER_SIZE 40
+#define CHUNKED_MESH_ENTRY_SIZE 56
+
+// A chunk which failed to load is not resident, it is requested again by the next frame which needs it
+typedef enum { CHUNK_EVICTED, CHUNK_QUEUED, CHUNK_LOADING, CHUNK_RESIDENT, CHUNK_FAILED } chunk_state_t;
+
+typedef struct {
+    uint64_t offset;
+    size_t nb_vertices, nb_texcoords, nb_colors, nb_normals, nb_faces;
+    aabb_t bounds;
+    size_t size;  // resident size in bytes
+
+    chunk_state_t state;
+    bool pinned;       // requested by the current frame and not drawn yet
+    bool is_prefetch;  // requested ahead of the frames which need it, not drawn when it is loaded
+    unsigned frame;    // last frame which drew it, or during which it was prefetched
+    model_t model;
+    void* data;
+
+    // least recently used list of the resident chunks
+    long lru_prev, lru_next;
+} stream_chunk_t;
+
+typedef struct {
+    size_t index;
+    fx32 depth;
+} chunk_order_t;
+
+struct mesh_stream {
+    FILE* file;
+    aabb_t bounds;
+    size_t nb_chunks;
+    stream_chunk_t* chunks;
+    chunk_order_t* order;
+
+    size_t memory_budget;
+    mesh_stream_stats_t stats;
+    unsigned frame;
+    long lru_head, lru_tail;
+
+    // chunks to load, in loading order
+    size_t* requests;
+    size_t nb_requests, request_index;
+
+    // loaded chunks not drawn yet
+    size_t* ready;
+    size_t ready_head, ready_tail;
+
+    bool has_loader;
+    pthread_t loader;
+    pthread_mutex_t mutex;
+    pthread_cond_t request_cond, ready_cond, space_cond;
+    bool quit;
+};
+
+static bool read_u32(FILE* f, uint32_t* v) { return fread(v, sizeof(uint32_t), 1, f) == 1; }
+
+static bool read_u64(FILE* f, uint64_t* v) { return fread(v, sizeof(uint64_t), 1, f) == 1; }
+
+static bool read_bounds(FILE* f, aabb_t* box) {
+    float b[6];
+    if (fread(b, sizeof(float), 6, f) != 6) return false;
+    box->min = (vec3d){FX(b[0]), FX(b[1]), FX(b[2]), FX(1.0f)};
+    box->max = (vec3d){FX(b[3]), FX(b[4]), FX(b[5]), FX(1.0f)};
+    return true;
+}
+
+// size of the packed floats and indices of a chunk in the file
+static uint64_t chunk_file_size(stream_chunk_t* chunk) {
+    return (uint64_t)chunk->nb_vertices * 3 * sizeof(float) + (uint64_t)chunk->nb_texcoords * 2 * sizeof(float) +
+           (uint64_t)chunk->nb_colors * 4 * sizeof(float) + (uint64_t)chunk->nb_normals * 3 * sizeof(float) +
+           (uint64_t)chunk->nb_faces * sizeof(face_t);
+}
+
+static size_t chunk_size(stream_chunk_t* chunk) {
+    size_t size = chunk->nb_vertices * sizeof(vec3d) + chunk->nb_texcoords * sizeof(vec2d) +
+                  chunk->nb_colors * sizeof(vec3d) + chunk->nb_normals * sizeof(vec3d) +
+                  chunk->nb_faces * sizeof(face_t);
+#if SORT_TRIANGLES
+    // note: clipping can produce an additional triangle
+    size += 2 * chunk->nb_faces * sizeof(raster_triangle_t);
+#endif
+    return size;
+}
+
+//
+// Least recently used list, the mutex must be held
+//
+
+static void lru_remove(mesh_stream_t* stream, size_t index) {
+    stream_chunk_t* chunk = &stream->chunks[index];
+    if (chunk->lru_prev >= 0)
+        stream->chunks[chunk->lru_prev].lru_next = chunk->lru_next;
+    else
+        stream->lru_head = chunk->lru_next;
+    if (chunk->lru_next >= 0)
+        stream->chunks[chunk->lru_next].lru_prev = chunk->lru_prev;
+    else
+        stream->lru_tail = chunk->lru_prev;
+    chunk->lru_prev = chunk->lru_next = -1;
+}
+
+static void lru_push_back(mesh_stream_t* stream, size_t index) {
+    stream_chunk_t* chunk = &stream->chunks[index];
+    chunk->lru_prev = stream->lru_tail;
+    chunk->lru_next = -1;
+    if (stream->lru_tail >= 0)
+        stream->chunks[stream->lru_tail].lru_next = (long)index;
+    else
+        stream->lru_head = (long)index;
+    stream->lru_tail = (long)index;
+}
+
+// evict the least recently used chunk which is not needed by the current frame, nor drawn by it if keep_frame is set
+static bool evict_one(mesh_stream_t* stream, bool keep_frame) {
+    for (long i = stream->lru_head; i >= 0; i = stream->chunks[i].lru_next) {
+        stream_chunk_t* chunk = &stream->chunks[i];
+        if (chunk->pinned || (keep_frame && chunk->frame == stream->frame)) continue;
+        lru_remove(stream, (size_t)i);
+        free(chunk->data);
+        chunk->data = NULL;
+        chunk->state = CHUNK_EVICTED;
+        stream->stats.memory_used -= chunk->size;
+        stream->stats.nb_chunks_evicted++;
+        return true;
+    }
+    return false;
+}
+
+//
+// Loader thread
+//
+
+// Read an array of floats and expand it in place to fx32 vectors. The expansion goes backward since the vectors are
+// at least as large as the packed floats.
+static bool read_vectors(FILE* f, void* dst, size_t nb, size_t nb_components, size_t stride, fx32 w) {
+    // the arrays of a chunk without them are NULL
+    if (nb == 0) return true;
+    float* src = (float*)dst;
+    if (fread(src, sizeof(float) * nb_components, nb, f) != nb) return false;
+    for (size_t i = nb; i-- > 0;) {
+        fx32 v[4] = {FX(0.0f), FX(0.0f), FX(0.0f), w};
+        for (size_t j = 0; j < nb_components; ++j) v[j] = FX(src[i * nb_components + j]);
+        memcpy((char*)dst + i * stride, v, stride);
+    }
+    return true;
+}
+
+static bool is_valid_index(int index, size_t count) { return index >= 0 && (size_t)index < count; }
+
+static bool load_chunk(mesh_stream_t* stream, stream_chunk_t* chunk, void* data) {
+    mesh_t* mesh = &chunk->model.mesh;
+    char* p = (char*)data;
+
+    mesh->nb_vertices = chunk->nb_vertices;
+    mesh->nb_texcoords = chunk->nb_texcoords;
+    mesh->nb_colors = chunk->nb_colors;
+    mesh->nb_normals = chunk->nb_normals;
+    mesh->nb_faces = chunk->nb_faces;
+    mesh->vertices = (vec3d*)p;
+    p += chunk->nb_vertices * sizeof(vec3d);
+    mesh->texcoords = chunk->nb_texcoords ? (vec2d*)p : NULL;
+    p += chunk->nb_texcoords * sizeof(vec2d);
+    mesh->colors = chunk->nb_colors ? (vec3d*)p : NULL;
+    p += chunk->nb_colors * sizeof(vec3d);
+    mesh->normals = chunk->nb_normals ? (vec3d*)p : NULL;
+    p += chunk->nb_normals * sizeof(vec3d);
+    mesh->faces = (face_t*)p;
+    p += chunk->nb_faces * sizeof(face_t);
+#if SORT_TRIANGLES
+    chunk->model.triangles_to_raster = (raster_triangle_t*)p;
+#else
+    chunk->model.triangles_to_raster = NULL;
+#endif
+
+    if (fseeko(stream->file, (off_t)chunk->offset, SEEK_SET) != 0) return false;
+    if (!read_vectors(stream->file, mesh->vertices, mesh->nb_vertices, 3, sizeof(vec3d), FX(1.0f))) return false;
+    if (!read_vectors(stream->file, mesh->texcoords, mesh->nb_texcoords, 2, sizeof(vec2d), FX(1.0f))) return false;
+    if (!read_vectors(stream->file, mesh->colors, mesh->nb_colors, 4, sizeof(vec3d), FX(1.0f))) return false;
+    if (!read_vectors(stream->file, mesh->normals, mesh->nb_normals, 3, sizeof(vec3d), FX(0.0f))) return false;
+    if (fread(mesh->faces, sizeof(face_t), mesh->nb_faces, stream->file) != mesh->nb_faces) return false;
+
+    // the indices are used by draw_model without checks, a corrupted chunk is rejected
+    for (size_t i = 0; i < mesh->nb_faces; ++i) {
+        const face_t* face = &mesh->faces[i];
+        for (int j = 0; j < 3; ++j) {
+            if (!is_valid_index(face->indices[j], mesh->nb_vertices) ||
+                (mesh->nb_texcoords && !is_valid_index(face->tex_indices[j], mesh->nb_texcoords)) ||
+                (mesh->nb_colors && !is_valid_index(face->col_indices[j], mesh->nb_colors)) ||
+                (mesh->nb_normals && !is_valid_index(face->norm_indices[j], mesh->nb_normals)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void* loader_thread(void* arg) {
+    mesh_stream_t* stream = (mesh_stream_t*)arg;
+
+    pthread_mutex_lock(&stream->mutex);
+    for (;;) {
+        while (!stream->quit && stream->request_index == stream->nb_requests)
+            pthread_cond_wait(&stream->request_cond, &stream->mutex);
+        if (stream->quit) break;
+
+        size_t index = stream->requests[stream->request_index++];
+        stream_chunk_t* chunk = &stream->chunks[index];
+        chunk->state = CHUNK_LOADING;
+
+        // make room, waiting for the renderer to release chunks if everything resident is still needed. A prefetch is
+        // dropped instead.
+        bool has_room = true;
+        while (!stream->quit && stream->stats.memory_used + chunk->size > stream->memory_budget) {
+            if (evict_one(stream, chunk->is_prefetch)) continue;
+            if (chunk->is_prefetch) {
+                has_room = false;
+                break;
+            }
+            pthread_cond_wait(&stream->space_cond, &stream->mutex);
+        }
+        if (stream->quit) break;
+        if (!has_room) {
+            chunk->state = CHUNK_EVICTED;
+            chunk->is_prefetch = false;
+            continue;
+        }
+        stream->stats.memory_used += chunk->size;
+        if (stream->stats.memory_used > stream->stats.memory_peak)
+            stream->stats.memory_peak = stream->stats.memory_used;
+
+        // read without holding the lock so that the renderer can draw the chunks already loaded
+        pthread_mutex_unlock(&stream->mutex);
+        void* data = malloc(chunk->size);
+        bool ok = data && load_chunk(stream, chunk, data);
+        if (!ok) printf("Unable to load chunk %zu\n", index);
+        pthread_mutex_lock(&stream->mutex);
+
+        // the renderer is told of a failed chunk as well, it is skipped. A prefetched chunk is only handed over if a
+        // frame requested it while it was loading.
+        if (ok) {
+            chunk->data = data;
+            chunk->state = CHUNK_RESIDENT;
+            chunk->frame = stream->frame;
+            if (chunk->is_prefetch)
+                stream->stats.nb_chunks_prefetched++;
+            else
+                stream->stats.nb_chunks_loaded++;
+            lru_push_back(stream, index);
+        } else {
+            free(data);
+            chunk->state = CHUNK_FAILED;
+            stream->stats.memory_used -= chunk->size;
+        }
+        if (!chunk->is_prefetch) {
+            stream->ready[stream->ready_tail++] = index;
+            pthread_cond_signal(&stream->ready_cond);
+        }
+        chunk->is_prefetch = false;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+//
+// Stream
+//
+
+mesh_stream_t* mesh_stream_open(const char* path, size_t memory_budget) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("Unable to open %s\n", path);
+        return NULL;
+    }
+
+    // the chunk table must fit in the file, the counts of the header are not trusted
+    char magic[4];
+    uint32_t version, nb_chunks, reserved;
+    aabb_t bounds;
+    off_t file_size = fseeko(f, 0, SEEK_END) == 0 ? ftello(f) : -1;
+    if (file_size < 0 || fseeko(f, 0, SEEK_SET) != 0 || fread(magic, 1, 4, f) != 4 ||
+        memcmp(magic, CHUNKED_MESH_MAGIC, 4) != 0 || !read_u32(f, &version) || version != CHUNKED_MESH_VERSION ||
+        !read_u32(f, &nb_chunks) || !read_u32(f, &reserved) || !read_bounds(f, &bounds)) {
+        printf("%s is not a chunked mesh\n", path);
+        fclose(f);
+        return NULL;
+    }
+    if (nb_chunks == 0 ||
+        (uint64_t)nb_chunks > ((uint64_t)file_size - CHUNKED_MESH_HEADER_SIZE) / CHUNKED_MESH_ENTRY_SIZE) {
+        printf("%s: invalid number of chunks %u\n", path, nb_chunks);
+        fclose(f);
+        return NULL;
+    }
+
+    mesh_stream_t* stream = (mesh_stream_t*)calloc(1, sizeof(mesh_stream_t));
+    if (!stream) {
+        printf("Unable to allocate the stream of %s\n", path);
+        fclose(f);
+        return NULL;
+    }
+    stream->file = f;
+    stream->bounds = bounds;
+    stream->memory_budget = memory_budget;
+    stream->lru_head = stream->lru_tail = -1;
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->request_cond, NULL);
+    pthread_cond_init(&stream->ready_cond, NULL);
+    pthread_cond_init(&stream->space_cond, NULL);
+
+    stream->chunks = (stream_chunk_t*)calloc(nb_chunks, sizeof(stream_chunk_t));
+    stream->order = (chunk_order_t*)malloc(nb_chunks * sizeof(chunk_order_t));
+    stream->requests = (size_t*)malloc(nb_chunks * sizeof(size_t));
+    stream->ready = (size_t*)malloc(nb_chunks * sizeof(size_t));
+    if (!stream->chunks || !stream->order || !stream->requests || !stream->ready) {
+        printf("Unable to allocate the chunk table of %s\n", path);
+        mesh_stream_close(stream);
+        return NULL;
+    }
+    stream->nb_chunks = nb_chunks;
+
+    for (size_t i = 0; i < nb_chunks; ++i) {
+        stream_chunk_t* chunk = &stream->chunks[i];
+        uint32_t counts[6];
+        bool ok = read_u64(f, &chunk->offset);
+        for (int j = 0; j < 6; ++j) ok = ok && read_u32(f, &counts[j]);
+        ok = ok && read_bounds(f, &chunk->bounds);
+        if (!ok) {
+            printf("%s: truncated chunk table\n", path);
+            mesh_stream_close(stream);
+            return NULL;
+        }
+        chunk->nb_vertices = counts[0];
+        chunk->nb_texcoords = counts[1];
+        chunk->nb_colors = counts[2];
+        chunk->nb_normals = counts[3];
+        chunk->nb_faces = counts[4];
+        chunk->size = chunk_size(chunk);
+        chunk->lru_prev = chunk->lru_next = -1;
+        if (chunk->offset > (uint64_t)file_size || chunk_file_size(chunk) > (uint64_t)file_size - chunk->offset) {
+            printf("%s: chunk %zu is out of the file\n", path, i);
+            mesh_stream_close(stream);
+            return NULL;
+        }
+        if (chunk->size > memory_budget) {
+            printf("%s: the memory budget is smaller than chunk %zu (%zu bytes)\n", path, i, chunk->size);
+            mesh_stream_close(stream);
+            return NULL;
+        }
+    }
+
+    stream->has_loader = pthread_create(&stream->loader, NULL, loader_thread, stream) == 0;
+    if (!stream->has_loader) {
+        printf("Unable to create the loader thread\n");
+        mesh_stream_close(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+void mesh_stream_close(mesh_stream_t* stream) {
+    if (stream->has_loader) {
+        pthread_mutex_lock(&stream->mutex);
+        stream->quit = true;
+        pthread_cond_signal(&stream->request_cond);
+        pthread_cond_signal(&stream->space_cond);
+        pthread_mutex_unlock(&stream->mutex);
+        pthread_join(stream->loader, NULL);
+    }
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->request_cond);
+    pthread_cond_destroy(&stream->ready_cond);
+    pthread_cond_destroy(&stream->space_cond);
+
+    for (size_t i = 0; i < stream->nb_chunks; ++i) free(stream->chunks[i].data);
+    free(stream->chunks);
+    free(stream->order);
+    free(stream->requests);
+    free(stream->ready);
+    fclose(stream->file);
+    free(stream);
+}
+
+aabb_t mesh_stream_bounds(mesh_stream_t* stream) { return stream->bounds; }
+
+mesh_stream_stats_t mesh_stream_stats(mesh_stream_t* stream) {
+    pthread_mutex_lock(&stream->mutex);
+    mesh_stream_stats_t stats = stream->stats;
+    pthread_mutex_unlock(&stream->mutex);
+    return stats;
+}
+
+static int compare_chunk_order(const void* a, const void* b) {
+    fx32 da = ((const chunk_order_t*)a)->depth;
+    fx32 db = ((const chunk_order_t*)b)->depth;
+    return (da > db) - (da < db);
+}
+
+void draw_mesh_stream(int viewport_width, int viewport_height, vec3d* vec_camera, mesh_stream_t* stream,
+                      mat4x4* mat_world, mat4x4* mat_normal, mat4x4* mat_proj, mat4x4* mat_view, light_t* lights,
+                      size_t nb_lights, bool is_wireframe, texture_t* texture, bool clamp_s, bool clamp_t,
+                      int texture_scale_x, int texture_scale_y, bool perspective_correct) {
+    mat4x4 mat_world_view = matrix_multiply_matrix(mat_world, mat_view);
+    mat4x4 mat_world_view_proj = matrix_multiply_matrix(&mat_world_view, mat_proj);
+    mat4x4 mat_widened = matrix_make_scale(FX(1.0f / MESH_STREAM_PREFETCH_SCALE), FX(1.0f / MESH_STREAM_PREFETCH_SCALE),
+                                           FX(1.0f));
+    mat4x4 mat_prefetch = matrix_multiply_matrix(&mat_world_view_proj, &mat_widened);
+
+    // cull the chunks by their bounds and sort the visible ones from front to back, then the ones to prefetch, which
+    // are stored from the end of the order
+    size_t nb_visible = 0, nb_prefetch = 0;
+    for (size_t i = 0; i < stream->nb_chunks; ++i) {
+        stream_chunk_t* chunk = &stream->chunks[i];
+        bool is_visible = aabb_is_visible(&chunk->bounds, &mat_world_view_proj);
+        if (!is_visible && (MESH_STREAM_PREFETCH_SCALE <= 1.0f || !aabb_is_visible(&chunk->bounds, &mat_prefetch)))
+            continue;
+        vec3d center = vector_add(&chunk->bounds.min, &chunk->bounds.max);
+        center = vector_mul(&center, FX(0.5f));
+        center = matrix_multiply_vector(&mat_world_view, &center);
+        if (is_visible)
+            stream->order[nb_visible++] = (chunk_order_t){i, center.z};
+        else
+            stream->order[stream->nb_chunks - ++nb_prefetch] = (chunk_order_t){i, center.z};
+    }
+    chunk_order_t* prefetch_order = &stream->order[stream->nb_chunks - nb_prefetch];
+    qsort(stream->order, nb_visible, sizeof(chunk_order_t), compare_chunk_order);
+    qsort(prefetch_order, nb_prefetch, sizeof(chunk_order_t), compare_chunk_order);
+
+    // the prefetches of the previous frame which are not loading yet are dropped
+    pthread_mutex_lock(&stream->mutex);
+    for (size_t i = stream->request_index; i < stream->nb_requests; ++i) {
+        stream_chunk_t* chunk = &stream->chunks[stream->requests[i]];
+        chunk->state = CHUNK_EVICTED;
+        chunk->is_prefetch = false;
+    }
+
+    // request the chunks which are not resident, the resident ones are ready to be drawn right away and a chunk still
+    // loading from a prefetch is handed over once loaded
+    stream->frame++;
+    stream->stats.nb_chunks_visible = nb_visible;
+    stream->stats.nb_chunks_culled = stream->nb_chunks - nb_visible;
+    stream->stats.nb_chunks_loaded = 0;
+    stream->stats.nb_chunks_prefetched = 0;
+    stream->stats.nb_chunks_evicted = 0;
+    stream->nb_requests = stream->request_index = 0;
+    stream->ready_head = stream->ready_tail = 0;
+    for (size_t i = 0; i < nb_visible; ++i) {
+        size_t index = stream->order[i].index;
+        stream_chunk_t* chunk = &stream->chunks[index];
+        chunk->pinned = true;
+        if (chunk->state == CHUNK_RESIDENT) {
+            stream->ready[stream->ready_tail++] = index;
+        } else if (chunk->state == CHUNK_LOADING) {
+            chunk->is_prefetch = false;
+        } else {
+            chunk->state = CHUNK_QUEUED;
+            stream->requests[stream->nb_requests++] = index;
+        }
+    }
+
+    // then the chunks around the view, which are not drawn by this frame, the failed ones are not retried ahead
+    for (size_t i = 0; i < nb_prefetch; ++i) {
+        size_t index = prefetch_order[i].index;
+        stream_chunk_t* chunk = &stream->chunks[index];
+        if (chunk->state != CHUNK_EVICTED) continue;
+        chunk->state = CHUNK_QUEUED;
+        chunk->is_prefetch = true;
+        stream->requests[stream->nb_requests++] = index;
+    }
+    pthread_cond_signal(&stream->request_cond);
+
+    // draw the chunks as they become ready
+    for (size_t i = 0; i < nb_visible; ++i) {
+        while (stream->ready_head == stream->ready_tail) pthread_cond_wait(&stream->ready_cond, &stream->mutex);
+        size_t index = stream->ready[stream->ready_head++];
+        stream_chunk_t* chunk = &stream->chunks[index];
+        if (chunk->state == CHUNK_FAILED) {
+            chunk->pinned = false;
+            continue;
+        }
+        pthread_mutex_unlock(&stream->mutex);
+
+        draw_model(viewport_width, viewport_height, vec_camera, &chunk->model, mat_world, mat_normal, mat_proj,
+                   mat_view, lights, nb_lights, is_wireframe, texture, clamp_s, clamp_t, texture_scale_x,
+                   texture_scale_y, perspective_correct);
+
+        pthread_mutex_lock(&stream->mutex);
+        chunk->pinned = false;
+        chunk->frame = stream->frame;
+        lru_remove(stream, index);
+        lru_push_back(stream, index);
+        pthread_cond_signal(&stream->space_cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+}
@@ -0,0 +1,48 @@
+// mesh_stream.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Out-of-core rendering of meshes stored as spatially coherent chunks (see utils/obj2chunks.py). Only the chunks
+// intersecting the view frustum are read, by a background thread, into a cache bounded by a memory budget with least
+// recently used eviction. Chunks are drawn as soon as they are loaded so that the I/O overlaps the geometry work.
+// The neighbouring chunks which the camera is about to see are then prefetched.
+
+#ifndef MESH_STREAM_H
+#define MESH_STREAM_H
+
+#include "graphite.h"
+
+// The chunks outside of the view frustum but inside the frustum widened by this factor, horizontally and vertically,
+// are prefetched nearest first once the visible ones are loaded. A prefetch only takes the room left by the chunks of
+// the previous frames, it never waits for room nor evicts a chunk drawn by the current frame. 1 disables it.
+#ifndef MESH_STREAM_PREFETCH_SCALE
+#define MESH_STREAM_PREFETCH_SCALE 1.5f
+#endif
+
+typedef struct mesh_stream mesh_stream_t;
+
+typedef struct {
+    size_t nb_chunks_visible;     // chunks drawn during the last frame
+    size_t nb_chunks_culled;      // chunks rejected by their bounds during the last frame, never read
+    size_t nb_chunks_loaded;      // cache misses during the last frame
+    size_t nb_chunks_prefetched;  // chunks loaded ahead of the frames which need them, during the last frame
+    size_t nb_chunks_evicted;     // chunks evicted during the last frame
+    size_t memory_used;           // bytes currently resident
+    size_t memory_peak;           // highest number of bytes resident since the stream was opened
+} mesh_stream_stats_t;
+
+// Open a chunked mesh file. The memory budget is in bytes and must hold at least the largest chunk.
+// Returns NULL on error.
+mesh_stream_t* mesh_stream_open(const char* path, size_t memory_budget);
+void mesh_stream_close(mesh_stream_t* stream);
+
+aabb_t mesh_stream_bounds(mesh_stream_t* stream);
+mesh_stream_stats_t mesh_stream_stats(mesh_stream_t* stream);
+
+// Same as draw_model for the visible chunks of the stream
+void draw_mesh_stream(int viewport_width, int viewport_height, vec3d* vec_camera, mesh_stream_t* stream,
+                      mat4x4* mat_world, mat4x4* mat_normal, mat4x4* mat_proj, mat4x4* mat_view, light_t* lights,
+                      size_t nb_lights, bool is_wireframe, texture_t* texture, bool clamp_s, bool clamp_t,
+                      int texture_scale_x, int texture_scale_y, bool perspective_correct);
+
+#endif
@@ -0,0 +1,203 @@
+// scene_grid.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "scene_grid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CELL_OVERSIZE -1  // larger than a cell or outside of the grid
+#define CELL_FREE -2      // handle available for reuse
+
+typedef struct {
+    scene_object_t object;
+    int cell;
+    int prev, next;  // list of the cell, or free list
+} grid_entry_t;
+
+struct scene_grid {
+    vec3d origin;
+    fx32 cell_size;
+    int nb_cells_x, nb_cells_y, nb_cells_z;
+    int* cells;  // first entry of each cell, -1 if empty
+    int oversize;
+
+    grid_entry_t* entries;
+    int nb_entries, max_entries;
+    int free_list;
+};
+
+static int* cell_head(scene_grid_t* grid, int cell) {
+    return cell == CELL_OVERSIZE ? &grid->oversize : &grid->cells[cell];
+}
+
+static int cell_coordinate(fx32 x, fx32 origin, fx32 cell_size) {
+    fx32 d = x - origin;
+    return d < FX(0.0f) ? -1 : INT(DIV(d, cell_size));
+}
+
+static int cell_of(scene_grid_t* grid, aabb_t* bounds) {
+    vec3d extent = vector_sub(&bounds->max, &bounds->min);
+    if (extent.x > grid->cell_size || extent.y > grid->cell_size || extent.z > grid->cell_size) return CELL_OVERSIZE;
+
+    vec3d center = vector_add(&bounds->min, &bounds->max);
+    center = vector_mul(&center, FX(0.5f));
+    int x = cell_coordinate(center.x, grid->origin.x, grid->cell_size);
+    int y = cell_coordinate(center.y, grid->origin.y, grid->cell_size);
+    int z = cell_coordinate(center.z, grid->origin.z, grid->cell_size);
+    if (x < 0 || y < 0 || z < 0 || x >= grid->nb_cells_x || y >= grid->nb_cells_y || z >= grid->nb_cells_z)
+        return CELL_OVERSIZE;
+    return (z * grid->nb_cells_y + y) * grid->nb_cells_x + x;
+}
+
+static void link_entry(scene_grid_t* grid, int handle, int cell) {
+    grid_entry_t* entry = &grid->entries[handle];
+    int* head = cell_head(grid, cell);
+    entry->cell = cell;
+    entry->prev = -1;
+    entry->next = *head;
+    if (*head >= 0) grid->entries[*head].prev = handle;
+    *head = handle;
+}
+
+static void unlink_entry(scene_grid_t* grid, int handle) {
+    grid_entry_t* entry = &grid->entries[handle];
+    if (entry->prev >= 0)
+        grid->entries[entry->prev].next = entry->next;
+    else
+        *cell_head(grid, entry->cell) = entry->next;
+    if (entry->next >= 0) grid->entries[entry->next].prev = entry->prev;
+}
+
+scene_grid_t* scene_grid_create(aabb_t* world_bounds, fx32 cell_size) {
+    if (cell_size <= FX(0.0f)) return NULL;
+
+    scene_grid_t* grid = (scene_grid_t*)calloc(1, sizeof(scene_grid_t));
+    if (!grid) return NULL;
+    grid->origin = world_bounds->min;
+    grid->cell_size = cell_size;
+    grid->nb_cells_x = cell_coordinate(world_bounds->max.x, world_bounds->min.x, cell_size) + 1;
+    grid->nb_cells_y = cell_coordinate(world_bounds->max.y, world_bounds->min.y, cell_size) + 1;
+    grid->nb_cells_z = cell_coordinate(world_bounds->max.z, world_bounds->min.z, cell_size) + 1;
+    grid->oversize = -1;
+    grid->free_list = -1;
+
+    size_t nb_cells = (size_t)grid->nb_cells_x * grid->nb_cells_y * grid->nb_cells_z;
+    grid->cells = (int*)malloc(nb_cells * sizeof(int));
+    if (grid->nb_cells_x <= 0 || grid->nb_cells_y <= 0 || grid->nb_cells_z <= 0 || !grid->cells) {
+        printf("Unable to create a scene grid of %d x %d x %d cells\n", grid->nb_cells_x, grid->nb_cells_y,
+               grid->nb_cells_z);
+        scene_grid_free(grid);
+        return NULL;
+    }
+    for (size_t i = 0; i < nb_cells; ++i) grid->cells[i] = -1;
+
+    return grid;
+}
+
+void scene_grid_free(scene_grid_t* grid) {
+    if (!grid) return;
+    free(grid->cells);
+    free(grid->entries);
+    free(grid);
+}
+
+int scene_grid_insert(scene_grid_t* grid, model_t* model, mat4x4* mat_world, void* user_data, aabb_t* bounds) {
+    int handle = grid->free_list;
+    if (handle >= 0) {
+        grid->free_list = grid->entries[handle].next;
+    } else {
+        if (grid->nb_entries == grid->max_entries) {
+            int max_entries = grid->max_entries ? 2 * grid->max_entries : 64;
+            grid_entry_t* entries = (grid_entry_t*)realloc(grid->entries, max_entries * sizeof(grid_entry_t));
+            if (!entries) return -1;
+            grid->entries = entries;
+            grid->max_entries = max_entries;
+        }
+        handle = grid->nb_entries++;
+    }
+
+    grid_entry_t* entry = &grid->entries[handle];
+    entry->object = (scene_object_t){model, mat_world, user_data, *bounds};
+    link_entry(grid, handle, cell_of(grid, bounds));
+
+    return handle;
+}
+
+void scene_grid_remove(scene_grid_t* grid, int handle) {
+    unlink_entry(grid, handle);
+    grid->entries[handle].cell = CELL_FREE;
+    grid->entries[handle].next = grid->free_list;
+    grid->free_list = handle;
+}
+
+void scene_grid_move(scene_grid_t* grid, int handle, aabb_t* bounds) {
+    grid_entry_t* entry = &grid->entries[handle];
+    entry->object.bounds = *bounds;
+    int cell = cell_of(grid, bounds);
+    if (cell != entry->cell) {
+        unlink_entry(grid, handle);
+        link_entry(grid, handle, cell);
+    }
+}
+
+scene_object_t* scene_grid_object(scene_grid_t* grid, int handle) { return &grid->entries[handle].object; }
+
+static size_t query_list(scene_grid_t* grid, int head, mat4x4* mat_view_proj, fx32 view_distance, int* handles,
+                         size_t nb_handles, size_t max_handles) {
+    for (int i = head; i >= 0 && nb_handles < max_handles; i = grid->entries[i].next)
+        if (aabb_is_visible_within(&grid->entries[i].object.bounds, mat_view_proj, view_distance))
+            handles[nb_handles++] = i;
+    return nb_handles;
+}
+
+size_t scene_grid_query(scene_grid_t* grid, mat4x4* mat_view, mat4x4* mat_proj, fx32 view_distance, int* handles,
+                        size_t max_handles) {
+    mat4x4 mat_view_proj = matrix_multiply_matrix(mat_view, mat_proj);
+
+    // world bounds of the frustum, from the camera position to the view distance
+    mat4x4 mat_camera = matrix_quick_inverse(mat_view);
+    fx32 half_width = DIV(view_distance, mat_proj->m[0][0]);
+    fx32 half_height = DIV(view_distance, mat_proj->m[1][1]);
+    aabb_t frustum_view = {{-half_width, -half_height, FX(0.0f), FX(1.0f)},
+                           {half_width, half_height, view_distance, FX(1.0f)}};
+    aabb_t frustum = aabb_transform(&frustum_view, &mat_camera);
+
+    // the objects of a cell can overhang by half a cell
+    fx32 half_cell = grid->cell_size / 2;
+    int min_x = cell_coordinate(frustum.min.x - half_cell, grid->origin.x, grid->cell_size);
+    int min_y = cell_coordinate(frustum.min.y - half_cell, grid->origin.y, grid->cell_size);
+    int min_z = cell_coordinate(frustum.min.z - half_cell, grid->origin.z, grid->cell_size);
+    int max_x = cell_coordinate(frustum.max.x + half_cell, grid->origin.x, grid->cell_size);
+    int max_y = cell_coordinate(frustum.max.y + half_cell, grid->origin.y, grid->cell_size);
+    int max_z = cell_coordinate(frustum.max.z + half_cell, grid->origin.z, grid->cell_size);
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (min_z < 0) min_z = 0;
+    if (max_x >= grid->nb_cells_x) max_x = grid->nb_cells_x - 1;
+    if (max_y >= grid->nb_cells_y) max_y = grid->nb_cells_y - 1;
+    if (max_z >= grid->nb_cells_z) max_z = grid->nb_cells_z - 1;
+
+    size_t nb_handles = query_list(grid, grid->oversize, &mat_view_proj, view_distance, handles, 0, max_handles);
+
+    for (int z = min_z; z <= max_z; ++z)
+        for (int y = min_y; y <= max_y; ++y)
+            for (int x = min_x; x <= max_x; ++x) {
+                int head = grid->cells[(z * grid->nb_cells_y + y) * grid->nb_cells_x + x];
+                if (head < 0) continue;
+
+                // loose bounds of the cell
+                aabb_t cell = {{grid->origin.x + x * grid->cell_size - half_cell,
+                                grid->origin.y + y * grid->cell_size - half_cell,
+                                grid->origin.z + z * grid->cell_size - half_cell, FX(1.0f)},
+                               {grid->origin.x + (x + 1) * grid->cell_size + half_cell,
+                                grid->origin.y + (y + 1) * grid->cell_size + half_cell,
+                                grid->origin.z + (z + 1) * grid->cell_size + half_cell, FX(1.0f)}};
+                if (!aabb_is_visible_within(&cell, &mat_view_proj, view_distance)) continue;
+
+                nb_handles = query_list(grid, head, &mat_view_proj, view_distance, handles, nb_handles, max_handles);
+            }
+
+    return nb_handles;
+}
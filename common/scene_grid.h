@@ -0,0 +1,41 @@
+// scene_grid.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Loose uniform grid of the objects of a scene. Each object is stored in the cell containing the center of its world
+// bounds, and the cells are tested with their bounds enlarged by half a cell, so that moving an object only relinks it
+// when its center changes cell. A frustum query only visits the cells overlapping the bounds of the frustum, so that
+// its cost follows the visible set instead of the size of the scene. Objects larger than a cell, or outside of the grid,
+// are kept in a separate list which is always tested.
+
+#ifndef SCENE_GRID_H
+#define SCENE_GRID_H
+
+#include "graphite.h"
+
+typedef struct scene_grid scene_grid_t;
+
+typedef struct {
+    model_t* model;
+    mat4x4* mat_world;  // owned by the caller
+    void* user_data;
+    aabb_t bounds;      // in world space
+} scene_object_t;
+
+// The grid covers the given world bounds with cubic cells. Returns NULL on error.
+scene_grid_t* scene_grid_create(aabb_t* world_bounds, fx32 cell_size);
+void scene_grid_free(scene_grid_t* grid);
+
+// Returns the handle of the object, or -1 on error
+int scene_grid_insert(scene_grid_t* grid, model_t* model, mat4x4* mat_world, void* user_data, aabb_t* bounds);
+void scene_grid_remove(scene_grid_t* grid, int handle);
+// to call when the world bounds of an object change
+void scene_grid_move(scene_grid_t* grid, int handle, aabb_t* bounds);
+scene_object_t* scene_grid_object(scene_grid_t* grid, int handle);
+
+// Store the handles of the objects intersecting the view frustum up to view_distance, at most max_handles, and return
+// how many were found.
+size_t scene_grid_query(scene_grid_t* grid, mat4x4* mat_view, mat4x4* mat_proj, fx32 view_distance, int* handles,
+                        size_t max_handles);
+
+#endif
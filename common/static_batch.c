@@ -0,0 +1,319 @@
+// static_batch.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "static_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// mesh layout flags, only models with the same layout are merged
+#define LAYOUT_TEXCOORDS 1
+#define LAYOUT_COLORS 2
+#define LAYOUT_NORMALS 4
+
+typedef struct {
+    size_t model_index;
+    size_t face_index;
+    int layout;
+    vec3d centroid;  // origin of the model in world space, the faces of a model stay together
+    fx32 key;        // sort key of the current split
+} batch_face_t;
+
+// local index of each attribute of a model in the batch being built, -1 if not referenced yet
+typedef struct {
+    int* vertices;
+    int* texcoords;
+    int* colors;
+    int* normals;
+} index_map_t;
+
+static int compare_batch_faces(const void* a, const void* b) {
+    const batch_face_t* fa = (const batch_face_t*)a;
+    const batch_face_t* fb = (const batch_face_t*)b;
+    if (fa->layout != fb->layout) return fa->layout - fb->layout;
+    return (fa->key > fb->key) - (fa->key < fb->key);
+}
+
+// order of the faces in the models, to draw the faces of a batch in the order of draw_model. It draws the faces of a
+// mesh from the last one, so the models are in reverse order and their faces in order.
+static int compare_model_faces(const void* a, const void* b) {
+    const batch_face_t* fa = (const batch_face_t*)a;
+    const batch_face_t* fb = (const batch_face_t*)b;
+    if (fa->model_index != fb->model_index) return (fa->model_index < fb->model_index) - (fa->model_index > fb->model_index);
+    return (fa->face_index > fb->face_index) - (fa->face_index < fb->face_index);
+}
+
+static int model_layout(model_t* model) {
+    mesh_t* mesh = &model->mesh;
+    return (mesh->texcoords ? LAYOUT_TEXCOORDS : 0) | (mesh->colors ? LAYOUT_COLORS : 0) |
+           (mesh->nb_normals > 0 ? LAYOUT_NORMALS : 0);
+}
+
+static aabb_t faces_bounds(batch_face_t* faces, size_t nb_faces) {
+    aabb_t box = {faces[0].centroid, faces[0].centroid};
+    for (size_t i = 1; i < nb_faces; ++i) {
+        vec3d* c = &faces[i].centroid;
+        if (c->x < box.min.x) box.min.x = c->x;
+        if (c->y < box.min.y) box.min.y = c->y;
+        if (c->z < box.min.z) box.min.z = c->z;
+        if (c->x > box.max.x) box.max.x = c->x;
+        if (c->y > box.max.y) box.max.y = c->y;
+        if (c->z > box.max.z) box.max.z = c->z;
+    }
+    return box;
+}
+
+static void aabb_extend(aabb_t* box, vec3d* p) {
+    if (p->x < box->min.x) box->min.x = p->x;
+    if (p->y < box->min.y) box->min.y = p->y;
+    if (p->z < box->min.z) box->min.z = p->z;
+    if (p->x > box->max.x) box->max.x = p->x;
+    if (p->y > box->max.y) box->max.y = p->y;
+    if (p->z > box->max.z) box->max.z = p->z;
+}
+
+// assign the next local index to an attribute referenced for the first time
+static int map_index(int* map, int index, size_t* nb) {
+    if (index < 0) return -1;
+    if (map[index] < 0) map[index] = (int)(*nb)++;
+    return map[index];
+}
+
+static int local_index(int* map, int index) { return index < 0 ? -1 : map[index]; }
+
+// Matrix of the normals of a world matrix: the inverse transpose of its 3x3 part, which is its matrix of cofactors
+// divided by its determinant, so that the normals stay perpendicular to the faces with a non-uniform scale. Computed in
+// float, the cofactors of small scales are too coarse in fixed point.
+static mat4x4 matrix_make_normal(mat4x4* m) {
+    float a[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) a[i][j] = FLT(m->m[i][j]);
+
+    float c[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            c[i][j] = a[(i + 1) % 3][(j + 1) % 3] * a[(i + 2) % 3][(j + 2) % 3] -
+                      a[(i + 1) % 3][(j + 2) % 3] * a[(i + 2) % 3][(j + 1) % 3];
+    float det = a[0][0] * c[0][0] + a[0][1] * c[0][1] + a[0][2] * c[0][2];
+    // a degenerate matrix keeps its cofactors, the normals are normalized anyway
+    if (det == 0.0f) det = 1.0f;
+
+    mat4x4 r = matrix_make_identity();
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) r.m[i][j] = FX(c[i][j] / det);
+    return r;
+}
+
+static bool build_batch(static_batch_t* batch, model_t** models, mat4x4* mat_worlds, index_map_t* maps,
+                        batch_face_t* faces, size_t nb_faces) {
+    mesh_t* mesh = &batch->model.mesh;
+    int layout = faces[0].layout;
+    memset(batch, 0, sizeof(static_batch_t));
+
+    // count the attributes referenced by the faces of the batch
+    for (size_t i = 0; i < nb_faces; ++i) {
+        index_map_t* map = &maps[faces[i].model_index];
+        face_t* face = &models[faces[i].model_index]->mesh.faces[faces[i].face_index];
+        for (int j = 0; j < 3; ++j) {
+            map_index(map->vertices, face->indices[j], &mesh->nb_vertices);
+            if (layout & LAYOUT_TEXCOORDS) map_index(map->texcoords, face->tex_indices[j], &mesh->nb_texcoords);
+            if (layout & LAYOUT_COLORS) map_index(map->colors, face->col_indices[j], &mesh->nb_colors);
+            if (layout & LAYOUT_NORMALS) map_index(map->normals, face->norm_indices[j], &mesh->nb_normals);
+        }
+    }
+    mesh->nb_faces = nb_faces;
+
+    size_t size = mesh->nb_vertices * sizeof(vec3d) + mesh->nb_texcoords * sizeof(vec2d) +
+                  mesh->nb_colors * sizeof(vec3d) + mesh->nb_normals * sizeof(vec3d) + nb_faces * sizeof(face_t);
+#if SORT_TRIANGLES
+    // note: clipping can produce an additional triangle
+    size += 2 * nb_faces * sizeof(raster_triangle_t);
+#endif
+    char* p = (char*)malloc(size);
+    if (!p) return false;
+
+    mesh->vertices = (vec3d*)p;
+    p += mesh->nb_vertices * sizeof(vec3d);
+    mesh->texcoords = (layout & LAYOUT_TEXCOORDS) ? (vec2d*)p : NULL;
+    p += mesh->nb_texcoords * sizeof(vec2d);
+    mesh->colors = (layout & LAYOUT_COLORS) ? (vec3d*)p : NULL;
+    p += mesh->nb_colors * sizeof(vec3d);
+    mesh->normals = (layout & LAYOUT_NORMALS) ? (vec3d*)p : NULL;
+    p += mesh->nb_normals * sizeof(vec3d);
+    mesh->faces = (face_t*)p;
+#if SORT_TRIANGLES
+    p += nb_faces * sizeof(face_t);
+    batch->model.triangles_to_raster = (raster_triangle_t*)p;
+#endif
+
+    // copy the faces with local indices and the attributes transformed to world space
+    for (size_t i = 0; i < nb_faces; ++i) {
+        mat4x4* mat_world = &mat_worlds[faces[i].model_index];
+        mesh_t* src = &models[faces[i].model_index]->mesh;
+        index_map_t* map = &maps[faces[i].model_index];
+        face_t* face = &src->faces[faces[i].face_index];
+        face_t* dst = &mesh->faces[i];
+
+        mat4x4 mat_normal = matrix_make_normal(mat_world);
+
+        for (int j = 0; j < 3; ++j) {
+            dst->indices[j] = map->vertices[face->indices[j]];
+            dst->tex_indices[j] = (layout & LAYOUT_TEXCOORDS) ? local_index(map->texcoords, face->tex_indices[j]) : -1;
+            dst->col_indices[j] = (layout & LAYOUT_COLORS) ? local_index(map->colors, face->col_indices[j]) : -1;
+            dst->norm_indices[j] = (layout & LAYOUT_NORMALS) ? local_index(map->normals, face->norm_indices[j]) : -1;
+
+            vec3d v = matrix_multiply_vector(mat_world, &src->vertices[face->indices[j]]);
+            v.w = FX(1.0f);
+            mesh->vertices[dst->indices[j]] = v;
+            if (i == 0 && j == 0) batch->bounds.min = batch->bounds.max = v;
+            aabb_extend(&batch->bounds, &v);
+
+            if (dst->tex_indices[j] >= 0) mesh->texcoords[dst->tex_indices[j]] = src->texcoords[face->tex_indices[j]];
+            if (dst->col_indices[j] >= 0) mesh->colors[dst->col_indices[j]] = src->colors[face->col_indices[j]];
+            if (dst->norm_indices[j] >= 0) {
+                vec3d n = matrix_multiply_vector(&mat_normal, &src->normals[face->norm_indices[j]]);
+                n = vector_normalize(&n);
+                n.w = FX(0.0f);
+                mesh->normals[dst->norm_indices[j]] = n;
+            }
+        }
+    }
+
+    // reset the index maps for the next batch
+    for (size_t i = 0; i < nb_faces; ++i) {
+        index_map_t* map = &maps[faces[i].model_index];
+        face_t* face = &models[faces[i].model_index]->mesh.faces[faces[i].face_index];
+        for (int j = 0; j < 3; ++j) {
+            map->vertices[face->indices[j]] = -1;
+            if ((layout & LAYOUT_TEXCOORDS) && face->tex_indices[j] >= 0) map->texcoords[face->tex_indices[j]] = -1;
+            if ((layout & LAYOUT_COLORS) && face->col_indices[j] >= 0) map->colors[face->col_indices[j]] = -1;
+            if ((layout & LAYOUT_NORMALS) && face->norm_indices[j] >= 0) map->normals[face->norm_indices[j]] = -1;
+        }
+    }
+
+    return true;
+}
+
+static int* make_index_map(size_t nb) {
+    int* map = (int*)malloc((nb + 1) * sizeof(int));
+    if (map) memset(map, 0xff, (nb + 1) * sizeof(int));
+    return map;
+}
+
+static_batch_set_t* static_batch_build(model_t** models, mat4x4* mat_worlds, size_t nb_models, size_t max_faces) {
+    size_t nb_faces = 0;
+    for (size_t i = 0; i < nb_models; ++i) nb_faces += models[i]->mesh.nb_faces;
+
+    static_batch_set_t* set = (static_batch_set_t*)calloc(1, sizeof(static_batch_set_t));
+    if (!set) return NULL;
+
+    // there are at most as many batches and pending ranges as faces
+    batch_face_t* faces = (batch_face_t*)malloc((nb_faces + 1) * sizeof(batch_face_t));
+    index_map_t* maps = (index_map_t*)calloc(nb_models + 1, sizeof(index_map_t));
+    size_t* ranges = (size_t*)malloc(2 * (nb_faces + 1) * sizeof(size_t));
+    set->batches = (static_batch_t*)malloc((nb_faces + 1) * sizeof(static_batch_t));
+    bool ok = faces && maps && ranges && set->batches && max_faces > 0;
+
+    // world space origins of the models of the faces
+    size_t n = 0;
+    for (size_t i = 0; ok && i < nb_models; ++i) {
+        mesh_t* mesh = &models[i]->mesh;
+        maps[i].vertices = make_index_map(mesh->nb_vertices);
+        maps[i].texcoords = make_index_map(mesh->nb_texcoords);
+        maps[i].colors = make_index_map(mesh->nb_colors);
+        maps[i].normals = make_index_map(mesh->nb_normals);
+        ok = maps[i].vertices && maps[i].texcoords && maps[i].colors && maps[i].normals;
+
+        int layout = model_layout(models[i]);
+        vec3d c = matrix_multiply_vector(&mat_worlds[i], &(vec3d){FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)});
+        for (size_t j = 0; ok && j < mesh->nb_faces; ++j) faces[n++] = (batch_face_t){i, j, layout, c, FX(0.0f)};
+    }
+
+    // group the faces by layout, then split each group recursively at the median of the largest axis of the centroids
+    // so that the batches are spatially coherent and can be culled individually
+    size_t nb_ranges = 0;
+    if (ok && nb_faces > 0) {
+        qsort(faces, nb_faces, sizeof(batch_face_t), compare_batch_faces);
+        for (size_t begin = 0, end; begin < nb_faces; begin = end) {
+            for (end = begin + 1; end < nb_faces && faces[end].layout == faces[begin].layout; ++end)
+                ;
+            ranges[nb_ranges * 2] = begin;
+            ranges[nb_ranges * 2 + 1] = end;
+            nb_ranges++;
+        }
+    }
+    while (ok && nb_ranges > 0) {
+        nb_ranges--;
+        size_t begin = ranges[nb_ranges * 2], end = ranges[nb_ranges * 2 + 1];
+        if (end - begin <= max_faces) {
+            qsort(&faces[begin], end - begin, sizeof(batch_face_t), compare_model_faces);
+            ok = build_batch(&set->batches[set->nb_batches], models, mat_worlds, maps, &faces[begin], end - begin);
+            if (ok) set->nb_batches++;
+            continue;
+        }
+
+        aabb_t box = faces_bounds(&faces[begin], end - begin);
+        vec3d extent = vector_sub(&box.max, &box.min);
+        for (size_t i = begin; i < end; ++i) {
+            vec3d* c = &faces[i].centroid;
+            faces[i].key = (extent.x >= extent.y && extent.x >= extent.z) ? c->x : (extent.y >= extent.z) ? c->y : c->z;
+        }
+        qsort(&faces[begin], end - begin, sizeof(batch_face_t), compare_batch_faces);
+
+        // the second half is pushed first so that the batches are built in spatial order
+        size_t half = begin + (end - begin) / 2;
+        ranges[nb_ranges * 2] = half;
+        ranges[nb_ranges * 2 + 1] = end;
+        ranges[nb_ranges * 2 + 2] = begin;
+        ranges[nb_ranges * 2 + 3] = half;
+        nb_ranges += 2;
+    }
+
+    for (size_t i = 0; maps && i < nb_models; ++i) {
+        free(maps[i].vertices);
+        free(maps[i].texcoords);
+        free(maps[i].colors);
+        free(maps[i].normals);
+    }
+    free(maps);
+    free(ranges);
+    free(faces);
+
+    if (!ok) {
+        printf("Unable to build the static batches\n");
+        static_batch_free(set);
+        return NULL;
+    }
+
+    static_batch_t* batches = (static_batch_t*)realloc(set->batches, (set->nb_batches + 1) * sizeof(static_batch_t));
+    if (batches) set->batches = batches;
+    return set;
+}
+
+void static_batch_free(static_batch_set_t* set) {
+    if (!set) return;
+    for (size_t i = 0; set->batches && i < set->nb_batches; ++i) free(set->batches[i].model.mesh.vertices);
+    free(set->batches);
+    free(set);
+}
+
+size_t draw_static_batches(int viewport_width, int viewport_height, vec3d* vec_camera, static_batch_set_t* set,
+                           mat4x4* mat_proj, mat4x4* mat_view, light_t* lights, size_t nb_lights,
+                           bool is_gouraud_shading, bool is_wireframe, texture_t* texture, bool clamp_s, bool clamp_t,
+                           int texture_scale_x, int texture_scale_y, bool perspective_correct) {
+    mat4x4 mat_identity = matrix_make_identity();
+    mat4x4 mat_view_proj = matrix_multiply_matrix(mat_view, mat_proj);
+
+    size_t nb_draw_calls = 0;
+    for (size_t i = 0; i < set->nb_batches; ++i) {
+        static_batch_t* batch = &set->batches[i];
+        if (!aabb_is_visible(&batch->bounds, &mat_view_proj)) continue;
+        draw_model(viewport_width, viewport_height, vec_camera, &batch->model, NULL,
+                   is_gouraud_shading ? &mat_identity : NULL, mat_proj, mat_view, lights, nb_lights, is_wireframe,
+                   texture, clamp_s, clamp_t, texture_scale_x, texture_scale_y, perspective_correct);
+        nb_draw_calls++;
+    }
+    return nb_draw_calls;
+}
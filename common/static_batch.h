@@ -0,0 +1,38 @@
+// static_batch.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Static batching. The models of a scene which never move are transformed once to world space and merged into a few
+// spatially coherent batches, so that the whole static set is drawn with a handful of draw_model calls instead of one
+// per model. The models are grouped by mesh layout (texture coordinates, colors and normals) and all the batches are
+// drawn with the same render state. The faces of a batch keep the order of their models, so the batches draw the pixels
+// of one draw_model call per model, except where models of different batches are at the same depth.
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include "graphite.h"
+
+typedef struct {
+    model_t model;  // in world space
+    aabb_t bounds;  // in world space
+} static_batch_t;
+
+typedef struct {
+    size_t nb_batches;
+    static_batch_t* batches;
+} static_batch_set_t;
+
+// Merge the models, each one with its world matrix, into batches of at most max_faces faces.
+// Returns NULL on error.
+static_batch_set_t* static_batch_build(model_t** models, mat4x4* mat_worlds, size_t nb_models, size_t max_faces);
+void static_batch_free(static_batch_set_t* set);
+
+// Same as draw_model for the batches intersecting the view frustum. The normals are already in world space, so Gouraud
+// shading is selected by a flag instead of a normal matrix. Returns the number of draw_model calls.
+size_t draw_static_batches(int viewport_width, int viewport_height, vec3d* vec_camera, static_batch_set_t* set,
+                           mat4x4* mat_proj, mat4x4* mat_view, light_t* lights, size_t nb_lights,
+                           bool is_gouraud_shading, bool is_wireframe, texture_t* texture, bool clamp_s, bool clamp_t,
+                           int texture_scale_x, int texture_scale_y, bool perspective_correct);
+
+#endif
@@ -2129,8 +2129,10 @@ static face_t faces[] = {{{0, 5, 6}, {0, 1, 2}, {-1, -1, -1}, {-1, 1, 2}},
                          {{469, 529, 528}, {151, 219, 217}, {-1, -1, -1}, {473, 529, 528}}};
 
 static model_t g_model;
+#if SORT_TRIANGLES
 // note: clipping can produce an additional triangle
-static triangle_t g_triangles_to_raster[2 * sizeof(faces) / sizeof(face_t)];
+static raster_triangle_t g_triangles_to_raster[2 * sizeof(faces) / sizeof(face_t)];
+#endif
 
 model_t* load_teapot() {
     g_model.mesh.nb_faces = sizeof(faces) / sizeof(face_t);
@@ -2143,7 +2145,11 @@ model_t* load_teapot() {
     g_model.mesh.texcoords = texcoords;
     g_model.mesh.colors = NULL;
     g_model.mesh.normals = normals;
+#if SORT_TRIANGLES
     g_model.triangles_to_raster = g_triangles_to_raster;
+#else
+    g_model.triangles_to_raster = NULL;
+#endif
 
     return &g_model;
 }
@@ -0,0 +1,48 @@
+// transform.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "transform.h"
+
+#include <string.h>
+
+void transform_node_init(transform_node_t* node, transform_node_t* parent) {
+    memset(node, 0, sizeof(transform_node_t));
+    node->local = matrix_make_identity();
+    node->parent = parent;
+
+    if (parent) {
+        transform_node_t** link = &parent->first_child;
+        while (*link) link = &(*link)->next_sibling;
+        *link = node;
+    }
+
+    // new nodes always need an update
+    transform_node_set_local(node, &node->local);
+}
+
+void transform_node_set_local(transform_node_t* node, mat4x4* local) {
+    node->local = *local;
+    node->dirty = true;
+    for (transform_node_t* n = node->parent; n && !n->has_dirty_child; n = n->parent) n->has_dirty_child = true;
+}
+
+static void update_node(transform_node_t* node, bool parent_changed, mat4x4* mat_view_proj, bool view_proj_changed) {
+    bool changed = parent_changed || node->dirty;
+    if (!changed && !node->has_dirty_child && !view_proj_changed) return;
+
+    if (changed)
+        node->world = node->parent ? matrix_multiply_matrix(&node->local, &node->parent->world) : node->local;
+    if (changed || view_proj_changed) node->world_view_proj = matrix_multiply_matrix(&node->world, mat_view_proj);
+    node->dirty = false;
+    node->has_dirty_child = false;
+
+    for (transform_node_t* child = node->first_child; child; child = child->next_sibling)
+        update_node(child, changed, mat_view_proj, view_proj_changed);
+}
+
+void transform_update(transform_node_t* root, mat4x4* mat_view_proj) {
+    bool view_proj_changed = memcmp(&root->mat_view_proj, mat_view_proj, sizeof(mat4x4)) != 0;
+    root->mat_view_proj = *mat_view_proj;
+    update_node(root, false, mat_view_proj, view_proj_changed);
+}
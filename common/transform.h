@@ -0,0 +1,36 @@
+// transform.h
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Hierarchy of transforms with cached world and world-view-projection matrices. Changing the local matrix of a node
+// marks it dirty and flags its ancestors, so that an update only visits the dirty subtrees and leaves the unchanged
+// branches alone, unless the view-projection matrix itself changed.
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "graphite.h"
+
+typedef struct transform_node {
+    mat4x4 local;
+    mat4x4 world;
+    mat4x4 world_view_proj;  // for draw_model culling (aabb_is_visible)
+
+    struct transform_node* parent;
+    struct transform_node* first_child;
+    struct transform_node* next_sibling;
+
+    bool dirty;            // the local matrix changed since the last update
+    bool has_dirty_child;  // a descendant is dirty
+    mat4x4 mat_view_proj;  // view-projection matrix of the last update, only used on the root
+} transform_node_t;
+
+// Initialize a node with an identity local matrix and attach it as the last child of parent (if not NULL)
+void transform_node_init(transform_node_t* node, transform_node_t* parent);
+void transform_node_set_local(transform_node_t* node, mat4x4* local);
+
+// Recompute the world and world-view-projection matrices of the dirty nodes of the hierarchy under root, and the
+// world-view-projection matrices of every node if mat_view_proj changed
+void transform_update(transform_node_t* root, mat4x4* mat_view_proj);
+
+#endif
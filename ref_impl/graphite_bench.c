@@ -0,0 +1,1445 @@
+// graphite_bench.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+// Headless benchmarks of the reference implementation. The frames are rendered into a framebuffer in memory.
+// Usage: graphite_bench [benchmark name...]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <block_texture.h>
+#include <cube.h>
+#include <dynamic_mesh.h>
+#include <dynamic_resolution.h>
+#include <impostor.h>
+#include <scene_grid.h>
+#include <static_batch.h>
+#include <teapot.h>
+#include <transform.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "sw_rasterizer.h"
+
+#define SCREEN_WIDTH 320
+#define SCREEN_HEIGHT 240
+
+static uint16_t g_framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+static size_t g_nb_triangles;
+
+// rasterizer of xd_draw_triangle
+typedef enum { BENCH_BARYCENTRIC, BENCH_STANDARD } bench_rasterizer_t;
+static bench_rasterizer_t g_rasterizer = BENCH_BARYCENTRIC;
+
+void draw_pixel(int x, int y, int color) { g_framebuffer[y * SCREEN_WIDTH + x] = (uint16_t)color; }
+
+void xd_draw_triangle(vec3d p[3], vec2d t[3], vec3d c[3], texture_t* tex, bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y,
+                      bool depth_test, bool perspective_correct, bool alpha_test)
+{
+    g_nb_triangles++;
+    if (tex) sw_bind_texture(tex);
+    sw_set_alpha_test(alpha_test);
+    if (g_rasterizer == BENCH_STANDARD) {
+        sw_draw_triangle_standard(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
+    } else {
+        sw_draw_triangle_barycentric(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
+    }
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void clear_frame() {
+    memset(g_framebuffer, 0, sizeof(g_framebuffer));
+    sw_clear_depth_buffer_barycentric();
+}
+
+static size_t count_different_pixels(uint16_t* a, uint16_t* b) {
+    size_t nb = 0;
+    for (size_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) nb += a[i] != b[i];
+    return nb;
+}
+
+static light_t g_light = {{FX(0.0f), FX(0.0f), FX(1.0f), FX(0.0f)},
+                          {FX(0.1f), FX(0.1f), FX(0.1f), FX(1.0f)},
+                          {FX(0.5f), FX(0.5f), FX(0.5f), FX(1.0f)}};
+
+//
+// Static batching: a field of small props drawn one draw_model call per prop, then merged into batches
+//
+
+#define NB_PROPS_X 64
+#define NB_PROPS_Z 64
+#define NB_PROPS (NB_PROPS_X * NB_PROPS_Z)
+#define NB_FRAMES 20
+
+static void bench_static_batching() {
+    model_t* cube = load_cube();
+    static model_t* models[NB_PROPS];
+    static mat4x4 mat_worlds[NB_PROPS];
+
+    srand(1);
+    for (int i = 0; i < NB_PROPS; ++i) {
+        mat4x4 mat_rot = matrix_make_rotation_y((float)(rand() % 628) / 100.0f);
+        mat4x4 mat_scale = matrix_make_scale(FX(0.2f), FX(0.2f), FX(0.2f));
+        mat4x4 mat_trans = matrix_make_translation(FX(-8.0f + 0.25f * (i % NB_PROPS_X)), FX(-1.0f),
+                                                   FX(1.0f + 0.25f * (i / NB_PROPS_X)));
+        mat_worlds[i] = matrix_multiply_matrix(&mat_rot, &mat_scale);
+        mat_worlds[i] = matrix_multiply_matrix(&mat_worlds[i], &mat_trans);
+        models[i] = cube;
+    }
+
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
+    vec3d vec_target = {FX(0.0f), FX(-0.3f), FX(1.0f), FX(1.0f)};
+    mat4x4 mat_camera = matrix_point_at(&vec_camera, &vec_target, &vec_up);
+    mat4x4 mat_view = matrix_quick_inverse(&mat_camera);
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+
+    // one draw call per prop
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    // fastest frame, less sensitive to the load of the machine
+    double per_prop_ms = 1e9;
+    for (int frame = 0; frame < NB_FRAMES; ++frame) {
+        double t0 = now_ms();
+        clear_frame();
+        for (int i = 0; i < NB_PROPS; ++i)
+            draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, models[i], &mat_worlds[i], NULL, &mat_proj, &mat_view,
+                       &g_light, 1, false, NULL, false, false, 0, 0, true);
+        double frame_ms = now_ms() - t0;
+        if (frame_ms < per_prop_ms) per_prop_ms = frame_ms;
+    }
+    memcpy(reference, g_framebuffer, sizeof(reference));
+
+    printf("static batching: %d props of %zu faces, %d frames\n", NB_PROPS, cube->mesh.nb_faces, NB_FRAMES);
+    printf("  per prop:  %5d draw calls, %8.2f ms/frame\n", NB_PROPS, per_prop_ms);
+
+    static const size_t batch_sizes[] = {256, 1024, 4096};
+    for (size_t k = 0; k < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++k) {
+        double t0 = now_ms();
+        static_batch_set_t* set = static_batch_build(models, mat_worlds, NB_PROPS, batch_sizes[k]);
+        double build_ms = now_ms() - t0;
+        if (!set) return;
+
+        size_t nb_draw_calls = 0;
+        double batched_ms = 1e9;
+        for (int frame = 0; frame < NB_FRAMES; ++frame) {
+            t0 = now_ms();
+            clear_frame();
+            nb_draw_calls = draw_static_batches(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, set, &mat_proj, &mat_view,
+                                                &g_light, 1, false, false, NULL, false, false, 0, 0, true);
+            double frame_ms = now_ms() - t0;
+            if (frame_ms < batched_ms) batched_ms = frame_ms;
+        }
+
+        printf("  batched (%4zu faces/batch, %3zu batches, built in %.1f ms): %5zu draw calls, %8.2f ms/frame "
+               "(%.2fx), %zu pixels differ\n",
+               batch_sizes[k], set->nb_batches, build_ms, nb_draw_calls, batched_ms, per_prop_ms / batched_ms,
+               count_different_pixels(reference, g_framebuffer));
+        static_batch_free(set);
+    }
+}
+
+//
+// Scene grid: frustum queries over a large scene of small objects, compared to testing the bounds of every object
+//
+
+#define GRID_SIZE 100
+#define GRID_SPACING 4
+#define NB_OBJECTS (GRID_SIZE * GRID_SIZE)
+#define NB_MOVING_OBJECTS 1000
+#define NB_QUERIES 100
+#define VIEW_DISTANCE FX(40.0f)
+
+static void bench_scene_grid() {
+    model_t* cube = load_cube();
+    aabb_t cube_bounds = mesh_bounds(&cube->mesh);
+    static mat4x4 mat_worlds[NB_OBJECTS];
+    static aabb_t bounds[NB_OBJECTS];
+    static int handles[NB_OBJECTS];
+    static int visible[NB_OBJECTS];
+
+    aabb_t world_bounds = {{FX(-200.0f), FX(-2.0f), FX(-200.0f), FX(1.0f)}, {FX(200.0f), FX(2.0f), FX(200.0f), FX(1.0f)}};
+    scene_grid_t* grid = scene_grid_create(&world_bounds, FX(4.0f));
+    if (!grid) return;
+
+    srand(1);
+    for (int i = 0; i < NB_OBJECTS; ++i) {
+        mat4x4 mat_rot = matrix_make_rotation_y((float)(rand() % 628) / 100.0f);
+        mat4x4 mat_scale = matrix_make_scale(FX(0.5f), FX(0.5f), FX(0.5f));
+        mat4x4 mat_trans = matrix_make_translation(FXI((i % GRID_SIZE - GRID_SIZE / 2) * GRID_SPACING), FX(-1.0f),
+                                                   FXI((i / GRID_SIZE - GRID_SIZE / 2) * GRID_SPACING));
+        mat_worlds[i] = matrix_multiply_matrix(&mat_rot, &mat_scale);
+        mat_worlds[i] = matrix_multiply_matrix(&mat_worlds[i], &mat_trans);
+        bounds[i] = aabb_transform(&cube_bounds, &mat_worlds[i]);
+        handles[i] = scene_grid_insert(grid, cube, &mat_worlds[i], NULL, &bounds[i]);
+    }
+
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
+
+    double linear_ms = 0.0, grid_ms = 0.0, move_ms = 0.0;
+    size_t nb_linear = 0, nb_grid = 0;
+    for (int q = 0; q < NB_QUERIES; ++q) {
+        // walk around the scene
+        vec3d vec_camera = {FX(-150.0f + 3.0f * q), FX(0.0f), FX(100.0f - 2.0f * q), FX(1.0f)};
+        vec3d vec_target = {FX(0.0f), FX(0.0f), FX(1.0f), FX(1.0f)};
+        mat4x4 mat_camera_rot = matrix_make_rotation_y(q * 6.28f / NB_QUERIES);
+        vec3d vec_look_dir = matrix_multiply_vector(&mat_camera_rot, &vec_target);
+        vec_target = vector_add(&vec_camera, &vec_look_dir);
+        mat4x4 mat_camera = matrix_point_at(&vec_camera, &vec_target, &vec_up);
+        mat4x4 mat_view = matrix_quick_inverse(&mat_camera);
+        mat4x4 mat_view_proj = matrix_multiply_matrix(&mat_view, &mat_proj);
+
+        // move some objects
+        double t0 = now_ms();
+        for (int i = 0; i < NB_MOVING_OBJECTS; ++i) {
+            int k = (q * NB_MOVING_OBJECTS + i * 7) % NB_OBJECTS;
+            fx32 dx = (q & 1) ? FX(0.3f) : FX(-0.3f);
+            mat_worlds[k].m[3][0] += dx;
+            bounds[k].min.x += dx;
+            bounds[k].max.x += dx;
+            scene_grid_move(grid, handles[k], &bounds[k]);
+        }
+        move_ms += now_ms() - t0;
+
+        t0 = now_ms();
+        size_t n = 0;
+        for (int i = 0; i < NB_OBJECTS; ++i)
+            if (aabb_is_visible_within(&bounds[i], &mat_view_proj, VIEW_DISTANCE)) n++;
+        linear_ms += now_ms() - t0;
+        nb_linear += n;
+
+        t0 = now_ms();
+        nb_grid += scene_grid_query(grid, &mat_view, &mat_proj, VIEW_DISTANCE, visible, NB_OBJECTS);
+        grid_ms += now_ms() - t0;
+    }
+
+    printf("scene grid: %d objects, %d moved per query, %d queries\n", NB_OBJECTS, NB_MOVING_OBJECTS, NB_QUERIES);
+    printf("  bounds of every object: %8.3f ms/query, %zu visible\n", linear_ms / NB_QUERIES, nb_linear / NB_QUERIES);
+    printf("  grid query:             %8.3f ms/query, %zu visible (%.2fx)\n", grid_ms / NB_QUERIES,
+           nb_grid / NB_QUERIES, linear_ms / grid_ms);
+    printf("  grid updates:           %8.3f ms/query\n", move_ms / NB_QUERIES);
+
+    scene_grid_free(grid);
+}
+
+//
+// Transform hierarchy: an articulated tree where a single branch is animated, rebuilt from scratch every frame
+// like the demo does, then updated through the transform cache
+//
+
+#define TREE_DEPTH 7
+#define TREE_BRANCHING 4
+#define TREE_NB_NODES 5461  // 1 + 4 + ... + 4^6
+#define TREE_ANIMATED_NODE 1
+#define NB_UPDATES 200
+
+static mat4x4 node_local(int index, float theta) {
+    mat4x4 mat_rot = matrix_make_rotation_y(theta + 0.1f * index);
+    mat4x4 mat_trans = matrix_make_translation(FX(0.5f), FX(0.0f), FX(0.25f));
+    return matrix_multiply_matrix(&mat_rot, &mat_trans);
+}
+
+static void bench_transform_hierarchy() {
+    static transform_node_t nodes[TREE_NB_NODES];
+    static int parents[TREE_NB_NODES];
+    static mat4x4 worlds[TREE_NB_NODES], world_view_projs[TREE_NB_NODES];
+
+    // breadth-first layout, the parent of node i is (i - 1) / TREE_BRANCHING
+    for (int i = 0; i < TREE_NB_NODES; ++i) {
+        parents[i] = i > 0 ? (i - 1) / TREE_BRANCHING : -1;
+        transform_node_init(&nodes[i], i > 0 ? &nodes[parents[i]] : NULL);
+        mat4x4 local = node_local(i, 0.0f);
+        transform_node_set_local(&nodes[i], &local);
+    }
+
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    mat4x4 mat_view = matrix_make_translation(FX(0.0f), FX(0.0f), FX(8.0f));
+    mat4x4 mat_view_proj = matrix_multiply_matrix(&mat_view, &mat_proj);
+    transform_update(&nodes[0], &mat_view_proj);
+
+    printf("transform hierarchy: %d nodes, depth %d, one animated branch, %d updates\n", TREE_NB_NODES, TREE_DEPTH,
+           NB_UPDATES);
+
+    for (int moving_camera = 0; moving_camera < 2; ++moving_camera) {
+        // rebuild every matrix
+        double t0 = now_ms();
+        for (int frame = 0; frame < NB_UPDATES; ++frame) {
+            if (moving_camera) mat_view.m[3][0] = FX(0.01f * frame);
+            mat_view_proj = matrix_multiply_matrix(&mat_view, &mat_proj);
+            for (int i = 0; i < TREE_NB_NODES; ++i) {
+                // the animated branch is the subtree of TREE_ANIMATED_NODE
+                mat4x4 local = node_local(i, i == TREE_ANIMATED_NODE ? 0.01f * frame : 0.0f);
+                worlds[i] = i > 0 ? matrix_multiply_matrix(&local, &worlds[parents[i]]) : local;
+                world_view_projs[i] = matrix_multiply_matrix(&worlds[i], &mat_view_proj);
+            }
+        }
+        double rebuild_ms = (now_ms() - t0) / NB_UPDATES;
+
+        // only the animated node is set, then the dirty subtree is updated
+        t0 = now_ms();
+        for (int frame = 0; frame < NB_UPDATES; ++frame) {
+            if (moving_camera) mat_view.m[3][0] = FX(0.01f * frame);
+            mat_view_proj = matrix_multiply_matrix(&mat_view, &mat_proj);
+            mat4x4 local = node_local(TREE_ANIMATED_NODE, 0.01f * frame);
+            transform_node_set_local(&nodes[TREE_ANIMATED_NODE], &local);
+            transform_update(&nodes[0], &mat_view_proj);
+        }
+        double cached_ms = (now_ms() - t0) / NB_UPDATES;
+
+        size_t nb_different = 0;
+        for (int i = 0; i < TREE_NB_NODES; ++i)
+            nb_different += memcmp(&worlds[i], &nodes[i].world, sizeof(mat4x4)) != 0 ||
+                            memcmp(&world_view_projs[i], &nodes[i].world_view_proj, sizeof(mat4x4)) != 0;
+
+        printf("  %s camera: rebuild %7.3f ms/update, cached %7.3f ms/update (%.2fx), %zu nodes differ\n",
+               moving_camera ? "moving" : "static", rebuild_ms, cached_ms, rebuild_ms / cached_ms, nb_different);
+    }
+}
+
+//
+// Impostors: a crowd of distant teapots drawn as models, then as quads of an atlas refreshed as the camera orbits
+//
+
+#define CROWD_SIZE 20
+#define CROWD_NB_INSTANCES (CROWD_SIZE * CROWD_SIZE)
+#define CROWD_NB_FRAMES 50
+#define IMPOSTOR_NB_VIEWS 16
+#define IMPOSTOR_CELL_SIZE 64
+#define IMPOSTOR_MAX_REFRESHES 2
+
+static uint16_t* g_atlas_pixels;
+static int g_atlas_width, g_cell_x, g_cell_y;
+
+// RGB565 to ARGB4444, opaque
+static void draw_atlas_pixel(int x, int y, int color) {
+    int r = (color >> 12) & 0xF, g = (color >> 7) & 0xF, b = (color >> 1) & 0xF;
+    g_atlas_pixels[(g_cell_y + y) * g_atlas_width + g_cell_x + x] = (uint16_t)(0xF000 | r << 8 | g << 4 | b);
+}
+
+static void render_impostor_cell(impostor_t* impostor, int x, int y, mat4x4* mat_world, mat4x4* mat_view,
+                                 mat4x4* mat_proj, void* user_data) {
+    static fx32 depth_buffer[IMPOSTOR_CELL_SIZE * IMPOSTOR_CELL_SIZE];
+    int cell_size = impostor_cell_size(impostor);
+    texture_t* atlas = impostor_atlas(impostor);
+    g_atlas_pixels = (uint16_t*)atlas->data;
+    g_atlas_width = (int)atlas->width;
+    g_cell_x = x;
+    g_cell_y = y;
+    memset(depth_buffer, 0, sizeof(depth_buffer));
+
+    sw_target_t target = {cell_size, cell_size, draw_atlas_pixel, depth_buffer, NULL, NULL, 0, NULL};
+    sw_target_t previous = sw_set_target_barycentric(target);
+    mat4x4 mat_camera = matrix_quick_inverse(mat_view);
+    vec3d vec_camera = {mat_camera.m[3][0], mat_camera.m[3][1], mat_camera.m[3][2], FX(1.0f)};
+    draw_model(cell_size, cell_size, &vec_camera, (model_t*)user_data, mat_world, NULL, mat_proj, mat_view, &g_light, 1,
+               false, NULL, false, false, 0, 0, true);
+    sw_set_target_barycentric(previous);
+}
+
+static void bench_impostors() {
+    model_t* teapot = load_teapot();
+    static mat4x4 mat_worlds[CROWD_NB_INSTANCES];
+
+    srand(1);
+    for (int i = 0; i < CROWD_NB_INSTANCES; ++i) {
+        mat4x4 mat_rot = matrix_make_rotation_y((float)(rand() % 628) / 100.0f);
+        mat4x4 mat_scale = matrix_make_scale(FX(1.0f), FX(1.0f), FX(1.0f));
+        mat4x4 mat_trans = matrix_make_translation(FX(-20.0f + 2.0f * (i % CROWD_SIZE)), FX(-2.0f),
+                                                   FX(20.0f + 2.0f * (i / CROWD_SIZE)));
+        mat_worlds[i] = matrix_multiply_matrix(&mat_rot, &mat_scale);
+        mat_worlds[i] = matrix_multiply_matrix(&mat_worlds[i], &mat_trans);
+    }
+
+    impostor_t* impostor = impostor_create(teapot, IMPOSTOR_NB_VIEWS, IMPOSTOR_CELL_SIZE, 10.0f,
+                                           render_impostor_cell, teapot);
+    if (!impostor) return;
+
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
+    vec3d vec_target = {FX(0.0f), FX(-2.0f), FX(30.0f), FX(1.0f)};
+
+    printf("impostors: %d teapots of %zu faces, %d views of %dx%d, %d frames\n", CROWD_NB_INSTANCES,
+           teapot->mesh.nb_faces, IMPOSTOR_NB_VIEWS, IMPOSTOR_CELL_SIZE, IMPOSTOR_CELL_SIZE, CROWD_NB_FRAMES);
+
+    for (int use_impostors = 0; use_impostors < 2; ++use_impostors) {
+        size_t nb_triangles = 0, nb_refreshed = 0, nb_initial = 0;
+        double t0 = now_ms();
+        for (int frame = 0; frame < CROWD_NB_FRAMES; ++frame) {
+            // the camera orbits around the crowd
+            float angle = 0.01f * frame;
+            vec3d vec_camera = {FX(30.0f * sinf(angle)), FX(2.0f), FX(30.0f - 30.0f * cosf(angle)), FX(1.0f)};
+            mat4x4 mat_camera = matrix_point_at(&vec_camera, &vec_target, &vec_up);
+            mat4x4 mat_view = matrix_quick_inverse(&mat_camera);
+
+            clear_frame();
+            g_nb_triangles = 0;
+            if (use_impostors) {
+                impostor_begin_frame(impostor, IMPOSTOR_MAX_REFRESHES);
+                for (int i = 0; i < CROWD_NB_INSTANCES; ++i)
+                    draw_impostor(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, impostor, &mat_worlds[i], &mat_view,
+                                  &mat_proj, true);
+                impostor_stats_t stats = impostor_stats(impostor);
+                if (frame == 0)
+                    nb_initial = stats.nb_refreshed;
+                else
+                    nb_refreshed += stats.nb_refreshed;
+            } else {
+                for (int i = 0; i < CROWD_NB_INSTANCES; ++i)
+                    draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, teapot, &mat_worlds[i], NULL, &mat_proj,
+                               &mat_view, &g_light, 1, false, NULL, false, false, 0, 0, true);
+            }
+            nb_triangles += g_nb_triangles;
+        }
+        double ms = (now_ms() - t0) / CROWD_NB_FRAMES;
+
+        if (use_impostors)
+            printf("  impostors: %8zu triangles/frame, %8.2f ms/frame, %zu cells rendered on the first frame, %.2f "
+                   "refreshed/frame after\n",
+                   nb_triangles / CROWD_NB_FRAMES, ms, nb_initial, (double)nb_refreshed / (CROWD_NB_FRAMES - 1));
+        else
+            printf("  models:    %8zu triangles/frame, %8.2f ms/frame\n", nb_triangles / CROWD_NB_FRAMES, ms);
+    }
+
+    impostor_free(impostor);
+}
+
+//
+// Dynamic mesh: a small region of a teapot deformed every frame, with the derived data refreshed for the dirty range
+// only, then entirely
+//
+
+#define DEFORM_NB_FRAMES 200
+#define DEFORM_FRACTION 20  // 1/20 of the vertices
+
+static void deform(dynamic_mesh_t* dm, vec3d* rest, size_t first, size_t count, int frame) {
+    static vec3d vertices[4096];
+    for (size_t i = 0; i < count; ++i) {
+        vertices[i] = rest[first + i];
+        vertices[i].y += FX(0.05f * sinf(0.3f * frame + 0.1f * i));
+    }
+    dynamic_mesh_set_vertices(dm, first, count, vertices);
+}
+
+static void bench_dynamic_mesh() {
+    model_t* teapot = load_teapot();
+    dynamic_mesh_t* incremental = dynamic_mesh_create(&teapot->mesh);
+    dynamic_mesh_t* full = dynamic_mesh_create(&teapot->mesh);
+    if (!incremental || !full) return;
+
+    mat4x4 mat_normal = matrix_make_rotation_x(0.5f);
+    dynamic_mesh_set_lighting(incremental, &mat_normal, &g_light, 1);
+    dynamic_mesh_set_lighting(full, &mat_normal, &g_light, 1);
+
+    mesh_t* mesh = &incremental->model.mesh;
+    size_t count = mesh->nb_vertices / DEFORM_FRACTION;
+    size_t first = mesh->nb_vertices / 3;
+
+    printf("dynamic mesh: %zu vertices, %zu faces, %zu vertices deformed per frame, %d frames\n", mesh->nb_vertices,
+           mesh->nb_faces, count, DEFORM_NB_FRAMES);
+
+    double t0 = now_ms();
+    for (int frame = 0; frame < DEFORM_NB_FRAMES; ++frame) {
+        deform(full, teapot->mesh.vertices, first, count, frame);
+        dynamic_mesh_touch_faces(full, 0, mesh->nb_faces);
+        dynamic_mesh_refresh(full);
+        full->bounds = mesh_bounds(&full->model.mesh);
+    }
+    double full_ms = (now_ms() - t0) / DEFORM_NB_FRAMES;
+
+    size_t nb_faces = 0;
+    t0 = now_ms();
+    for (int frame = 0; frame < DEFORM_NB_FRAMES; ++frame) {
+        deform(incremental, teapot->mesh.vertices, first, count, frame);
+        nb_faces += dynamic_mesh_refresh(incremental);
+    }
+    double incremental_ms = (now_ms() - t0) / DEFORM_NB_FRAMES;
+
+    size_t nb_different = memcmp(&full->bounds, &incremental->bounds, sizeof(aabb_t)) != 0;
+    for (size_t i = 0; i < mesh->nb_faces; ++i) {
+        nb_different += memcmp(&full->face_normals[i], &incremental->face_normals[i], sizeof(vec3d)) != 0;
+        for (int j = 0; j < 3; ++j)
+            nb_different += memcmp(&full->lit_model.mesh.colors[3 * i + j],
+                                   &incremental->lit_model.mesh.colors[3 * i + j], sizeof(vec3d)) != 0;
+    }
+    for (size_t i = 0; i < mesh->nb_vertices; ++i)
+        nb_different += memcmp(&full->model.mesh.normals[i], &incremental->model.mesh.normals[i], sizeof(vec3d)) != 0;
+
+    printf("  full refresh:        %7.3f ms/frame\n", full_ms);
+    printf("  incremental refresh: %7.3f ms/frame (%.2fx), %zu faces/frame, %zu derived values differ\n",
+           incremental_ms, full_ms / incremental_ms, nb_faces / DEFORM_NB_FRAMES, nb_different);
+
+    // the baked lighting matches the Gouraud shading of draw_model
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    mat4x4 mat_view = matrix_make_identity();
+    mat4x4 mat_world = matrix_make_translation(FX(0.0f), FX(0.0f), FX(4.0f));
+    mat_world = matrix_multiply_matrix(&mat_normal, &mat_world);
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    clear_frame();
+    draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, &incremental->model, &mat_world, &mat_normal, &mat_proj,
+               &mat_view, &g_light, 1, false, NULL, false, false, 0, 0, true);
+    memcpy(reference, g_framebuffer, sizeof(reference));
+    clear_frame();
+    draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, &incremental->lit_model, &mat_world, NULL, &mat_proj,
+               &mat_view, NULL, 0, false, NULL, false, false, 0, 0, true);
+    printf("  baked lighting:      %zu pixels differ from Gouraud shading\n",
+           count_different_pixels(reference, g_framebuffer));
+
+    dynamic_mesh_free(incremental);
+    dynamic_mesh_free(full);
+}
+
+//
+// Dynamic resolution: frames of a scene whose load spikes, rendered at the resolution chosen by the controller. The
+// target leaves some headroom to the scene at full resolution. The teapot first comes close to the camera, which mostly
+// costs pixels, then 4 teapots are drawn, which mostly costs geometry.
+//
+
+#define RESOLUTION_NB_FRAMES 80
+#define RESOLUTION_PHASE_FRAMES 20
+
+static const char* g_resolution_phases[] = {"far", "close", "4 teapots", "far again"};
+
+static void draw_resolution_scene(int width, int height, model_t* model, int phase) {
+    mat4x4 mat_proj = matrix_make_projection(width, height, 60.0f);
+    mat4x4 mat_view = matrix_make_identity();
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    texture_t texture = {256, 2048, NULL};
+
+    clear_frame();
+    int nb_instances = phase == 2 ? 4 : 1;
+    float z = phase == 1 ? 1.5f : 3.0f;
+    for (int i = 0; i < nb_instances; ++i) {
+        mat4x4 mat_normal = matrix_make_rotation_x(0.5f + 0.3f * i);
+        mat4x4 mat_trans = matrix_make_translation(FX(0.3f * (i % 3 - 1)), FX(0.0f), FX(z + 0.1f * i));
+        mat4x4 mat_world = matrix_multiply_matrix(&mat_normal, &mat_trans);
+        draw_model(width, height, &vec_camera, model, &mat_world, &mat_normal, &mat_proj, &mat_view, &g_light, 1,
+                   false, &texture, false, false, 0, 0, true);
+    }
+}
+
+static void bench_dynamic_resolution() {
+    model_t* teapot = load_teapot();
+    sw_target_t full_target = sw_set_target_barycentric((sw_target_t){0});
+    sw_set_target_barycentric(full_target);
+
+    // the target is 1.25x the fastest frame of the far teapot at full resolution
+    double best_ms = 1e9;
+    for (int i = 0; i < 8; ++i) {
+        double t0 = now_ms();
+        draw_resolution_scene(SCREEN_WIDTH, SCREEN_HEIGHT, teapot, 0);
+        double frame_ms = now_ms() - t0;
+        if (frame_ms < best_ms) best_ms = frame_ms;
+    }
+    float target_ms = (float)(1.25 * best_ms);
+
+    printf("dynamic resolution: %d frames per phase, target %.2f ms\n", RESOLUTION_PHASE_FRAMES, target_ms);
+
+    dynamic_resolution_t dr;
+    dynamic_resolution_init(&dr, SCREEN_WIDTH, SCREEN_HEIGHT, 0.5f, target_ms);
+    static uint16_t screen[SCREEN_WIDTH * SCREEN_HEIGHT];
+    double upscale_ms = 0.0;
+    int nb_upscales = 0, nb_over_target = 0, nb_over_target_fixed = 0;
+    float phase_ms = 0.0f, phase_fixed_ms = 0.0f, phase_scale = 0.0f;
+    int phase_over_target = 0, phase_over_target_fixed = 0;
+    for (int frame = 0; frame < RESOLUTION_NB_FRAMES; ++frame) {
+        int phase = frame / RESOLUTION_PHASE_FRAMES;
+
+        // same frame at full resolution for reference
+        double t0 = now_ms();
+        draw_resolution_scene(SCREEN_WIDTH, SCREEN_HEIGHT, teapot, phase);
+        float fixed_ms = (float)(now_ms() - t0);
+        phase_over_target_fixed += fixed_ms > target_ms;
+
+        sw_target_t target = full_target;
+        target.fb_width = dr.width;
+        target.fb_height = dr.height;
+        sw_set_target_barycentric(target);
+        int width = dr.width, height = dr.height;
+        t0 = now_ms();
+        draw_resolution_scene(width, height, teapot, phase);
+        float frame_ms = (float)(now_ms() - t0);
+        sw_set_target_barycentric(full_target);
+        phase_over_target += frame_ms > target_ms;
+        dynamic_resolution_update(&dr, frame_ms);
+
+        if (width != SCREEN_WIDTH || height != SCREEN_HEIGHT) {
+            t0 = now_ms();
+            dynamic_resolution_upscale(g_framebuffer, width, height, SCREEN_WIDTH, screen, SCREEN_WIDTH,
+                                       SCREEN_HEIGHT, SCREEN_WIDTH);
+            upscale_ms += now_ms() - t0;
+            nb_upscales++;
+        }
+
+        phase_ms += frame_ms;
+        phase_fixed_ms += fixed_ms;
+        phase_scale += (float)width / SCREEN_WIDTH;
+        if (frame % RESOLUTION_PHASE_FRAMES == RESOLUTION_PHASE_FRAMES - 1) {
+            printf("  %-9s %5.2f ms, %2d over the target at full resolution, %5.2f ms, %2d over at %.2fx the "
+                   "resolution\n",
+                   g_resolution_phases[phase], phase_fixed_ms / RESOLUTION_PHASE_FRAMES, phase_over_target_fixed,
+                   phase_ms / RESOLUTION_PHASE_FRAMES, phase_over_target, phase_scale / RESOLUTION_PHASE_FRAMES);
+            nb_over_target_fixed += phase_over_target_fixed;
+            nb_over_target += phase_over_target;
+            phase_ms = phase_fixed_ms = phase_scale = 0.0f;
+            phase_over_target = phase_over_target_fixed = 0;
+        }
+    }
+
+    printf("  frames over the target: %d at full resolution, %d with dynamic resolution\n", nb_over_target_fixed,
+           nb_over_target);
+    if (nb_upscales > 0) printf("  upscale: %.3f ms/frame\n", upscale_ms / nb_upscales);
+}
+
+//
+// Rasterizers: triangles of different shapes, then a scene of small and large thin triangles, drawn with each
+// rasterizer
+//
+
+#define NB_SHAPES 8
+#define SHAPE_NB_TRIANGLES 500
+#define SHAPE_NB_RUNS 8
+
+// x, y of the vertices, relative to a random position on the screen, in the winding of the front faces: the
+// barycentric rasterizer culls the other one
+static const int g_shapes[NB_SHAPES][6] = {
+    {0, 0, 0, 2, 2, 0},         // tiny
+    {0, 0, 0, 16, 16, 0},       // medium
+    {0, 0, 0, 120, 120, 0},     // large
+    {0, 0, 20, 30, 40, 8},      // medium, oblique
+    {0, 0, 100, 200, 103, 200}, // sliver
+    {0, 0, 2, 200, 4, 0},       // tall thin
+    {0, 0, 0, 4, 200, 0},       // wide flat
+    {0, 0, 0, 24, 200, 20},     // wide thin
+};
+
+static void draw_shape(const int* shape, int ox, int oy) {
+    vec3d p[3];
+    vec2d t[3];
+    vec3d c[3];
+    for (int i = 0; i < 3; ++i) {
+        p[i] = (vec3d){FXI(ox + shape[2 * i]), FXI(oy + shape[2 * i + 1]), FX(0.0f), FX(1.0f)};
+        t[i] = (vec2d){FX(0.25f * i), FX(0.5f), FX(0.5f)};
+        c[i] = (vec3d){FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+    }
+    xd_draw_triangle(p, t, c, &(texture_t){256, 2048, NULL}, false, false, 0, 0, true, true, false);
+}
+
+// time per triangle of a shape in ps
+static double time_shape(const int* shape) {
+    int w = 0, h = 0;
+    for (int i = 0; i < 3; ++i) {
+        if (shape[2 * i] > w) w = shape[2 * i];
+        if (shape[2 * i + 1] > h) h = shape[2 * i + 1];
+    }
+    // fastest of a few runs, less sensitive to the load of the machine
+    double best_ms = 1e9;
+    for (int run = 0; run < SHAPE_NB_RUNS; ++run) {
+        srand(1);
+        clear_frame();
+        double t0 = now_ms();
+        for (int i = 0; i < SHAPE_NB_TRIANGLES; ++i)
+            draw_shape(shape, rand() % (SCREEN_WIDTH - w), rand() % (SCREEN_HEIGHT - h));
+        double run_ms = now_ms() - t0;
+        if (run_ms < best_ms) best_ms = run_ms;
+    }
+    return best_ms * 1e9 / SHAPE_NB_TRIANGLES;
+}
+
+static void draw_rasterizer_scene(model_t* model) {
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    mat4x4 mat_view = matrix_make_identity();
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    texture_t texture = {256, 2048, NULL};
+
+    clear_frame();
+
+    // a ring of distant small models
+    for (int i = 0; i < 16; ++i) {
+        mat4x4 mat_normal = matrix_make_rotation_y(0.4f * i);
+        mat4x4 mat_trans =
+            matrix_make_translation(FX(2.0f * cosf(0.4f * i)), FX(1.0f * sinf(0.4f * i)), FX(6.0f));
+        mat4x4 mat_world = matrix_multiply_matrix(&mat_normal, &mat_trans);
+        draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, model, &mat_world, &mat_normal, &mat_proj, &mat_view,
+                   &g_light, 1, false, &texture, false, false, 0, 0, true);
+    }
+
+    // large thin triangles, e.g. wires or a floor seen at a grazing angle
+    srand(2);
+    for (int i = 0; i < 64; ++i) {
+        int shape[6] = {0, 0, 150 + rand() % 100, 100 + rand() % 100, 0, 0};
+        shape[4] = shape[2] + 2;
+        shape[5] = shape[3];
+        draw_shape(shape, rand() % (SCREEN_WIDTH - shape[4]), rand() % (SCREEN_HEIGHT - shape[5]));
+    }
+}
+
+static void bench_rasterizers() {
+    double times[2][NB_SHAPES];
+    bench_rasterizer_t rasterizers[2] = {BENCH_BARYCENTRIC, BENCH_STANDARD};
+    for (int r = 0; r < 2; ++r) {
+        g_rasterizer = rasterizers[r];
+        for (int k = 0; k < NB_SHAPES; ++k) times[r][k] = time_shape(g_shapes[k]);
+    }
+
+    printf("rasterizers: %d shapes of %d triangles, fastest of %d runs\n", NB_SHAPES, SHAPE_NB_TRIANGLES, SHAPE_NB_RUNS);
+    for (int k = 0; k < NB_SHAPES; ++k)
+        printf("  shape %d: %8.0f ps barycentric, %8.0f ps standard (%.2fx)\n", k, times[0][k], times[1][k],
+               times[0][k] / times[1][k]);
+
+    model_t* teapot = load_teapot();
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    const char* names[2] = {"barycentric", "standard"};
+    double scene_ms[2];
+    for (int r = BENCH_BARYCENTRIC; r <= BENCH_STANDARD; ++r) {
+        g_rasterizer = (bench_rasterizer_t)r;
+        // fastest frame, less sensitive to the load of the machine
+        scene_ms[r] = 1e9;
+        for (int frame = 0; frame < NB_FRAMES; ++frame) {
+            double t0 = now_ms();
+            draw_rasterizer_scene(teapot);
+            double frame_ms = now_ms() - t0;
+            if (frame_ms < scene_ms[r]) scene_ms[r] = frame_ms;
+        }
+        if (r == BENCH_BARYCENTRIC) memcpy(reference, g_framebuffer, sizeof(reference));
+
+        printf("  %-11s %7.2f ms/frame (%.2fx)", names[r], scene_ms[r], scene_ms[0] / scene_ms[r]);
+        if (r != BENCH_BARYCENTRIC)
+            printf(", %zu pixels differ from barycentric", count_different_pixels(reference, g_framebuffer));
+        printf("\n");
+    }
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+//
+// SIMD: fill rate of the barycentric rasterizer with the scalar and the AVX2 span shaders, on layers of screen-sized
+// triangles drawn back to front, where every fragment is shaded, and front to back, where most fail the depth test
+//
+
+#define FILL_NB_LAYERS 8
+
+static void draw_fill_layers(bool front_to_back) {
+    clear_frame();
+    for (int i = 0; i < FILL_NB_LAYERS; ++i) {
+        int layer = front_to_back ? FILL_NB_LAYERS - 1 - i : i;
+        fx32 w = FX(0.1f + 0.1f * layer);
+        vec3d c = {FX(1.0f), FX(0.5f + 0.05f * layer), FX(0.5f), FX(1.0f)};
+        vec3d p0[3] = {{FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)},
+                       {FX(0.0f), FXI(SCREEN_HEIGHT), FX(0.0f), FX(1.0f)},
+                       {FXI(SCREEN_WIDTH), FX(0.0f), FX(0.0f), FX(1.0f)}};
+        vec3d p1[3] = {{FXI(SCREEN_WIDTH), FX(0.0f), FX(0.0f), FX(1.0f)},
+                       {FX(0.0f), FXI(SCREEN_HEIGHT), FX(0.0f), FX(1.0f)},
+                       {FXI(SCREEN_WIDTH), FXI(SCREEN_HEIGHT), FX(0.0f), FX(1.0f)}};
+        vec2d t0[3] = {{FX(0.0f), FX(0.0f), w}, {FX(0.0f), MUL(FX(0.5f), w), w}, {MUL(FX(0.5f), w), FX(0.0f), w}};
+        vec2d t1[3] = {{MUL(FX(0.5f), w), FX(0.0f), w}, {FX(0.0f), MUL(FX(0.5f), w), w},
+                       {MUL(FX(0.5f), w), MUL(FX(0.5f), w), w}};
+        vec3d cc[3] = {c, c, c};
+        texture_t texture = {256, 2048, NULL};
+        xd_draw_triangle(p0, t0, cc, &texture, false, false, 0, 0, true, true, false);
+        xd_draw_triangle(p1, t1, cc, &texture, false, false, 0, 0, true, true, false);
+    }
+}
+
+static void bench_simd() {
+    const char* names[3] = {"scalar", "SSE2", "AVX2"};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    double pixels = (double)FILL_NB_LAYERS * SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    printf("simd: %d layers of %d x %d pixels\n", FILL_NB_LAYERS, SCREEN_WIDTH, SCREEN_HEIGHT);
+    for (int order = 0; order < 2; ++order) {
+        double scalar_ms = 0.0;
+        for (int i = SW_SIMD_NONE; i <= SW_SIMD_AVX2; ++i) {
+            // SSE2 shades with the scalar span shaders
+            if (i == SW_SIMD_SSE2) continue;
+            if (sw_set_simd((sw_simd_t)i) != (sw_simd_t)i) {
+                printf("  %-5s not supported\n", names[i]);
+                continue;
+            }
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_fill_layers(order == 1);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            if (i == SW_SIMD_NONE) {
+                scalar_ms = best_ms;
+                memcpy(reference, g_framebuffer, sizeof(reference));
+            }
+            printf("  %s, %-6s %7.2f ms/frame, %6.1f Mpixels/s (%.2fx), %zu pixels differ from scalar\n",
+                   order == 0 ? "back to front" : "front to back", names[i], best_ms, pixels / best_ms / 1000.0,
+                   scalar_ms / best_ms, count_different_pixels(reference, g_framebuffer));
+        }
+    }
+    sw_set_simd(SW_SIMD_AVX2);
+}
+
+//
+// Color buffer: the fill layers drawn by the rasterizers through the draw_pixel callback and straight into the color
+// buffer of their target, then the conversion of the frame to ARGB8888 for presentation with each instruction set
+//
+
+static void bench_color_buffer() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    const char* simd_names[3] = {"scalar", "SSE2", "AVX2"};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint32_t converted[SCREEN_WIDTH * SCREEN_HEIGHT], converted_reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    double pixels = (double)FILL_NB_LAYERS * SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    printf("color_buffer: %d layers of %d x %d pixels drawn back to front\n", FILL_NB_LAYERS, SCREEN_WIDTH,
+           SCREEN_HEIGHT);
+    for (int r = BENCH_BARYCENTRIC; r <= BENCH_STANDARD; ++r) {
+        g_rasterizer = (bench_rasterizer_t)r;
+        double callback_ms = 0.0;
+        for (int direct = 0; direct < 2; ++direct) {
+            sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+            sw_target_t previous = target;
+            if (direct) {
+                target.color_buffer = g_framebuffer;
+                target.color_pitch = SCREEN_WIDTH;
+            }
+            sw_set_target_barycentric(target);
+            sw_set_target_standard(target);
+
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_fill_layers(false);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            sw_set_target_barycentric(previous);
+            sw_set_target_standard(previous);
+
+            if (!direct) {
+                callback_ms = best_ms;
+                memcpy(reference, g_framebuffer, sizeof(reference));
+            }
+            printf("  %-11s %-12s %7.2f ms/frame, %6.1f Mpixels/s (%.2fx), %zu pixels differ from callback\n",
+                   rasterizer_names[r], direct ? "color buffer" : "callback", best_ms, pixels / best_ms / 1000.0,
+                   callback_ms / best_ms, count_different_pixels(reference, g_framebuffer));
+        }
+    }
+    g_rasterizer = BENCH_BARYCENTRIC;
+
+    double scalar_ms = 0.0;
+    for (int i = SW_SIMD_NONE; i <= SW_SIMD_AVX2; ++i) {
+        double best_ms = 1e9;
+        for (int frame = 0; frame < NB_FRAMES; ++frame) {
+            double t0 = now_ms();
+            sw_convert_rgb565_to_argb8888(g_framebuffer, SCREEN_WIDTH, converted, SCREEN_WIDTH, SCREEN_WIDTH,
+                                          SCREEN_HEIGHT, (sw_simd_t)i);
+            double frame_ms = now_ms() - t0;
+            if (frame_ms < best_ms) best_ms = frame_ms;
+        }
+        if (i == SW_SIMD_NONE) {
+            scalar_ms = best_ms;
+            memcpy(converted_reference, converted, sizeof(converted));
+        }
+        printf("  convert %-6s %7.3f ms/frame (%.2fx), %s\n", simd_names[i], best_ms, scalar_ms / best_ms,
+               memcmp(converted, converted_reference, sizeof(converted)) == 0 ? "same as scalar" : "DIFFERENT");
+    }
+}
+
+//
+// Perspective subdivision: a textured floor seen at an angle and a textured teapot, with the perspective corrected at
+// every pixel, then every 8, 16 and 32 pixels of the rows and interpolated in between. The error is the difference of
+// the RGB565 levels.
+//
+
+static void draw_persp_scene(model_t* model) {
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    mat4x4 mat_view = matrix_make_identity();
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    texture_t texture = {256, 2048, NULL};
+
+    clear_frame();
+
+    // the floor recedes to the top right, its texture repeats 4 times
+    fx32 w[4] = {FX(0.2f), FX(0.05f), FX(1.0f), FX(0.3f)};
+    vec3d p[4] = {{FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)},
+                  {FXI(SCREEN_WIDTH), FX(0.0f), FX(0.0f), FX(1.0f)},
+                  {FX(0.0f), FXI(SCREEN_HEIGHT), FX(0.0f), FX(1.0f)},
+                  {FXI(SCREEN_WIDTH), FXI(SCREEN_HEIGHT), FX(0.0f), FX(1.0f)}};
+    vec2d t[4] = {{FX(0.0f), FX(0.0f), w[0]},
+                  {MUL(FX(4.0f), w[1]), FX(0.0f), w[1]},
+                  {FX(0.0f), MUL(FX(0.5f), w[2]), w[2]},
+                  {MUL(FX(4.0f), w[3]), MUL(FX(0.5f), w[3]), w[3]}};
+    vec3d c[4] = {{MUL(FX(1.0f), w[0]), MUL(FX(0.8f), w[0]), MUL(FX(0.6f), w[0]), FX(1.0f)},
+                  {MUL(FX(0.6f), w[1]), MUL(FX(0.8f), w[1]), MUL(FX(1.0f), w[1]), FX(1.0f)},
+                  {MUL(FX(0.8f), w[2]), MUL(FX(1.0f), w[2]), MUL(FX(0.6f), w[2]), FX(1.0f)},
+                  {MUL(FX(1.0f), w[3]), MUL(FX(1.0f), w[3]), MUL(FX(1.0f), w[3]), FX(1.0f)}};
+    int triangles[2][3] = {{0, 2, 1}, {1, 2, 3}};
+    for (int i = 0; i < 2; ++i) {
+        vec3d tp[3], tc[3];
+        vec2d tt[3];
+        for (int j = 0; j < 3; ++j) {
+            tp[j] = p[triangles[i][j]];
+            tt[j] = t[triangles[i][j]];
+            tc[j] = c[triangles[i][j]];
+        }
+        xd_draw_triangle(tp, tt, tc, &texture, false, false, 0, 0, true, true, false);
+    }
+
+    mat4x4 mat_normal = matrix_make_rotation_y(0.6f);
+    mat4x4 mat_trans = matrix_make_translation(FX(0.0f), FX(0.0f), FX(2.0f));
+    mat4x4 mat_world = matrix_multiply_matrix(&mat_normal, &mat_trans);
+    draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, model, &mat_world, &mat_normal, &mat_proj, &mat_view, &g_light,
+               1, false, &texture, false, false, 0, 0, true);
+}
+
+// Sum of the absolute differences of the RGB565 levels, and their maximum
+static size_t color_error(uint16_t* a, uint16_t* b, int* max_error) {
+    size_t sum = 0;
+    *max_error = 0;
+    for (size_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+        int d[3] = {abs((a[i] >> 11) - (b[i] >> 11)), abs(((a[i] >> 5) & 0x3F) - ((b[i] >> 5) & 0x3F)),
+                    abs((a[i] & 0x1F) - (b[i] & 0x1F))};
+        for (int k = 0; k < 3; ++k) {
+            sum += d[k];
+            if (d[k] > *max_error) *max_error = d[k];
+        }
+    }
+    return sum;
+}
+
+static void bench_persp_subdivision() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    int subdivisions[4] = {0, 8, 16, 32};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    model_t* teapot = load_teapot();
+
+    sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+    sw_target_t previous = target;
+    target.color_buffer = g_framebuffer;
+    target.color_pitch = SCREEN_WIDTH;
+    sw_set_target_barycentric(target);
+    sw_set_target_standard(target);
+
+    // the subdivided spans are scalar, the AVX2 shader corrects every pixel
+    printf("persp_subdivision: textured floor and teapot, scalar spans\n");
+    for (int r = BENCH_BARYCENTRIC; r <= BENCH_STANDARD; ++r) {
+        g_rasterizer = (bench_rasterizer_t)r;
+        double per_pixel_ms = 0.0;
+        for (int i = -1; i < 4; ++i) {
+            sw_set_simd(i < 0 ? SW_SIMD_AVX2 : SW_SIMD_NONE);
+            sw_set_persp_subdivision(i < 0 ? 0 : subdivisions[i]);
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_persp_scene(teapot);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            if (i < 0) {
+                printf("  %-11s every pixel, AVX2 %7.2f ms/frame\n", rasterizer_names[r], best_ms);
+                continue;
+            }
+            if (i == 0) {
+                per_pixel_ms = best_ms;
+                memcpy(reference, g_framebuffer, sizeof(reference));
+                printf("  %-11s every pixel       %7.2f ms/frame (1.00x)\n", rasterizer_names[r], best_ms);
+                continue;
+            }
+            int max_error;
+            size_t error = color_error(reference, g_framebuffer, &max_error);
+            printf("  %-11s every %2d pixels   %7.2f ms/frame (%.2fx), %zu pixels differ, mean error %.4f, max error %d\n",
+                   rasterizer_names[r], subdivisions[i], best_ms, per_pixel_ms / best_ms,
+                   count_different_pixels(reference, g_framebuffer),
+                   (double)error / (3.0 * SCREEN_WIDTH * SCREEN_HEIGHT), max_error);
+        }
+    }
+    sw_set_persp_subdivision(0);
+    sw_set_simd(SW_SIMD_AVX2);
+    sw_set_target_barycentric(previous);
+    sw_set_target_standard(previous);
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+//
+// Texture binding: a grid of quads, each with its own texture of power-of-two sizes from 8 to 256 texels, repeated twice
+// across the quad. The texture is bound per draw, compared with the same grid drawn with a single texture.
+//
+
+#define NB_BOUND_TEXTURES 64
+#define TEXTURE_GRID_COLUMNS 16
+#define TEXTURE_GRID_ROWS 12
+
+static void draw_texture_grid(texture_t* textures, int nb_textures) {
+    int quad_width = SCREEN_WIDTH / TEXTURE_GRID_COLUMNS, quad_height = SCREEN_HEIGHT / TEXTURE_GRID_ROWS;
+    clear_frame();
+    for (int i = 0; i < TEXTURE_GRID_COLUMNS * TEXTURE_GRID_ROWS; ++i) {
+        int x = (i % TEXTURE_GRID_COLUMNS) * quad_width, y = (i / TEXTURE_GRID_COLUMNS) * quad_height;
+        vec3d p[4] = {{FXI(x), FXI(y), FX(0.0f), FX(1.0f)},
+                      {FXI(x + quad_width), FXI(y), FX(0.0f), FX(1.0f)},
+                      {FXI(x), FXI(y + quad_height), FX(0.0f), FX(1.0f)},
+                      {FXI(x + quad_width), FXI(y + quad_height), FX(0.0f), FX(1.0f)}};
+        vec2d t[4] = {{FX(0.0f), FX(0.0f), FX(1.0f)},
+                      {FX(2.0f), FX(0.0f), FX(1.0f)},
+                      {FX(0.0f), FX(2.0f), FX(1.0f)},
+                      {FX(2.0f), FX(2.0f), FX(1.0f)}};
+        vec3d c[3] = {{FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)},
+                      {FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)},
+                      {FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)}};
+        texture_t* texture = &textures[i % nb_textures];
+        xd_draw_triangle((vec3d[3]){p[0], p[2], p[1]}, (vec2d[3]){t[0], t[2], t[1]}, c, texture, false, false, 0, 0,
+                         true, false, false);
+        xd_draw_triangle((vec3d[3]){p[1], p[2], p[3]}, (vec2d[3]){t[1], t[2], t[3]}, c, texture, false, false, 0, 0,
+                         true, false, false);
+    }
+}
+
+static double time_texture_grid(texture_t* textures, int nb_textures) {
+    double best_ms = 1e9;
+    for (int frame = 0; frame < NB_FRAMES; ++frame) {
+        double t0 = now_ms();
+        draw_texture_grid(textures, nb_textures);
+        double frame_ms = now_ms() - t0;
+        if (frame_ms < best_ms) best_ms = frame_ms;
+    }
+    return best_ms;
+}
+
+static void bench_texture_binding() {
+    texture_t textures[NB_BOUND_TEXTURES];
+    size_t nb_texels = 0;
+    srand(3);
+    for (int i = 0; i < NB_BOUND_TEXTURES; ++i) {
+        textures[i].width = (size_t)8 << (rand() % 6);
+        textures[i].height = (size_t)8 << (rand() % 6);
+        uint16_t* texels = (uint16_t*)malloc(textures[i].width * textures[i].height * sizeof(uint16_t));
+        // opaque checkerboard of two random colors
+        uint16_t colors[2] = {(uint16_t)(0xF000 | (rand() & 0xFFF)), (uint16_t)(0xF000 | (rand() & 0xFFF))};
+        for (size_t y = 0; y < textures[i].height; ++y)
+            for (size_t x = 0; x < textures[i].width; ++x)
+                texels[y * textures[i].width + x] = colors[((x >> 2) ^ (y >> 2)) & 1];
+        textures[i].data = (unsigned char*)texels;
+        nb_texels += textures[i].width * textures[i].height;
+    }
+
+    int nb_quads = TEXTURE_GRID_COLUMNS * TEXTURE_GRID_ROWS;
+    printf("texture_binding: %d quads, %d textures of %zu KiB\n", nb_quads, NB_BOUND_TEXTURES,
+           nb_texels * sizeof(uint16_t) / 1024);
+    double single_ms = time_texture_grid(textures, 1);
+    printf("  1 texture            %7.3f ms/frame\n", single_ms);
+    double many_ms = time_texture_grid(textures, NB_BOUND_TEXTURES);
+    printf("  %d textures          %7.3f ms/frame (%.2fx), %d binds/frame\n", NB_BOUND_TEXTURES, many_ms,
+           single_ms / many_ms, 2 * nb_quads);
+
+    texture_t invalid = {100, 64, textures[0].data};
+    printf("  binding a 100x64 texture: %s\n", sw_bind_texture(&invalid) ? "accepted" : "rejected");
+
+    sw_bind_texture(NULL);
+    for (int i = 0; i < NB_BOUND_TEXTURES; ++i) free(textures[i].data);
+}
+
+//
+// Mipmapping: a field of small cubes textured with the full 256x2048 texture, sampled at the base level, then at the
+// mip level of each triangle. The texel cache misses are counted in another pass by the scalar shaders.
+//
+
+#define NB_MINIFIED_CUBES_X 10
+#define NB_MINIFIED_CUBES_Z 6
+
+static void draw_minified_scene(model_t* cube, float angle) {
+    mat4x4 mat_proj = matrix_make_projection(SCREEN_WIDTH, SCREEN_HEIGHT, 60.0f);
+    mat4x4 mat_view = matrix_make_identity();
+    vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
+    texture_t texture = {256, 2048, NULL};
+
+    clear_frame();
+    for (int i = 0; i < NB_MINIFIED_CUBES_X * NB_MINIFIED_CUBES_Z; ++i) {
+        int column = i % NB_MINIFIED_CUBES_X, row = i / NB_MINIFIED_CUBES_X;
+        mat4x4 mat_rot_y = matrix_make_rotation_y(angle + 0.3f * i);
+        mat4x4 mat_rot_x = matrix_make_rotation_x(0.5f * angle + 0.2f * i);
+        mat4x4 mat_normal = matrix_multiply_matrix(&mat_rot_y, &mat_rot_x);
+        mat4x4 mat_scale = matrix_make_scale(FX(0.4f), FX(0.4f), FX(0.4f));
+        mat4x4 mat_trans = matrix_make_translation(FX(-2.5f + 0.5f * column + 0.25f * (row & 1)),
+                                                   FX(-1.0f + 0.3f * row), FX(3.0f + 0.5f * row));
+        mat4x4 mat_world = matrix_multiply_matrix(&mat_normal, &mat_scale);
+        mat_world = matrix_multiply_matrix(&mat_world, &mat_trans);
+        draw_model(SCREEN_WIDTH, SCREEN_HEIGHT, &vec_camera, cube, &mat_world, &mat_normal, &mat_proj, &mat_view,
+                   &g_light, 1, false, &texture, false, false, 0, 0, true);
+    }
+}
+
+static void bench_mipmapping() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    model_t* cube = load_cube();
+    sw_upload_texture(NULL, SW_TEXTURE_LINEAR, true);
+
+    printf("mipmapping: %d cubes with the 256x2048 texture\n", NB_MINIFIED_CUBES_X * NB_MINIFIED_CUBES_Z);
+    for (int r = BENCH_BARYCENTRIC; r <= BENCH_STANDARD; ++r) {
+        g_rasterizer = (bench_rasterizer_t)r;
+        double base_ms = 0.0;
+        for (int mipmapping = 0; mipmapping < 2; ++mipmapping) {
+            sw_set_mipmapping(mipmapping);
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_minified_scene(cube, 0.05f * frame);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            if (!mipmapping) base_ms = best_ms;
+            sw_set_texture_cache_stats(true);
+            sw_get_texture_cache_stats(true);
+            for (int frame = 0; frame < NB_FRAMES; ++frame) draw_minified_scene(cube, 0.05f * frame);
+            sw_texture_cache_stats_t stats = sw_get_texture_cache_stats(true);
+            sw_set_texture_cache_stats(false);
+            printf("  %-11s %-10s %7.3f ms/frame (%.2fx), %zu fetches, %.2f%% misses in %d KiB\n", rasterizer_names[r],
+                   mipmapping ? "mipmapped" : "base level", best_ms, base_ms / best_ms, stats.fetches / NB_FRAMES,
+                   stats.fetches ? 100.0 * stats.misses / stats.fetches : 0.0, SW_TEXTURE_CACHE_SIZE / 1024);
+        }
+    }
+    sw_set_mipmapping(false);
+    sw_free_texture(NULL);
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+//
+// Texture layout: a square rotated at 0, 45 and 90 degrees, sampling 256x512 texels of the default texture, 2 texels
+// per pixel, with the texture uploaded linear then in tiles. The rows of the square cross the rows of the texture
+// when rotated. The texel cache misses and the DRAM row switches are counted in another frame by the scalar shaders.
+//
+
+static const int g_layout_angles[] = {0, 45, 90};
+
+static void draw_rotated_square(int angle) {
+    float c = cosf(angle * 3.14159265f / 180.0f), s = sinf(angle * 3.14159265f / 180.0f);
+    float corners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {-1.0f, 1.0f}, {1.0f, 1.0f}};
+    vec3d p[4];
+    vec2d t[4];
+    for (int i = 0; i < 4; ++i) {
+        float x = 128.0f * corners[i][0], y = 128.0f * corners[i][1];
+        p[i] = (vec3d){FX(SCREEN_WIDTH / 2 + c * x - s * y), FX(SCREEN_HEIGHT / 2 + s * x + c * y), FX(0.0f),
+                       FX(1.0f)};
+        t[i] = (vec2d){FX(0.5f + 0.5f * corners[i][0]), FX(0.125f + 0.125f * corners[i][1]), FX(1.0f)};
+    }
+    vec3d color = {FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+    vec3d c3[3] = {color, color, color};
+    texture_t texture = {256, 2048, NULL};
+    clear_frame();
+    xd_draw_triangle((vec3d[3]){p[0], p[2], p[1]}, (vec2d[3]){t[0], t[2], t[1]}, c3, &texture, false, false, 0, 0,
+                     true, false, false);
+    xd_draw_triangle((vec3d[3]){p[1], p[2], p[3]}, (vec2d[3]){t[1], t[2], t[3]}, c3, &texture, false, false, 0, 0,
+                     true, false, false);
+}
+
+static void bench_texture_layout() {
+    const char* layout_names[2] = {"linear", "tiled"};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    printf("texture_layout: square of 256x512 texels, 2 texels per pixel\n");
+    for (size_t k = 0; k < sizeof(g_layout_angles) / sizeof(g_layout_angles[0]); ++k) {
+        double linear_ms = 0.0;
+        for (int layout = SW_TEXTURE_LINEAR; layout <= SW_TEXTURE_TILED; ++layout) {
+            sw_upload_texture(NULL, (sw_texture_layout_t)layout, false);
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_rotated_square(g_layout_angles[k]);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            if (layout == SW_TEXTURE_LINEAR) {
+                linear_ms = best_ms;
+                memcpy(reference, g_framebuffer, sizeof(reference));
+            }
+            bool same = memcmp(reference, g_framebuffer, sizeof(reference)) == 0;
+            sw_set_texture_cache_stats(true);
+            sw_get_texture_cache_stats(true);
+            draw_rotated_square(g_layout_angles[k]);
+            sw_texture_cache_stats_t stats = sw_get_texture_cache_stats(true);
+            sw_set_texture_cache_stats(false);
+            printf("  %2d degrees %-6s %7.3f ms/frame (%.2fx), %s, %zu fetches, %.2f%% misses in %d KiB, %.2f%% row "
+                   "switches\n",
+                   g_layout_angles[k], layout_names[layout], best_ms, linear_ms / best_ms,
+                   same ? "same as linear" : "DIFFERENT", stats.fetches,
+                   stats.fetches ? 100.0 * stats.misses / stats.fetches : 0.0, SW_TEXTURE_CACHE_SIZE / 1024,
+                   stats.fetches ? 100.0 * stats.row_switches / stats.fetches : 0.0);
+        }
+    }
+    sw_free_texture(NULL);
+}
+
+//
+// Texture compression: the rotated squares of the texture layout, with the texture uploaded in tiles then compressed
+// in blocks of 4x4 texels, and the error of the compression of the textures. The texel cache misses are counted in
+// another frame by the scalar shaders.
+//
+
+extern uint16_t tex32x32[];
+extern uint16_t tex32x64[];
+extern uint16_t tex256x2048[];
+
+static void print_compression_error(const char* name, const uint16_t* texels, int width, int height) {
+    uint16_t* blocks = (uint16_t*)malloc(block_texture_size(width, height) * sizeof(uint16_t));
+    block_texture_encode(texels, width, height, blocks);
+    int nb_different = 0, max_error = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            uint16_t texel = texels[y * width + x];
+            uint16_t decoded =
+                block_texture_texel(&blocks[((y / 4) * (width / 4) + x / 4) * BLOCK_TEXTURE_WORDS], x & 3, y & 3);
+            if (decoded != texel) nb_different++;
+            for (int shift = 0; shift < 12; shift += 4) {
+                int error = abs(((texel >> shift) & 0xF) - ((decoded >> shift) & 0xF));
+                if (error > max_error) max_error = error;
+            }
+        }
+    printf("  %-12s %7zu -> %6zu bytes, %6.2f%% texels differ, max error %d/15\n", name,
+           (size_t)width * height * sizeof(uint16_t), block_texture_size(width, height) * sizeof(uint16_t),
+           100.0 * nb_different / (width * height), max_error);
+    free(blocks);
+}
+
+static void bench_texture_compression() {
+    const char* layout_names[2] = {"tiled", "compressed"};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    printf("texture_compression: square of 256x512 texels, 2 texels per pixel\n");
+    print_compression_error("tex256x2048", tex256x2048, 256, 2048);
+    print_compression_error("tex32x64", tex32x64, 32, 64);
+    print_compression_error("tex32x32", tex32x32, 32, 32);
+    for (size_t k = 0; k < sizeof(g_layout_angles) / sizeof(g_layout_angles[0]); ++k) {
+        double tiled_ms = 0.0;
+        for (int layout = SW_TEXTURE_TILED; layout <= SW_TEXTURE_COMPRESSED; ++layout) {
+            sw_upload_texture(NULL, (sw_texture_layout_t)layout, false);
+            double best_ms = 1e9;
+            for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                double t0 = now_ms();
+                draw_rotated_square(g_layout_angles[k]);
+                double frame_ms = now_ms() - t0;
+                if (frame_ms < best_ms) best_ms = frame_ms;
+            }
+            if (layout == SW_TEXTURE_TILED) {
+                tiled_ms = best_ms;
+                memcpy(reference, g_framebuffer, sizeof(reference));
+            }
+            bool same = memcmp(reference, g_framebuffer, sizeof(reference)) == 0;
+            sw_set_texture_cache_stats(true);
+            sw_get_texture_cache_stats(true);
+            draw_rotated_square(g_layout_angles[k]);
+            sw_texture_cache_stats_t stats = sw_get_texture_cache_stats(true);
+            sw_set_texture_cache_stats(false);
+            // lines of 64 bytes
+            printf("  %2d degrees %-10s %7.3f ms/frame (%.2fx), %s, %zu fetches, %.2f%% misses in %d KiB, %zu KiB "
+                   "fetched\n",
+                   g_layout_angles[k], layout_names[layout - SW_TEXTURE_TILED], best_ms, tiled_ms / best_ms,
+                   same ? "same as tiled" : "different", stats.fetches,
+                   stats.fetches ? 100.0 * stats.misses / stats.fetches : 0.0, SW_TEXTURE_CACHE_SIZE / 1024,
+                   stats.misses * 64 / 1024);
+        }
+    }
+    sw_free_texture(NULL);
+}
+
+//
+// Texel decode: a textured quad covering the screen, with a color modulating the texels, so that every pixel decodes
+// a texel. Reported per pixel, with the channels looked up in their table and divided like before it, by the scalar
+// span shaders since the AVX2 ones do not divide.
+//
+
+static void draw_textured_quad(bool perspective_correct) {
+    float corners[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}};
+    vec3d p[4];
+    vec2d t[4];
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (vec3d){FX(SCREEN_WIDTH * corners[i][0]), FX(SCREEN_HEIGHT * corners[i][1]), FX(0.0f), FX(1.0f)};
+        t[i] = (vec2d){FX(corners[i][0]), FX(0.125f * corners[i][1]), FX(1.0f)};
+    }
+    vec3d c3[3] = {{FX(1.0f), FX(0.5f), FX(0.25f), FX(1.0f)},
+                   {FX(0.25f), FX(1.0f), FX(0.5f), FX(1.0f)},
+                   {FX(0.5f), FX(0.25f), FX(1.0f), FX(1.0f)}};
+    texture_t texture = {256, 2048, NULL};
+    clear_frame();
+    xd_draw_triangle((vec3d[3]){p[0], p[2], p[1]}, (vec2d[3]){t[0], t[2], t[1]}, c3, &texture, false, false, 0, 0,
+                     false, perspective_correct, false);
+    xd_draw_triangle((vec3d[3]){p[1], p[2], p[3]}, (vec2d[3]){t[1], t[2], t[3]}, c3, &texture, false, false, 0, 0,
+                     false, perspective_correct, false);
+}
+
+static void bench_texel_decode() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    const bench_rasterizer_t rasterizers[2] = {BENCH_BARYCENTRIC, BENCH_STANDARD};
+
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    printf("texel_decode: textured quad of %dx%d pixels, modulated, scalar\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    sw_set_simd(SW_SIMD_NONE);
+    for (int i = 0; i < 2; ++i) {
+        g_rasterizer = rasterizers[i];
+        for (int perspective_correct = 0; perspective_correct < 2; ++perspective_correct) {
+            double best_ms[2];
+            for (int divisions = 0; divisions < 2; ++divisions) {
+                sw_set_texel_divisions(divisions);
+                best_ms[divisions] = 1e9;
+                for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                    double t0 = now_ms();
+                    draw_textured_quad(perspective_correct);
+                    double frame_ms = now_ms() - t0;
+                    if (frame_ms < best_ms[divisions]) best_ms[divisions] = frame_ms;
+                }
+                if (!divisions) memcpy(reference, g_framebuffer, sizeof(reference));
+            }
+            sw_set_texel_divisions(false);
+            double pixels = SCREEN_WIDTH * SCREEN_HEIGHT;
+            printf("  %-11s %-11s %5.2f ns/pixel table, %5.2f ns/pixel divisions (%.2fx), %zu pixels differ\n",
+                   rasterizer_names[i], perspective_correct ? "perspective" : "affine", best_ms[0] * 1e6 / pixels,
+                   best_ms[1] * 1e6 / pixels, best_ms[1] / best_ms[0], count_different_pixels(reference, g_framebuffer));
+        }
+    }
+    sw_set_simd(SW_SIMD_AVX2);
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+//
+// Depth tiles: the fill layers drawn by the rasterizers without and with the depth tiles, front to back, where the
+// layers behind the first one are skipped, and back to front, where the tiles only add their upkeep
+//
+
+static void bench_depth_tiles() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    const bench_rasterizer_t rasterizers[2] = {BENCH_BARYCENTRIC, BENCH_STANDARD};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    printf("depth_tiles: %d layers of %d x %d pixels, tiles of %d x %d pixels\n", FILL_NB_LAYERS, SCREEN_WIDTH,
+           SCREEN_HEIGHT, 1 << SW_DEPTH_TILE_SIZE_LOG2, 1 << SW_DEPTH_TILE_SIZE_LOG2);
+    sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+    sw_set_target_barycentric(target);
+    for (int i = 0; i < 2; ++i) {
+        g_rasterizer = rasterizers[i];
+        for (int order = 0; order < 2; ++order) {
+            double untiled_ms = 0.0;
+            for (int tiled = 0; tiled < 2; ++tiled) {
+                sw_target_t layers_target = target;
+                if (!tiled) layers_target.depth_tiles = NULL;
+                sw_set_target_barycentric(layers_target);
+                sw_set_target_standard(layers_target);
+                double best_ms = 1e9;
+                for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                    double t0 = now_ms();
+                    draw_fill_layers(order == 1);
+                    double frame_ms = now_ms() - t0;
+                    if (frame_ms < best_ms) best_ms = frame_ms;
+                }
+                if (!tiled) {
+                    untiled_ms = best_ms;
+                    memcpy(reference, g_framebuffer, sizeof(reference));
+                }
+                printf("  %-11s %s, %-8s %7.2f ms/frame (%.2fx), %zu pixels differ\n", rasterizer_names[i],
+                       order == 0 ? "back to front" : "front to back", tiled ? "tiles" : "no tiles", best_ms,
+                       untiled_ms / best_ms, count_different_pixels(reference, g_framebuffer));
+            }
+        }
+    }
+    sw_set_target_barycentric(target);
+    sw_set_target_standard(target);
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+//
+// 16-bit depth buffer: the fill layers drawn by the rasterizers with the fx32 depth buffer, without its depth tiles,
+// then with a 16-bit depth buffer. The depths of the layers are under 4, they are the same in both.
+//
+
+static void bench_depth_buffer16() {
+    const char* rasterizer_names[2] = {"barycentric", "standard"};
+    const bench_rasterizer_t rasterizers[2] = {BENCH_BARYCENTRIC, BENCH_STANDARD};
+    static uint16_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static uint16_t depth_buffer16[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    printf("depth_buffer16: %d layers of %d x %d pixels, depth buffer of %zu KiB or %zu KiB\n", FILL_NB_LAYERS,
+           SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(fx32) / 1024,
+           sizeof(depth_buffer16) / 1024);
+    sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+    sw_set_target_barycentric(target);
+    for (int i = 0; i < 2; ++i) {
+        g_rasterizer = rasterizers[i];
+        for (int order = 0; order < 2; ++order) {
+            double fx32_ms = 0.0;
+            for (int depth16 = 0; depth16 < 2; ++depth16) {
+                sw_target_t layers_target = target;
+                layers_target.depth_tiles = NULL;
+                if (depth16) layers_target.depth_buffer16 = depth_buffer16;
+                sw_set_target_barycentric(layers_target);
+                sw_set_target_standard(layers_target);
+                double best_ms = 1e9;
+                for (int frame = 0; frame < NB_FRAMES; ++frame) {
+                    double t0 = now_ms();
+                    draw_fill_layers(order == 1);
+                    double frame_ms = now_ms() - t0;
+                    if (frame_ms < best_ms) best_ms = frame_ms;
+                }
+                if (!depth16) {
+                    fx32_ms = best_ms;
+                    memcpy(reference, g_framebuffer, sizeof(reference));
+                }
+                printf("  %-11s %s, %-6s %7.2f ms/frame (%.2fx), %zu pixels differ\n", rasterizer_names[i],
+                       order == 0 ? "back to front" : "front to back", depth16 ? "16-bit" : "fx32", best_ms,
+                       fx32_ms / best_ms, count_different_pixels(reference, g_framebuffer));
+            }
+        }
+    }
+    sw_set_target_barycentric(target);
+    sw_set_target_standard(target);
+    g_rasterizer = BENCH_BARYCENTRIC;
+}
+
+typedef struct {
+    const char* name;
+    void (*fn)();
+} benchmark_t;
+
+static const benchmark_t g_benchmarks[] = {
+    {"static_batching", bench_static_batching},
+    {"scene_grid", bench_scene_grid},
+    {"transform_hierarchy", bench_transform_hierarchy},
+    {"impostors", bench_impostors},
+    {"dynamic_mesh", bench_dynamic_mesh},
+    {"dynamic_resolution", bench_dynamic_resolution},
+    {"rasterizers", bench_rasterizers},
+    {"simd", bench_simd},
+    {"color_buffer", bench_color_buffer},
+    {"persp_subdivision", bench_persp_subdivision},
+    {"texture_binding", bench_texture_binding},
+    {"mipmapping", bench_mipmapping},
+    {"texture_layout", bench_texture_layout},
+    {"texture_compression", bench_texture_compression},
+    {"texel_decode", bench_texel_decode},
+    {"depth_tiles", bench_depth_tiles},
+    {"depth_buffer16", bench_depth_buffer16},
+};
+
+int main(int argc, char* argv[]) {
+    sw_init_rasterizer_barycentric(SCREEN_WIDTH, SCREEN_HEIGHT, draw_pixel, false);
+
+    // the standard rasterizer shares the target of the barycentric one
+    sw_init_rasterizer_standard(SCREEN_WIDTH, SCREEN_HEIGHT, draw_pixel, false);
+    sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+    sw_set_target_barycentric(target);
+    sw_target_t standard_target = sw_set_target_standard(target);
+
+    for (size_t i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); ++i) {
+        bool selected = argc < 2;
+        for (int j = 1; j < argc; ++j)
+            if (strcmp(argv[j], g_benchmarks[i].name) == 0) selected = true;
+        if (selected) g_benchmarks[i].fn();
+    }
+
+    sw_set_target_standard(standard_target);
+    sw_dispose_rasterizer_standard();
+    sw_dispose_rasterizer_barycentric();
+
+    return 0;
+}
@@ -4,8 +4,13 @@
 
 #include <SDL.h>
 #include <cube.h>
+#include <dynamic_resolution.h>
+#include <frame_state.h>
+#include <mesh_stream.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <teapot.h>
+#include <transform.h>
 
 #include "sw_rasterizer.h"
 
@@ -13,39 +18,72 @@ static int screen_width = 320;
 static int screen_height = 240;
 static int screen_scale = 3;
 
-static SDL_Renderer* renderer;
-
-bool g_rasterizer_barycentric = true;
-
-void draw_pixel(int x, int y, int color) {
+// delay of an unchanged frame, which is not rendered again
+#define SKIPPED_FRAME_DELAY_MS 10
 
-    // Constants taken from https://stackoverflow.com/a/9069480
+// render time of a frame targeted by the dynamic resolution, and the smallest scale of the resolution
+#ifndef DYNAMIC_RESOLUTION_TARGET_MS
+#define DYNAMIC_RESOLUTION_TARGET_MS 16.0f
+#endif
+#ifndef DYNAMIC_RESOLUTION_MIN_SCALE
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#endif
 
-    int r5 = color >> 11;
-    int g6 = (color >> 5) & 0x3F;
-    int b5 = color & 0x1F;
+// 16-bit depth buffer quantized like the hardware, instead of fx32
+#ifndef DEPTH_BUFFER16
+#define DEPTH_BUFFER16 0
+#endif
 
-    int r = (r5 * 527 + 23) >> 6;
-    int g = (g6 * 259 + 33) >> 6;
-    int b = (b5 * 527 + 23) >> 6;
+static SDL_Renderer* renderer;
 
-    SDL_SetRenderDrawColor(renderer, r, g, b, SDL_ALPHA_OPAQUE);
-    SDL_RenderDrawPoint(renderer, x, y);
+// RGB565 frame at the render resolution written by the rasterizers, upscaled to the screen resolution and converted
+// to ARGB8888 once per frame when presented
+static uint16_t render_buffer[320 * 240];
+static uint16_t upscaled_buffer[320 * 240];
+static int render_width = 320;
+
+typedef enum { RASTERIZER_BARYCENTRIC, RASTERIZER_STANDARD } rasterizer_t;
+rasterizer_t g_rasterizer = RASTERIZER_BARYCENTRIC;
+
+// Render the next frames at a resolution up to the screen resolution. The standard rasterizer draws to the target of
+// the barycentric one, with its depth buffer allocated for the screen resolution.
+static void set_render_resolution(int width, int height) {
+    render_width = width;
+
+    sw_target_t target = sw_set_target_barycentric((sw_target_t){0});
+    target.fb_width = width;
+    target.fb_height = height;
+    target.color_buffer = render_buffer;
+    target.color_pitch = width;
+    sw_set_target_barycentric(target);
+    sw_set_target_standard(target);
 }
 
 void xd_draw_triangle(vec3d p[3], vec2d t[3], vec3d c[3], texture_t* tex, bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y,
-                      bool depth_test, bool perspective_correct)
+                      bool depth_test, bool perspective_correct, bool alpha_test)
 {
-    if (g_rasterizer_barycentric) {
-        sw_draw_triangle_barycentric(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, c[0].w, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, c[1].w, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, c[2].w, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
+    if (tex) sw_bind_texture(tex);
+    sw_set_alpha_test(alpha_test);
+    if (g_rasterizer == RASTERIZER_BARYCENTRIC) {
+        sw_draw_triangle_barycentric(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
     } else {
-        sw_draw_triangle_standard(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, c[0].w, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, c[1].w, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, c[2].w, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
+        sw_draw_triangle_standard(p[0].x, p[0].y, t[0].w, t[0].u, t[0].v, c[0].x, c[0].y, c[0].z, p[1].x, p[1].y, t[1].w, t[1].u, t[1].v, c[1].x, c[1].y, c[1].z, p[2].x, p[2].y, t[2].w, t[2].u, t[2].v, c[2].x, c[2].y, c[2].z, (tex != NULL) ? true : false, clamp_s, clamp_t, depth_test, perspective_correct);
     }
 }
 
-int main() {
-    sw_init_rasterizer_standard(screen_width, screen_height, draw_pixel);
-    sw_init_rasterizer_barycentric(screen_width, screen_height, draw_pixel);
+int main(int argc, char* argv[]) {
+    // Optional chunked mesh (see utils/obj2chunks.py) with its memory budget in MB
+    mesh_stream_t* stream = NULL;
+    if (argc > 1) {
+        size_t memory_budget = (size_t)(argc > 2 ? atoi(argv[2]) : 64) * 1024 * 1024;
+        stream = mesh_stream_open(argv[1], memory_budget);
+        if (!stream) return 1;
+    }
+
+    sw_init_rasterizer_standard(screen_width, screen_height, NULL, DEPTH_BUFFER16);
+    sw_init_rasterizer_barycentric(screen_width, screen_height, NULL, DEPTH_BUFFER16);
+    sw_target_t standard_target = sw_set_target_standard((sw_target_t){0});
+    set_render_resolution(screen_width, screen_height);
 
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -56,20 +94,36 @@ int main() {
     // SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
-    SDL_RenderSetScale(renderer, (float)screen_scale, (float)screen_scale);
+
+    // the frames are upscaled into a texture, presented again when the next frame is skipped
+    SDL_Texture* frame_texture =
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, screen_width, screen_height);
+    frame_state_t frame_state;
+    frame_state_init(&frame_state);
 
     SDL_Event e;
     int quit = 0;
 
-    // Projection matrix
+    // Projection matrix, for the render resolution
     mat4x4 mat_proj = matrix_make_projection(screen_width, screen_height, 60.0f);
 
+    bool is_dynamic_resolution = false;
+    dynamic_resolution_t dynamic_resolution;
+    dynamic_resolution_init(&dynamic_resolution, screen_width, screen_height, DYNAMIC_RESOLUTION_MIN_SCALE,
+                            DYNAMIC_RESOLUTION_TARGET_MS);
+    int width = screen_width, height = screen_height;
+
     float theta = 0.5f;
     float scale = 1.0f;
 
+    // default texture with its mip chain, sampled when mipmapping is enabled
+    sw_texture_layout_t texture_layout = SW_TEXTURE_LINEAR;
+    sw_upload_texture(NULL, texture_layout, true);
+
     model_t* cube_model = load_cube();
     model_t* teapot_model = load_teapot();
     model_t* current_model = cube_model;
+    bool is_stream = false;
 
     bool is_anim = false;
     bool is_wireframe = false;
@@ -97,6 +151,15 @@ int main() {
     lights[4].ambient_color = (vec3d){FX(0.1f), FX(0.1f), FX(0.0f), FX(1.0f)};
     lights[4].diffuse_color = (vec3d){FX(0.2f), FX(0.2f), FX(0.0f), FX(1.0f)};    
 
+    // model transform, only recomputed when the rotation or the scale changes
+    transform_node_t scene_node, model_node;
+    transform_node_init(&scene_node, NULL);
+    transform_node_init(&model_node, &scene_node);
+    mat4x4 mat_trans = matrix_make_translation(FX(0.0f), FX(0.0f), FX(2.0f));
+    transform_node_set_local(&scene_node, &mat_trans);
+    float model_theta = -1.0f, model_scale = -1.0f;
+    mat4x4 mat_normal;
+
     unsigned int time = SDL_GetTicks();
 
     float yaw = 0.0f;
@@ -104,12 +167,17 @@ int main() {
     vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
     vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
     while (!quit) {
-        SDL_SetRenderDrawColor(renderer, 50, 50, 50, SDL_ALPHA_OPAQUE);
-        SDL_RenderClear(renderer);
-        if (g_rasterizer_barycentric) {
-            sw_clear_depth_buffer_barycentric();
-        } else {
-            sw_clear_depth_buffer_standard();
+        //
+        // render resolution
+        //
+
+        int next_width = is_dynamic_resolution ? dynamic_resolution.width : screen_width;
+        int next_height = is_dynamic_resolution ? dynamic_resolution.height : screen_height;
+        if (next_width != width || next_height != height) {
+            width = next_width;
+            height = next_height;
+            set_render_resolution(width, height);
+            mat_proj = matrix_make_projection(width, height, 60.0f);
         }
 
         //
@@ -130,32 +198,102 @@ int main() {
         // world
         //
 
-        mat4x4 mat_rot_z = matrix_make_rotation_z(theta);
-        mat4x4 mat_rot_x = matrix_make_rotation_x(theta);
-        mat4x4 mat_scale = matrix_make_scale(FX(scale), FX(scale), FX(scale));
-        mat4x4 mat_trans = matrix_make_translation(FX(0.0f), FX(0.0f), FX(2.0f));
-        mat4x4 mat_world, mat_normal;
-        mat_world = matrix_make_identity();
-        mat_world = matrix_multiply_matrix(&mat_world, &mat_rot_z);
-        mat_world = mat_normal = matrix_multiply_matrix(&mat_world, &mat_rot_x);
-        mat_world = matrix_multiply_matrix(&mat_world, &mat_scale);
-        mat_world = matrix_multiply_matrix(&mat_world, &mat_trans);
-
-        // Draw lines
-        vec3d v0, v1, c0, c1;
-        v0.x = FX(0.0f), v0.y = FX(0.0f), v0.z = FX(1.0f), v0.w = FX(1.0f);
-        c0.x = FX(1.0f), c0.y = FX(1.0f), c0.z = FX(1.0f), c0.w = FX(1.0f);
-
-        for(fx32 x = FX(0.0); x < FX(120.0f); x+=FX(10.0f)) {
-            v1.x = x, v1.y = FX(140.0f), v1.z = FX(1.0f), v1.w = FX(1.0f);
-            draw_line(v0, v1, (vec2d){FX(0.0f), FX(0.0f), FX(0.0f)}, (vec2d){FX(0.0f), FX(0.0f), FX(0.0f)}, c0, c0, FX(1.0f), NULL, true, true, 0, 0, perspective_correct);
+        if (theta != model_theta || scale != model_scale) {
+            mat4x4 mat_rot_z = matrix_make_rotation_z(theta);
+            mat4x4 mat_rot_x = matrix_make_rotation_x(theta);
+            mat4x4 mat_scale = matrix_make_scale(FX(scale), FX(scale), FX(scale));
+            mat_normal = matrix_multiply_matrix(&mat_rot_z, &mat_rot_x);
+            mat4x4 mat_local = matrix_multiply_matrix(&mat_normal, &mat_scale);
+            transform_node_set_local(&model_node, &mat_local);
+            model_theta = theta;
+            model_scale = scale;
         }
+        mat4x4 mat_view_proj = matrix_multiply_matrix(&mat_view, &mat_proj);
+        transform_update(&scene_node, &mat_view_proj);
+        mat4x4 mat_world = model_node.world;
+
+        //
+        // inputs of the frame
+        //
+
+        frame_state_begin(&frame_state);
+        frame_state_track(&frame_state, &vec_camera, sizeof(vec_camera));
+        frame_state_track(&frame_state, &mat_view, sizeof(mat_view));
+        frame_state_track(&frame_state, &mat_world, sizeof(mat_world));
+        frame_state_track(&frame_state, &mat_normal, sizeof(mat_normal));
+        frame_state_track(&frame_state, &nb_lights, sizeof(nb_lights));
+        frame_state_track(&frame_state, lights, nb_lights * sizeof(light_t));
+        frame_state_track(&frame_state, &current_model, sizeof(current_model));
+        frame_state_track(&frame_state, &is_stream, sizeof(is_stream));
+        frame_state_track(&frame_state, &is_wireframe, sizeof(is_wireframe));
+        frame_state_track(&frame_state, &is_gouraud_shading, sizeof(is_gouraud_shading));
+        frame_state_track(&frame_state, &is_textured, sizeof(is_textured));
+        frame_state_track(&frame_state, &clamp_s, sizeof(clamp_s));
+        frame_state_track(&frame_state, &clamp_t, sizeof(clamp_t));
+        frame_state_track(&frame_state, &perspective_correct, sizeof(perspective_correct));
+        frame_state_track(&frame_state, &g_rasterizer, sizeof(g_rasterizer));
+        frame_state_track(&frame_state, &width, sizeof(width));
+        frame_state_track(&frame_state, &height, sizeof(height));
+        // the settings of the rasterizers, e.g. the texture layout, the mipmapping or the perspective subdivision
+        unsigned render_state_generation = sw_render_state_generation();
+        frame_state_track(&frame_state, &render_state_generation, sizeof(render_state_generation));
+        bool is_frame_changed = frame_state_end(&frame_state);
+
+        if (is_frame_changed) {
+            Uint64 render_start = SDL_GetPerformanceCounter();
+
+            // (50, 50, 50)
+            for (int i = 0; i < width * height; ++i) render_buffer[i] = 0x3186;
+            // shared by both rasterizers
+            sw_clear_depth_buffer_barycentric();
+
+            // Draw lines
+            vec3d v0, v1, c0, c1;
+            v0.x = FX(0.0f), v0.y = FX(0.0f), v0.z = FX(1.0f), v0.w = FX(1.0f);
+            c0.x = FX(1.0f), c0.y = FX(1.0f), c0.z = FX(1.0f), c0.w = FX(1.0f);
+
+            fx32 line_scale_x = DIV(FXI(width), FXI(screen_width));
+            fx32 line_scale_y = DIV(FXI(height), FXI(screen_height));
+            for(fx32 x = FX(0.0); x < FX(120.0f); x+=FX(10.0f)) {
+                v1.x = MUL(x, line_scale_x), v1.y = MUL(FX(140.0f), line_scale_y), v1.z = FX(1.0f), v1.w = FX(1.0f);
+                draw_line(v0, v1, (vec2d){FX(0.0f), FX(0.0f), FX(0.0f)}, (vec2d){FX(0.0f), FX(0.0f), FX(0.0f)}, c0, c0, FX(1.0f), NULL, true, true, 0, 0, perspective_correct);
+            }
+
+            // Draw model
+            texture_t dummy_texture = {256, 2048, NULL};
+            if (is_stream) {
+                draw_mesh_stream(width, height, &vec_camera, stream, &mat_world, is_gouraud_shading ? &mat_normal : NULL, &mat_proj, &mat_view, lights, nb_lights,
+                                 is_wireframe, is_textured ? &dummy_texture : NULL, clamp_s, clamp_t, 0, 0, perspective_correct);
+            } else {
+                draw_model(width, height, &vec_camera, current_model, &mat_world, is_gouraud_shading ? &mat_normal : NULL, &mat_proj, &mat_view, lights, nb_lights,
+                           is_wireframe, is_textured ? &dummy_texture : NULL, clamp_s, clamp_t, 0, 0, perspective_correct);
+            }
 
-        // Draw model
-        texture_t dummy_texture;
-        draw_model(screen_width, screen_height, &vec_camera, current_model, &mat_world, is_gouraud_shading ? &mat_normal : NULL, &mat_proj, &mat_view, lights, nb_lights,
-                   is_wireframe, is_textured ? &dummy_texture : NULL, clamp_s, clamp_t, 0, 0, perspective_correct);
 
+            if (is_dynamic_resolution)
+                dynamic_resolution_update(&dynamic_resolution,
+                                          (float)(SDL_GetPerformanceCounter() - render_start) * 1000.0f /
+                                              (float)SDL_GetPerformanceFrequency());
+
+            void* pixels;
+            int pitch;
+            const uint16_t* frame = render_buffer;
+            if (width != screen_width || height != screen_height) {
+                dynamic_resolution_upscale(render_buffer, width, height, width, upscaled_buffer, screen_width,
+                                           screen_height, screen_width);
+                frame = upscaled_buffer;
+            }
+            SDL_LockTexture(frame_texture, NULL, &pixels, &pitch);
+            sw_convert_rgb565_to_argb8888(frame, screen_width, (uint32_t*)pixels, pitch / (int)sizeof(uint32_t),
+                                          screen_width, screen_height, SW_SIMD_AVX2);
+            SDL_UnlockTexture(frame_texture);
+        } else {
+            // a frame rendered at a lower resolution is rendered again at the screen resolution
+            if (is_dynamic_resolution) dynamic_resolution_idle(&dynamic_resolution);
+            SDL_Delay(SKIPPED_FRAME_DELAY_MS);
+        }
+
+        SDL_RenderCopy(renderer, frame_texture, NULL, NULL);
         SDL_RenderPresent(renderer);
 
         // printf("%d ms\n", SDL_GetTicks() - time);
@@ -198,9 +336,14 @@ int main() {
                         break;
                     case SDL_SCANCODE_1:
                         current_model = cube_model;
+                        is_stream = false;
                         break;
                     case SDL_SCANCODE_2:
                         current_model = teapot_model;
+                        is_stream = false;
+                        break;
+                    case SDL_SCANCODE_3:
+                        is_stream = stream != NULL;
                         break;
                     case SDL_SCANCODE_TAB:
                         is_wireframe = !is_wireframe;
@@ -223,6 +366,38 @@ int main() {
                     case SDL_SCANCODE_P:
                         perspective_correct = !perspective_correct;
                         break;                                                                                        
+                    case SDL_SCANCODE_O: {
+                        int n = sw_set_persp_subdivision(0);
+                        n = n == 0 ? 8 : (n == 32 ? 0 : 2 * n);
+                        sw_set_persp_subdivision(n);
+                        if (n == 0) {
+                            printf("Perspective correction at every pixel\n");
+                        } else {
+                            printf("Perspective correction every %d pixels\n", n);
+                        }
+                        break;
+                    }
+                    case SDL_SCANCODE_M: {
+                        bool is_mipmapping = !sw_set_mipmapping(false);
+                        sw_set_mipmapping(is_mipmapping);
+                        if (is_mipmapping) {
+                            printf("Mipmapping\n");
+                        } else {
+                            printf("Base level textures\n");
+                        }
+                        break;
+                    }
+                    case SDL_SCANCODE_Y:
+                        texture_layout = (sw_texture_layout_t)((texture_layout + 1) % 3);
+                        sw_upload_texture(NULL, texture_layout, true);
+                        if (texture_layout == SW_TEXTURE_TILED) {
+                            printf("Tiled texture\n");
+                        } else if (texture_layout == SW_TEXTURE_COMPRESSED) {
+                            printf("Compressed texture\n");
+                        } else {
+                            printf("Linear texture\n");
+                        }
+                        break;
                     case SDL_SCANCODE_SPACE:
                         is_anim = !is_anim;
                         break;
@@ -233,9 +408,17 @@ int main() {
                         if (scale > 1.0f)
                             scale -= 1.0f;
                         break;                        
+                    case SDL_SCANCODE_R:
+                        is_dynamic_resolution = !is_dynamic_resolution;
+                        if (is_dynamic_resolution) {
+                            printf("Dynamic resolution\n");
+                        } else {
+                            printf("Fixed resolution\n");
+                        }
+                        break;
                     case SDL_SCANCODE_BACKSLASH:
-                        g_rasterizer_barycentric = !g_rasterizer_barycentric;
-                        if (g_rasterizer_barycentric) {
+                        g_rasterizer = (rasterizer_t)((g_rasterizer + 1) % 2);
+                        if (g_rasterizer == RASTERIZER_BARYCENTRIC) {
                             printf("Barycentric\n");
                         } else {
                             printf("Standard\n");
@@ -251,11 +434,17 @@ int main() {
         if (is_anim) theta += 0.01f;
     }
 
+    frame_state_free(&frame_state);
+    SDL_DestroyTexture(frame_texture);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
+    sw_set_target_standard(standard_target);
+    sw_free_texture(NULL);
     sw_dispose_rasterizer_barycentric();
     sw_dispose_rasterizer_standard();
 
+    if (stream) mesh_stream_close(stream);
+
     return 0;
 }
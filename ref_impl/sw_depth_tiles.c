@@ -0,0 +1,91 @@
+// sw_depth_tiles.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sw_rasterizer.h"
+
+// Above the depth of the nearest vertex, for the rounding of the interpolated depths. The fragments of the
+// rasterizers are at most a few units of the last place above it.
+#define DEPTH_MARGIN FX(1.0f / 1024.0f)
+
+#define TILE_SIZE (1 << SW_DEPTH_TILE_SIZE_LOG2)
+
+// The farthest depth of a tile is exact, a bound after writes with the depth test or unknown after writes without it
+enum { TILE_EXACT, TILE_BOUND, TILE_UNKNOWN };
+
+struct sw_depth_tiles {
+    size_t nb_tiles;  // allocated, for the largest target
+    fx32* farthest;
+    uint8_t* states;
+};
+
+sw_depth_tiles_t* sw_create_depth_tiles(int fb_width, int fb_height) {
+    sw_depth_tiles_t* tiles = (sw_depth_tiles_t*)malloc(sizeof(sw_depth_tiles_t));
+    tiles->nb_tiles = (size_t)((fb_width + TILE_SIZE - 1) >> SW_DEPTH_TILE_SIZE_LOG2) *
+                      ((fb_height + TILE_SIZE - 1) >> SW_DEPTH_TILE_SIZE_LOG2);
+    tiles->farthest = (fx32*)malloc(tiles->nb_tiles * sizeof(fx32));
+    tiles->states = (uint8_t*)malloc(tiles->nb_tiles);
+    sw_clear_depth_tiles(tiles);
+    return tiles;
+}
+
+void sw_free_depth_tiles(sw_depth_tiles_t* tiles) {
+    if (!tiles) return;
+    free(tiles->farthest);
+    free(tiles->states);
+    free(tiles);
+}
+
+void sw_clear_depth_tiles(sw_depth_tiles_t* tiles) {
+    for (size_t i = 0; i < tiles->nb_tiles; ++i) tiles->farthest[i] = FX(0.0f);
+    memset(tiles->states, TILE_EXACT, tiles->nb_tiles);
+}
+
+// The tiles are in rows across the width of the target, which may be smaller than the one they were created for
+static int tiles_per_row(const sw_target_t* target) {
+    return (target->fb_width + TILE_SIZE - 1) >> SW_DEPTH_TILE_SIZE_LOG2;
+}
+
+void sw_mark_depth_tiles(const sw_target_t* target, int x0, int x1, int y, bool depth_test) {
+    uint8_t* states = &target->depth_tiles->states[(y >> SW_DEPTH_TILE_SIZE_LOG2) * tiles_per_row(target)];
+    for (int tx = x0 >> SW_DEPTH_TILE_SIZE_LOG2; tx <= x1 >> SW_DEPTH_TILE_SIZE_LOG2; ++tx)
+        if (!depth_test)
+            states[tx] = TILE_UNKNOWN;
+        else if (states[tx] == TILE_EXACT)
+            states[tx] = TILE_BOUND;
+}
+
+// Farthest depth of the pixels of a tile within the target
+static fx32 farthest_depth(const sw_target_t* target, int tx, int ty) {
+    int x0 = tx << SW_DEPTH_TILE_SIZE_LOG2, y0 = ty << SW_DEPTH_TILE_SIZE_LOG2;
+    int x1 = x0 + TILE_SIZE < target->fb_width ? x0 + TILE_SIZE : target->fb_width;
+    int y1 = y0 + TILE_SIZE < target->fb_height ? y0 + TILE_SIZE : target->fb_height;
+    fx32 farthest = target->depth_buffer[y0 * target->fb_width + x0];
+    for (int y = y0; y < y1; ++y) {
+        const fx32* depth = &target->depth_buffer[y * target->fb_width];
+        for (int x = x0; x < x1; ++x) farthest = depth[x] < farthest ? depth[x] : farthest;
+    }
+    return farthest;
+}
+
+bool sw_is_depth_occluded(const sw_target_t* target, int x0, int y0, int x1, int y1, fx32 z, bool refresh) {
+    sw_depth_tiles_t* tiles = target->depth_tiles;
+    int nb_columns = tiles_per_row(target);
+    z += DEPTH_MARGIN;
+    for (int ty = y0 >> SW_DEPTH_TILE_SIZE_LOG2; ty <= y1 >> SW_DEPTH_TILE_SIZE_LOG2; ++ty)
+        for (int tx = x0 >> SW_DEPTH_TILE_SIZE_LOG2; tx <= x1 >> SW_DEPTH_TILE_SIZE_LOG2; ++tx) {
+            int i = ty * nb_columns + tx;
+            if (refresh && tiles->states[i] != TILE_EXACT) {
+                tiles->farthest[i] = farthest_depth(target, tx, ty);
+                tiles->states[i] = TILE_EXACT;
+            } else if (tiles->states[i] == TILE_UNKNOWN) {
+                return false;
+            }
+            // the depth test passes for the depths above the ones of the buffer
+            if (z > tiles->farthest[i]) return false;
+        }
+    return true;
+}
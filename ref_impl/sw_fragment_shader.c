@@ -1,14 +1,302 @@
 #include "sw_rasterizer.h"
 
+#include <block_texture.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// AVX2 span shader, in fixed point only
+#ifndef SW_SIMD
+#if FIXED_POINT && !RV_FIXED_POINT_EXTENSION && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SW_SIMD 1
+#else
+#define SW_SIMD 0
+#endif
+#endif
+
+#if SW_SIMD
+#include <immintrin.h>
+#endif
 
 extern uint16_t tex32x32[];
 extern uint16_t tex32x64[];
 extern uint16_t tex256x2048[];
 
-uint16_t *tex = tex256x2048;
-#define TEXTURE_WIDTH   256
-#define TEXTURE_HEIGHT  2048
+#define DEFAULT_TEXTURE_WIDTH_LOG2   8
+#define DEFAULT_TEXTURE_HEIGHT_LOG2  11
+
+// The texture coordinates have SCALE fractional bits, one texel per unit of the last place at most
+#if FIXED_POINT
+#define MAX_TEXTURE_SIZE_LOG2 SCALE
+#else
+#define MAX_TEXTURE_SIZE_LOG2 14
+#endif
+
+static sw_simd_t g_simd = SW_SIMD_NONE;
+static int g_persp_subdivision_log2 = 0;  // 0 to correct every pixel
+static bool g_alpha_test = false;
+static unsigned g_render_state_generation = 0;
+
+// Tiles and compressed blocks of 4x4 texels, narrower for the textures and mip levels under 4 texels
+#define TILE_SIZE_LOG2 2
+
+// Texture of linear, tiled or compressed texels. The linear texels are a single row of tiles.
+static sw_texture_t texture_layout(const uint16_t* texels, int width_log2, int height_log2,
+                                   sw_texture_layout_t layout) {
+    if (layout == SW_TEXTURE_LINEAR) return (sw_texture_t){texels, width_log2, height_log2, width_log2, 0, false};
+    return (sw_texture_t){texels, width_log2, height_log2, width_log2 < TILE_SIZE_LOG2 ? width_log2 : TILE_SIZE_LOG2,
+                          height_log2 < TILE_SIZE_LOG2 ? height_log2 : TILE_SIZE_LOG2, layout == SW_TEXTURE_COMPRESSED};
+}
+
+#define DEFAULT_TEXTURE \
+    {tex256x2048, DEFAULT_TEXTURE_WIDTH_LOG2, DEFAULT_TEXTURE_HEIGHT_LOG2, DEFAULT_TEXTURE_WIDTH_LOG2, 0, false}
+
+// Copy of a texture in the layout of the sampler, with its mip chain if any. The levels are halved down to 1x1, their
+// texels or blocks are in a single allocation.
+typedef struct {
+    const uint16_t* source;
+    sw_texture_t levels[MAX_TEXTURE_SIZE_LOG2 + 1];
+    int nb_levels;
+    uint16_t* texels;
+} uploaded_texture_t;
+
+static sw_texture_t g_texture = DEFAULT_TEXTURE;
+static const uint16_t* g_texture_source = tex256x2048;        // texels of the bound texture, before its upload
+static const uploaded_texture_t* g_uploaded_texture = NULL;  // of the bound texture, NULL if not uploaded
+static uploaded_texture_t g_uploaded_textures[SW_MAX_UPLOADED_TEXTURES];
+static bool g_mipmapping = false;
+
+static int size_log2(size_t size) {
+    int log2 = 0;
+    while (((size_t)1 << log2) < size) log2++;
+    return ((size_t)1 << log2) == size ? log2 : -1;
+}
+
+static bool texture_of(const texture_t* texture, sw_texture_t* result) {
+    if (!texture || !texture->data) {
+        *result = (sw_texture_t)DEFAULT_TEXTURE;
+        return true;
+    }
+    int width_log2 = size_log2(texture->width), height_log2 = size_log2(texture->height);
+    if (width_log2 < 0 || height_log2 < 0 || width_log2 > MAX_TEXTURE_SIZE_LOG2 ||
+        height_log2 > MAX_TEXTURE_SIZE_LOG2) {
+        printf("Invalid texture size %zux%zu, the sizes must be powers of two up to %d\n", texture->width,
+               texture->height, 1 << MAX_TEXTURE_SIZE_LOG2);
+        return false;
+    }
+    *result = texture_layout((const uint16_t*)texture->data, width_log2, height_log2, SW_TEXTURE_LINEAR);
+    return true;
+}
+
+static uploaded_texture_t* find_uploaded_texture(const uint16_t* source) {
+    for (int i = 0; i < SW_MAX_UPLOADED_TEXTURES; ++i)
+        if (g_uploaded_textures[i].source == source) return &g_uploaded_textures[i];
+    return NULL;
+}
+
+bool sw_bind_texture(const texture_t* texture) {
+    sw_texture_t bound;
+    if (!texture_of(texture, &bound)) return false;
+    g_texture_source = bound.texels;
+    g_uploaded_texture = find_uploaded_texture(bound.texels);
+    g_texture = g_uploaded_texture ? g_uploaded_texture->levels[0] : bound;
+    return true;
+}
+
+// Index of a texel: the tiles are in rows, and the texels of a tile too
+static ALWAYS_INLINE int texel_index(const sw_texture_t* texture, int x, int y) {
+    int tile_width_log2 = texture->tile_width_log2, tile_height_log2 = texture->tile_height_log2;
+    return ((y >> tile_height_log2) << (texture->width_log2 + tile_height_log2)) |
+           ((x >> tile_width_log2) << (tile_width_log2 + tile_height_log2)) |
+           ((y & ((1 << tile_height_log2) - 1)) << tile_width_log2) | (x & ((1 << tile_width_log2) - 1));
+}
+
+// Index of the block of a texel of a compressed texture, the blocks are in rows
+static ALWAYS_INLINE int block_index(const sw_texture_t* texture, int x, int y) {
+    return ((y >> texture->tile_height_log2) << (texture->width_log2 - texture->tile_width_log2)) |
+           (x >> texture->tile_width_log2);
+}
+
+// Average of the ARGB4444 texels of a footprint of 1x1 to 2x2, rounded
+static uint16_t average_texels(const uint16_t* texels, int pitch, int width, int height) {
+    uint16_t result = 0;
+    for (int shift = 0; shift < 16; shift += 4) {
+        int sum = 0;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x) sum += (texels[y * pitch + x] >> shift) & 0xF;
+        int n = width * height;
+        result |= (uint16_t)(((sum + n / 2) / n) << shift);
+    }
+    return result;
+}
+
+bool sw_upload_texture(const texture_t* texture, sw_texture_layout_t layout, bool mipmaps) {
+    sw_texture_t base;
+    if (!texture_of(texture, &base)) return false;
+    uploaded_texture_t* uploaded = find_uploaded_texture(base.texels);
+    if (uploaded) {
+        free(uploaded->texels);
+    } else {
+        uploaded = find_uploaded_texture(NULL);
+        if (!uploaded) {
+            printf("Too many uploaded textures, at most %d\n", SW_MAX_UPLOADED_TEXTURES);
+            return false;
+        }
+    }
+
+    // linear levels, the box filter reads the previous one
+    int nb_levels = mipmaps ? (base.width_log2 > base.height_log2 ? base.width_log2 : base.height_log2) + 1 : 1;
+    size_t nb_texels = 0;
+    for (int i = 0; i < nb_levels; ++i) {
+        int width_log2 = base.width_log2 > i ? base.width_log2 - i : 0;
+        int height_log2 = base.height_log2 > i ? base.height_log2 - i : 0;
+        nb_texels += (size_t)1 << (width_log2 + height_log2);
+    }
+    uint16_t* linear = (uint16_t*)malloc(nb_texels * sizeof(uint16_t));
+    memcpy(linear, base.texels, sizeof(uint16_t) << (base.width_log2 + base.height_log2));
+    sw_texture_t levels[MAX_TEXTURE_SIZE_LOG2 + 1] = {texture_layout(linear, base.width_log2, base.height_log2,
+                                                                     SW_TEXTURE_LINEAR)};
+    uint16_t* texels = linear + ((size_t)1 << (base.width_log2 + base.height_log2));
+    for (int i = 1; i < nb_levels; ++i) {
+        const sw_texture_t* src = &levels[i - 1];
+        int width_log2 = src->width_log2 > 0 ? src->width_log2 - 1 : 0;
+        int height_log2 = src->height_log2 > 0 ? src->height_log2 - 1 : 0;
+        int footprint_width = src->width_log2 > 0 ? 2 : 1, footprint_height = src->height_log2 > 0 ? 2 : 1;
+        for (int y = 0; y < 1 << height_log2; ++y)
+            for (int x = 0; x < 1 << width_log2; ++x)
+                texels[(y << width_log2) | x] =
+                    average_texels(&src->texels[((y * footprint_height) << src->width_log2) + x * footprint_width],
+                                   1 << src->width_log2, footprint_width, footprint_height);
+        levels[i] = texture_layout(texels, width_log2, height_log2, SW_TEXTURE_LINEAR);
+        texels += (size_t)1 << (width_log2 + height_log2);
+    }
+
+    // levels in the layout, at the same offsets unless compressed
+    size_t nb_words = nb_texels;
+    if (layout == SW_TEXTURE_COMPRESSED) {
+        nb_words = 0;
+        for (int i = 0; i < nb_levels; ++i)
+            nb_words += block_texture_size(1 << levels[i].width_log2, 1 << levels[i].height_log2);
+    }
+    uint16_t* copy = linear;
+    if (layout != SW_TEXTURE_LINEAR) copy = (uint16_t*)malloc(nb_words * sizeof(uint16_t));
+    uint16_t* blocks = copy;
+    for (int i = 0; i < nb_levels; ++i) {
+        sw_texture_t* level = &uploaded->levels[i];
+        if (layout == SW_TEXTURE_COMPRESSED) {
+            *level = texture_layout(blocks, levels[i].width_log2, levels[i].height_log2, layout);
+            block_texture_encode(levels[i].texels, 1 << level->width_log2, 1 << level->height_log2, blocks);
+            blocks += block_texture_size(1 << level->width_log2, 1 << level->height_log2);
+            continue;
+        }
+        *level = texture_layout(copy + (levels[i].texels - linear), levels[i].width_log2, levels[i].height_log2,
+                                layout);
+        if (layout == SW_TEXTURE_LINEAR) continue;
+        for (int y = 0; y < 1 << level->height_log2; ++y)
+            for (int x = 0; x < 1 << level->width_log2; ++x)
+                ((uint16_t*)level->texels)[texel_index(level, x, y)] = levels[i].texels[(y << level->width_log2) | x];
+    }
+    if (copy != linear) free(linear);
+
+    uploaded->source = base.texels;
+    uploaded->nb_levels = nb_levels;
+    uploaded->texels = copy;
+    sw_touch_render_state();
+    if (g_texture_source == base.texels) {
+        g_uploaded_texture = uploaded;
+        g_texture = uploaded->levels[0];
+    }
+    return true;
+}
+
+void sw_free_texture(const texture_t* texture) {
+    sw_texture_t base;
+    if (!texture_of(texture, &base)) return;
+    uploaded_texture_t* uploaded = find_uploaded_texture(base.texels);
+    if (!uploaded) return;
+    if (g_uploaded_texture == uploaded) {
+        g_uploaded_texture = NULL;
+        g_texture = base;
+    }
+    free(uploaded->texels);
+    *uploaded = (uploaded_texture_t){0};
+    sw_touch_render_state();
+}
+
+bool sw_set_mipmapping(bool enabled) {
+    bool previous = g_mipmapping;
+    g_mipmapping = enabled;
+    if (enabled != previous) sw_touch_render_state();
+    return previous;
+}
+
+void sw_select_mip_level(sw_fragment_state_t* state, const fx32 x[3], const fx32 y[3], const fx32 z[3],
+                         const fx32 u[3], const fx32 v[3]) {
+    if (!state->texture || !g_mipmapping || !g_uploaded_texture || g_uploaded_texture->nb_levels == 1) return;
+
+    // texture coordinates of the vertices, divided back when the perspective is corrected
+    float tu[3], tv[3];
+    for (int i = 0; i < 3; ++i) {
+        float w = state->persp_correct && z[i] > FX(0.0f) ? 1.0f / FLT(z[i]) : 1.0f;
+        tu[i] = FLT(u[i]) * w;
+        tv[i] = FLT(v[i]) * w;
+    }
+    float pixel_area = fabsf((FLT(x[1]) - FLT(x[0])) * (FLT(y[2]) - FLT(y[0])) -
+                             (FLT(x[2]) - FLT(x[0])) * (FLT(y[1]) - FLT(y[0])));
+    float texel_area = fabsf((tu[1] - tu[0]) * (tv[2] - tv[0]) - (tu[2] - tu[0]) * (tv[1] - tv[0])) *
+                       (float)(1 << (g_texture.width_log2 + g_texture.height_log2));
+    if (pixel_area <= 0.0f || texel_area <= pixel_area) return;
+
+    // a texel of level n spans 2^n texels of level 0 along each axis, the nearest level to the texels per pixel
+    int level = (int)(0.5f * log2f(texel_area / pixel_area) + 0.5f);
+    if (level >= g_uploaded_texture->nb_levels) level = g_uploaded_texture->nb_levels - 1;
+    state->sampler = g_uploaded_texture->levels[level];
+}
+
+// Set associative cache of the texel fetches, with a LRU replacement
+#define TEXTURE_CACHE_LINE_LOG2 6
+#define TEXTURE_CACHE_NB_WAYS 8
+#define TEXTURE_CACHE_NB_SETS ((SW_TEXTURE_CACHE_SIZE >> TEXTURE_CACHE_LINE_LOG2) / TEXTURE_CACHE_NB_WAYS)
+
+typedef struct {
+    uintptr_t tags[TEXTURE_CACHE_NB_WAYS];  // line + 1, 0 if empty, the most recently used first
+} texture_cache_set_t;
+
+static texture_cache_set_t g_texture_cache_sets[TEXTURE_CACHE_NB_SETS];
+static sw_texture_cache_stats_t g_texture_cache_stats;
+static uintptr_t g_texture_row = 0;  // + 1, of the last fetch
+static bool g_texture_cache_stats_enabled = false;
+
+static void fetch_texel(const uint16_t* texel) {
+    uintptr_t line = (uintptr_t)texel >> TEXTURE_CACHE_LINE_LOG2;
+    uintptr_t* tags = g_texture_cache_sets[line % TEXTURE_CACHE_NB_SETS].tags;
+    g_texture_cache_stats.fetches++;
+    uintptr_t row = (uintptr_t)texel / SW_TEXTURE_ROW_SIZE;
+    if (row + 1 != g_texture_row) g_texture_cache_stats.row_switches++;
+    g_texture_row = row + 1;
+    int way = 0;
+    while (way < TEXTURE_CACHE_NB_WAYS - 1 && tags[way] != line + 1) way++;
+    if (tags[way] != line + 1) g_texture_cache_stats.misses++;
+    for (; way > 0; --way) tags[way] = tags[way - 1];
+    tags[0] = line + 1;
+}
+
+sw_texture_cache_stats_t sw_get_texture_cache_stats(bool reset) {
+    sw_texture_cache_stats_t stats = g_texture_cache_stats;
+    if (reset) {
+        g_texture_cache_stats = (sw_texture_cache_stats_t){0};
+        memset(g_texture_cache_sets, 0, sizeof(g_texture_cache_sets));
+        g_texture_row = 0;
+    }
+    return stats;
+}
+
+bool sw_set_texture_cache_stats(bool enabled) {
+    bool previous = g_texture_cache_stats_enabled;
+    g_texture_cache_stats_enabled = enabled;
+    return previous;
+}
 
 typedef struct {
     fx32 r, g, b, a;
@@ -17,84 +305,721 @@ typedef struct {
 #define RECIPROCAL_NUMERATOR 256.0f
 static fx32 reciprocal(fx32 x) { return x > 0 ? DIV(FX(RECIPROCAL_NUMERATOR), x) : FX(RECIPROCAL_NUMERATOR); }
 
-color_t texture_sample_color(bool texture, fx32 u, fx32 v) {
+// Texel of a texture coordinate along a size of 2^size_log2 texels. The coordinate is scaled with a shift, then
+// wrapped with a mask or clamped to the last texel from 1.0. The negative coordinates are on the first texel in both
+// modes, as in the RTL.
+static ALWAYS_INLINE int texel_coordinate(fx32 u, int size_log2, const bool clamped) {
+    if (u < FX(0.0f)) return 0;
+    if (clamped && u >= FX(1.0f)) return (1 << size_log2) - 1;
+#if FIXED_POINT
+    int x = u >> (SCALE - size_log2);
+#else
+    int x = (int)(u * (float)(1 << size_log2));
+#endif
+    return clamped ? x : x & ((1 << size_log2) - 1);
+}
+
+// Channels of the ARGB4444 texels, n / 15, so that the texels are decoded without divisions
+#define TEXEL_CHANNEL(n) DIV(FXI(n), FXI(15))
+static const fx32 g_texel_channels[16] = {
+    TEXEL_CHANNEL(0),  TEXEL_CHANNEL(1),  TEXEL_CHANNEL(2),  TEXEL_CHANNEL(3),  TEXEL_CHANNEL(4),  TEXEL_CHANNEL(5),
+    TEXEL_CHANNEL(6),  TEXEL_CHANNEL(7),  TEXEL_CHANNEL(8),  TEXEL_CHANNEL(9),  TEXEL_CHANNEL(10), TEXEL_CHANNEL(11),
+    TEXEL_CHANNEL(12), TEXEL_CHANNEL(13), TEXEL_CHANNEL(14), TEXEL_CHANNEL(15)};
+
+static bool g_texel_divisions = false;
+
+static ALWAYS_INLINE color_t texture_sample_color(const sw_texture_t* texture, fx32 u, fx32 v, const bool clamp_s,
+                                                  const bool clamp_t) {
+    int x = texel_coordinate(u, texture->width_log2, clamp_s);
+    int y = texel_coordinate(v, texture->height_log2, clamp_t);
+    const uint16_t* texel;
+    uint16_t c;
+    if (texture->compressed) {
+        texel = &texture->texels[block_index(texture, x, y) * BLOCK_TEXTURE_WORDS];
+        c = block_texture_texel(texel, x & ((1 << texture->tile_width_log2) - 1),
+                                y & ((1 << texture->tile_height_log2) - 1));
+    } else {
+        texel = &texture->texels[texel_index(texture, x, y)];
+        c = *texel;
+    }
+    if (g_texture_cache_stats_enabled) fetch_texel(texel);
+    if (g_texel_divisions)
+        return (color_t){TEXEL_CHANNEL((c >> 8) & 0xF), TEXEL_CHANNEL((c >> 4) & 0xF), TEXEL_CHANNEL(c & 0xF),
+                         TEXEL_CHANNEL((c >> 12) & 0xF)};
+    return (color_t){g_texel_channels[(c >> 8) & 0xF], g_texel_channels[(c >> 4) & 0xF], g_texel_channels[c & 0xF],
+                     g_texel_channels[(c >> 12) & 0xF]};
+}
+
+static ALWAYS_INLINE int shade(const sw_fragment_state_t* state, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b,
+                               const bool persp_correct, const bool clamp_s, const bool clamp_t, const bool texture) {
+    // Perspective correction
+    if (persp_correct) {
+        fx32 inv_z = reciprocal(z);
+        inv_z = DIV(inv_z, FX(RECIPROCAL_NUMERATOR));
+
+        if (texture) {
+            u = MUL(u, inv_z);
+            v = MUL(v, inv_z);
+        }
+        r = MUL(r, inv_z);
+        g = MUL(g, inv_z);
+        b = MUL(b, inv_z);
+    }
+
+    // without texture, the sample is white and opaque
     if (texture) {
-        int x = INT(MUL(u, FXI(TEXTURE_WIDTH)));
-        int y = INT(MUL(v, FXI(TEXTURE_HEIGHT)));
-        if (x >= TEXTURE_WIDTH) x = TEXTURE_WIDTH - 1;
-        if (y >= TEXTURE_HEIGHT) y = TEXTURE_HEIGHT - 1;
-        uint16_t c = tex[y * TEXTURE_WIDTH + x];
-        uint8_t a = (c >> 12) & 0xF;
-        uint8_t r = (c >> 8) & 0xF;
-        uint8_t g = (c >> 4) & 0xF;
-        uint8_t b = c & 0xF;
+        color_t sample = texture_sample_color(&state->sampler, u, v, clamp_s, clamp_t);
+
+        // alpha test
+        if (state->alpha_test && sample.a == FX(0.0f))
+            return -1;
 
-        return (color_t){DIV(FXI(r), FXI(15)), DIV(FXI(g), FXI(15)), DIV(FXI(b), FXI(15)), DIV(FXI(a), FXI(15))};
+        r = MUL(r, sample.r);
+        g = MUL(g, sample.g);
+        b = MUL(b, sample.b);
     }
-    return (color_t){FX(1.0f), FX(1.0f), FX(1.0f), FX(1.0f)};
+
+    int rr = INT(MUL(r, FX(31.0f)));
+    int gg = INT(MUL(g, FX(63.0f)));
+    int bb = INT(MUL(b, FX(31.0f)));
+
+    return rr << 11 | gg << 5 | bb;
 }
 
-static fx32 clamp(fx32 v) {
-    if (v < FX(0.0f)) {
-        v = FX(0.0f);
-    } else if (v > FX(1.0f)) {
-        v = FX(1.0f);
+// Depth test and write of the pixel i of a span in the depth buffer of the target, 16-bit if depth16 is set
+static ALWAYS_INLINE bool depth_passes(const fx32* depth, const uint16_t* depth16, int i, fx32 z) {
+    return depth16 ? sw_depth16(z) > depth16[i] : z > depth[i];
+}
+
+static ALWAYS_INLINE void write_depth(fx32* depth, uint16_t* depth16, int i, fx32 z) {
+    if (depth16)
+        depth16[i] = sw_depth16(z);
+    else
+        depth[i] = z;
+}
+
+static ALWAYS_INLINE void draw_span(const sw_fragment_state_t* state, const sw_target_t* target,
+                                    const sw_span_t* span, const bool depth_test, const bool color_buffer,
+                                    const bool persp_correct, const bool clamp_s, const bool clamp_t,
+                                    const bool texture, const bool constant_color) {
+    int depth_index = span->y * target->fb_width + span->x;
+    fx32* depth = target->depth_buffer16 ? NULL : &target->depth_buffer[depth_index];
+    uint16_t* depth16 = target->depth_buffer16 ? &target->depth_buffer16[depth_index] : NULL;
+    uint16_t* colors = color_buffer ? &target->color_buffer[span->y * target->color_pitch + span->x] : NULL;
+    fx32 z = span->z, u = span->u, v = span->v, r = span->r, g = span->g, b = span->b;
+
+    // The interpolated colors of a triangle of constant color are not stepped when their increments are zero, which
+    // truncated weights leave for most spans. Without texture nor perspective correction, they are shaded once.
+    bool is_constant =
+        constant_color && span->dr == FX(0.0f) && span->dg == FX(0.0f) && span->db == FX(0.0f);
+    bool is_flat = is_constant && !persp_correct && !texture;
+    int flat_color = is_flat ? shade(state, z, u, v, r, g, b, false, false, false, false) : 0;
+
+    for (int i = 0; i < span->count; ++i) {
+        if (!depth_test || depth_passes(depth, depth16, i, z)) {
+            int color = is_flat ? flat_color : shade(state, z, u, v, r, g, b, persp_correct, clamp_s, clamp_t, texture);
+            if (color >= 0) {
+                if (color_buffer) {
+                    colors[i] = (uint16_t)color;
+                } else {
+                    (*target->draw_pixel_fn)(span->x + i, span->y, color);
+                }
+
+                // write to depth buffer
+                write_depth(depth, depth16, i, z);
+            }
+        }
+
+        z += span->dz;
+        if (texture) {
+            u += span->du;
+            v += span->dv;
+        }
+        if (!is_constant) {
+            r += span->dr;
+            g += span->dg;
+            b += span->db;
+        }
     }
-    return v;
 }
 
-static fx32 wrap(fx32 v) {
-    if (v < FX(0.0f)) {
-        v = FX(0.0f);
-    } else if (v >= FX(1.0f)) {
-        //v = FX(fmod(FLT(v), 1.0f));
-        v = v & 0x3FFF;
+// Span shader of the perspective subdivision: the attributes are corrected exactly at the multiples of
+// state->persp_subdivision along a row and interpolated linearly in between, like Quake. The ends of a segment are
+// extrapolated from the span, so the spans which split a segment, e.g. at the 8 pixel blocks of the barycentric
+// rasterizer, interpolate between the same ends. The fragments are shaded with their corrected attributes, without
+// perspective correction.
+
+// Last segment of the rows of a triangle, kept across the spans of a row. The rasterizers draw the rows of a triangle
+// in blocks of a few rows at most, a row keeps its segment until a row PERSP_SEGMENT_ROWS rows away is drawn.
+#define PERSP_SEGMENT_ROWS 64
+
+typedef struct {
+    unsigned triangle;  // of the segment, see sw_fragment_state_t
+    int x, y;           // of the start of the segment
+    fx32 start[5], end[5];  // corrected u, v, r, g, b at the ends
+    bool is_start, is_end;  // the ends are in front of the eye, otherwise every pixel of the segment is corrected
+} persp_segment_t;
+
+static persp_segment_t g_persp_segments[PERSP_SEGMENT_ROWS];
+static unsigned g_persp_triangle = 0;
+
+// Corrected u, v, r, g, b at a pixel of the row of a span, false if it is behind the eye
+static ALWAYS_INLINE bool persp_attributes(const sw_fragment_state_t* state, const sw_span_t* span, int offset,
+                                           fx32 attributes[5]) {
+    fx32 z = span->z + offset * span->dz;
+    if (z <= FX(0.0f)) return false;
+    fx32 inv_z = DIV(reciprocal(z), FX(RECIPROCAL_NUMERATOR));
+    attributes[0] = MUL(span->u + offset * span->du, inv_z);
+    attributes[1] = MUL(span->v + offset * span->dv, inv_z);
+    attributes[2] = MUL(span->r + offset * span->dr, inv_z);
+    attributes[3] = MUL(span->g + offset * span->dg, inv_z);
+    attributes[4] = MUL(span->b + offset * span->db, inv_z);
+    return true;
+}
+
+// Segment of a row starting at x, the end of the previous segment of the row is its start
+static ALWAYS_INLINE void persp_segment(const sw_fragment_state_t* state, const sw_span_t* span,
+                                        persp_segment_t* segment, int x) {
+    bool is_row = segment->triangle == state->persp_triangle && segment->y == span->y;
+    if (is_row && segment->x == x) return;
+    if (is_row && segment->x + state->persp_subdivision == x) {
+        memcpy(segment->start, segment->end, sizeof(segment->start));
+        segment->is_start = segment->is_end;
+    } else {
+        segment->is_start = persp_attributes(state, span, x - span->x, segment->start);
     }
-    return v;
+    segment->is_end = persp_attributes(state, span, x + state->persp_subdivision - span->x, segment->end);
+    segment->triangle = state->persp_triangle;
+    segment->x = x;
+    segment->y = span->y;
 }
 
-void sw_fragment_shader(int fb_width, int fb_height, int x, int y, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b, fx32 a, bool clamp_s, bool clamp_t, bool depth_test, bool texture, fx32* depth_buffer, bool persp_correct, draw_pixel_fn_t draw_pixel_fn) {
-    if (x < 0 || y < 0 || x >= fb_width || y >= fb_height)
-        return;
-    int depth_index = y * fb_width + x;
-    if (!depth_test || (z > depth_buffer[depth_index])) {
-        // Perspective correction
-        fx32 inv_z = reciprocal(z);
-        inv_z = DIV(inv_z, FX(RECIPROCAL_NUMERATOR));
+static ALWAYS_INLINE void draw_span_subdivided(const sw_fragment_state_t* state, const sw_target_t* target,
+                                               const sw_span_t* span, const bool depth_test, const bool color_buffer,
+                                               const bool clamp_s, const bool clamp_t, const bool texture) {
+    int depth_index = span->y * target->fb_width + span->x;
+    fx32* depth = target->depth_buffer16 ? NULL : &target->depth_buffer[depth_index];
+    uint16_t* depth16 = target->depth_buffer16 ? &target->depth_buffer16[depth_index] : NULL;
+    uint16_t* colors = color_buffer ? &target->color_buffer[span->y * target->color_pitch + span->x] : NULL;
+    persp_segment_t* segment = &g_persp_segments[span->y & (PERSP_SEGMENT_ROWS - 1)];
+    int n = state->persp_subdivision;
+    fx32 z = span->z;
 
-        if (persp_correct) {
-            u = MUL(u, inv_z);
-            v = MUL(v, inv_z);
-            r = MUL(r, inv_z);
-            g = MUL(g, inv_z);
-            b = MUL(b, inv_z);
-            a = MUL(a, inv_z);
+    for (int i = 0; i < span->count;) {
+        // pixels of the span in the segment of its pixel i
+        int x = span->x + i;
+        int segment_start = x & ~(n - 1);
+        int count = segment_start + n - x < span->count - i ? segment_start + n - x : span->count - i;
+        persp_segment(state, span, segment, segment_start);
+        bool is_exact = !segment->is_start || !segment->is_end;
+        fx32 du = (segment->end[0] - segment->start[0]) / n, dv = (segment->end[1] - segment->start[1]) / n;
+        fx32 dr = (segment->end[2] - segment->start[2]) / n, dg = (segment->end[3] - segment->start[3]) / n;
+        fx32 db = (segment->end[4] - segment->start[4]) / n;
+        int offset = x - segment_start;
+        fx32 u = segment->start[0] + offset * du, v = segment->start[1] + offset * dv;
+        fx32 r = segment->start[2] + offset * dr, g = segment->start[3] + offset * dg;
+        fx32 b = segment->start[4] + offset * db;
+
+        for (int end = i + count; i < end; ++i) {
+            if (!depth_test || depth_passes(depth, depth16, i, z)) {
+                int color;
+                if (is_exact) {
+                    fx32 c[5] = {0};
+                    persp_attributes(state, span, i, c);
+                    color = shade(state, z, c[0], c[1], c[2], c[3], c[4], false, clamp_s, clamp_t, texture);
+                } else {
+                    color = shade(state, z, u, v, r, g, b, false, clamp_s, clamp_t, texture);
+                }
+                if (color >= 0) {
+                    if (color_buffer) {
+                        colors[i] = (uint16_t)color;
+                    } else {
+                        (*target->draw_pixel_fn)(span->x + i, span->y, color);
+                    }
+                    write_depth(depth, depth16, i, z);
+                }
+            }
+
+            z += span->dz;
+            if (texture) {
+                u += du;
+                v += dv;
+            }
+            r += dr;
+            g += dg;
+            b += db;
         }
+    }
+}
+
+#if SW_SPECIALIZE_FRAGMENTS
+
+// X-macros enumerating every combination of depth test, color buffer, perspective correction, clamping, texture and
+// constant color, in the order of the indices computed by the selections. The shading does not depend on the constant
+// color, only the stepping of the spans.
+#define SHADE_VARIANTS_TX(pc, cs, ct) SHADE_VARIANT(pc, cs, ct, 0) SHADE_VARIANT(pc, cs, ct, 1)
+#define SHADE_VARIANTS_CT(pc, cs) SHADE_VARIANTS_TX(pc, cs, 0) SHADE_VARIANTS_TX(pc, cs, 1)
+#define SHADE_VARIANTS_CS(pc) SHADE_VARIANTS_CT(pc, 0) SHADE_VARIANTS_CT(pc, 1)
+#define SHADE_VARIANTS SHADE_VARIANTS_CS(0) SHADE_VARIANTS_CS(1)
+
+#define SPAN_VARIANTS_CC(dt, cb, pc, cs, ct, tx) SPAN_VARIANT(dt, cb, pc, cs, ct, tx, 0) SPAN_VARIANT(dt, cb, pc, cs, ct, tx, 1)
+#define SPAN_VARIANTS_TX(dt, cb, pc, cs, ct) SPAN_VARIANTS_CC(dt, cb, pc, cs, ct, 0) SPAN_VARIANTS_CC(dt, cb, pc, cs, ct, 1)
+#define SPAN_VARIANTS_CT(dt, cb, pc, cs) SPAN_VARIANTS_TX(dt, cb, pc, cs, 0) SPAN_VARIANTS_TX(dt, cb, pc, cs, 1)
+#define SPAN_VARIANTS_CS(dt, cb, pc) SPAN_VARIANTS_CT(dt, cb, pc, 0) SPAN_VARIANTS_CT(dt, cb, pc, 1)
+#define SPAN_VARIANTS_PC(dt, cb) SPAN_VARIANTS_CS(dt, cb, 0) SPAN_VARIANTS_CS(dt, cb, 1)
+#define SPAN_VARIANTS_CB(dt) SPAN_VARIANTS_PC(dt, 0) SPAN_VARIANTS_PC(dt, 1)
+#define SPAN_VARIANTS SPAN_VARIANTS_CB(0) SPAN_VARIANTS_CB(1)
+
+#define SUBDIVIDED_VARIANTS_TX(dt, cb, cs, ct) SUBDIVIDED_VARIANT(dt, cb, cs, ct, 0) SUBDIVIDED_VARIANT(dt, cb, cs, ct, 1)
+#define SUBDIVIDED_VARIANTS_CT(dt, cb, cs) SUBDIVIDED_VARIANTS_TX(dt, cb, cs, 0) SUBDIVIDED_VARIANTS_TX(dt, cb, cs, 1)
+#define SUBDIVIDED_VARIANTS_CS(dt, cb) SUBDIVIDED_VARIANTS_CT(dt, cb, 0) SUBDIVIDED_VARIANTS_CT(dt, cb, 1)
+#define SUBDIVIDED_VARIANTS_CB(dt) SUBDIVIDED_VARIANTS_CS(dt, 0) SUBDIVIDED_VARIANTS_CS(dt, 1)
+#define SUBDIVIDED_VARIANTS SUBDIVIDED_VARIANTS_CB(0) SUBDIVIDED_VARIANTS_CB(1)
+
+#define SHADE_VARIANT(pc, cs, ct, tx)                                                                                 \
+    static int shade_##pc##cs##ct##tx(const sw_fragment_state_t* state, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b) { \
+        return shade(state, z, u, v, r, g, b, pc, cs, ct, tx);                                                        \
+    }
+SHADE_VARIANTS
+#undef SHADE_VARIANT
+
+#define SHADE_VARIANT(pc, cs, ct, tx) shade_##pc##cs##ct##tx,
+static const sw_shade_kernel_t g_shade_variants[] = {SHADE_VARIANTS};
+#undef SHADE_VARIANT
+
+#define SPAN_VARIANT(dt, cb, pc, cs, ct, tx, cc)                                                                   \
+    static void draw_span_##dt##cb##pc##cs##ct##tx##cc(const sw_fragment_state_t* state, const sw_target_t* target, \
+                                                       const sw_span_t* span) {                                    \
+        draw_span(state, target, span, dt, cb, pc, cs, ct, tx, cc);                                                \
+    }
+SPAN_VARIANTS
+#undef SPAN_VARIANT
+
+#define SPAN_VARIANT(dt, cb, pc, cs, ct, tx, cc) draw_span_##dt##cb##pc##cs##ct##tx##cc,
+static const sw_span_shader_t g_span_variants[] = {SPAN_VARIANTS};
+#undef SPAN_VARIANT
 
-        if (clamp_s) {
-            u = clamp(u);
+#define SUBDIVIDED_VARIANT(dt, cb, cs, ct, tx)                                                                 \
+    static void draw_span_subdivided_##dt##cb##cs##ct##tx(const sw_fragment_state_t* state,                   \
+                                                          const sw_target_t* target, const sw_span_t* span) { \
+        draw_span_subdivided(state, target, span, dt, cb, cs, ct, tx);                                         \
+    }
+SUBDIVIDED_VARIANTS
+#undef SUBDIVIDED_VARIANT
+
+#define SUBDIVIDED_VARIANT(dt, cb, cs, ct, tx) draw_span_subdivided_##dt##cb##cs##ct##tx,
+static const sw_span_shader_t g_subdivided_variants[] = {SUBDIVIDED_VARIANTS};
+#undef SUBDIVIDED_VARIANT
+
+static int shade_index(const sw_fragment_state_t* state) {
+    return (((state->persp_correct ? 1 : 0) * 2 + (state->clamp_s ? 1 : 0)) * 2 + (state->clamp_t ? 1 : 0)) * 2 +
+           (state->texture ? 1 : 0);
+}
+
+static sw_span_shader_t select_scalar_span_shader(const sw_fragment_state_t* state, const sw_target_t* target) {
+    int index = (((state->depth_test ? 1 : 0) * 2 + (target->color_buffer ? 1 : 0)) * 16 + shade_index(state)) * 2 +
+                (state->constant_color ? 1 : 0);
+    return g_span_variants[index];
+}
+
+static sw_span_shader_t select_subdivided_span_shader(const sw_fragment_state_t* state, const sw_target_t* target) {
+    int index = ((((state->depth_test ? 1 : 0) * 2 + (target->color_buffer ? 1 : 0)) * 2 + (state->clamp_s ? 1 : 0)) * 2 +
+                 (state->clamp_t ? 1 : 0)) * 2 + (state->texture ? 1 : 0);
+    return g_subdivided_variants[index];
+}
+
+static void select_shade_kernels(sw_fragment_state_t* state) {
+    int index = shade_index(state);
+    state->shade = g_shade_variants[index];
+    // without perspective correction
+    state->shade_corrected = g_shade_variants[index & ~8];
+}
+
+#else
+
+static int shade_generic(const sw_fragment_state_t* state, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b) {
+    return shade(state, z, u, v, r, g, b, state->persp_correct, state->clamp_s, state->clamp_t, state->texture);
+}
+
+static int shade_generic_corrected(const sw_fragment_state_t* state, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b) {
+    return shade(state, z, u, v, r, g, b, false, state->clamp_s, state->clamp_t, state->texture);
+}
+
+static void draw_span_generic(const sw_fragment_state_t* state, const sw_target_t* target, const sw_span_t* span) {
+    draw_span(state, target, span, state->depth_test, target->color_buffer != NULL, state->persp_correct,
+              state->clamp_s, state->clamp_t, state->texture, state->constant_color);
+}
+
+static void draw_span_subdivided_generic(const sw_fragment_state_t* state, const sw_target_t* target,
+                                         const sw_span_t* span) {
+    draw_span_subdivided(state, target, span, state->depth_test, target->color_buffer != NULL, state->clamp_s,
+                         state->clamp_t, state->texture);
+}
+
+static sw_span_shader_t select_scalar_span_shader(const sw_fragment_state_t* state, const sw_target_t* target) {
+    return draw_span_generic;
+}
+
+static sw_span_shader_t select_subdivided_span_shader(const sw_fragment_state_t* state, const sw_target_t* target) {
+    return draw_span_subdivided_generic;
+}
+
+static void select_shade_kernels(sw_fragment_state_t* state) {
+    state->shade = shade_generic;
+    state->shade_corrected = shade_generic_corrected;
+}
+
+#endif  // SW_SPECIALIZE_FRAGMENTS
+
+sw_fragment_state_t sw_fragment_state(bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct,
+                                      fx32 r[3], fx32 g[3], fx32 b[3]) {
+    sw_fragment_state_t state = {0};
+    state.texture = texture;
+    state.clamp_s = clamp_s && texture;
+    state.clamp_t = clamp_t && texture;
+    state.depth_test = depth_test;
+    state.persp_correct = persp_correct;
+    if (texture) state.sampler = g_texture;
+    state.constant_color = r[0] == r[1] && r[0] == r[2] && g[0] == g[1] && g[0] == g[2] && b[0] == b[1] && b[0] == b[2];
+    state.alpha_test = texture && g_alpha_test;
+    if (persp_correct && g_persp_subdivision_log2 > 0) {
+        state.persp_subdivision = 1 << g_persp_subdivision_log2;
+        // the segments of the previous triangles are not reused
+        if (++g_persp_triangle == 0) {
+            memset(g_persp_segments, 0, sizeof(g_persp_segments));
+            g_persp_triangle = 1;
+        }
+        state.persp_triangle = g_persp_triangle;
+    }
+    select_shade_kernels(&state);
+    return state;
+}
+
+#if SW_SIMD
+
+// Span shader processing 8 pixels at once with AVX2. The depth test, the perspective correction, the texture sampling,
+// the alpha test and the shading of the pixels are computed for all the pixels with the same fixed point arithmetic as
+// the scalar shaders, and the colors and depths of the ones drawn are stored with a mask. The texels are gathered.
+
+// Depths above which the reciprocal of the perspective correction is computed with a division of doubles. It is
+// exact: the quotient of 2^36 by a depth is at least 1 / depth away from an integer, more than a rounding error, and
+// it fits in an int32. The few pixels under it are corrected one by one.
+#define MIN_VECTOR_DEPTH 32
+
+// Attributes z, u, v, r, g, b at the start of a span and their increments. The unused texture coordinates are zero.
+static void span_attributes(const sw_fragment_state_t* state, const sw_span_t* span, uint32_t start[6],
+                            uint32_t step[6]) {
+    start[0] = span->z;
+    step[0] = span->dz;
+    start[1] = state->texture ? span->u : 0;
+    step[1] = state->texture ? span->du : 0;
+    start[2] = state->texture ? span->v : 0;
+    step[2] = state->texture ? span->dv : 0;
+    start[3] = span->r;
+    step[3] = span->dr;
+    start[4] = span->g;
+    step[4] = span->dg;
+    start[5] = span->b;
+    step[5] = span->db;
+}
+
+__attribute__((target("avx2"))) static __m256i mul_avx2(__m256i a, __m256i b) {
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(a, b), SCALE);
+    __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    odd = _mm256_slli_epi64(_mm256_srli_epi64(odd, SCALE), 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+__attribute__((target("avx2"))) static __m256i select_avx2(__m256i mask, __m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+// Reciprocal of the perspective correction, like the shade kernels
+__attribute__((target("avx2"))) static __m256i inv_z_avx2(__m256i z, __m256i mask) {
+    __m256d numerator = _mm256_set1_pd((double)((int64_t)1 << 36));
+    __m128i q0 = _mm256_cvttpd_epi32(_mm256_div_pd(numerator, _mm256_cvtepi32_pd(_mm256_castsi256_si128(z))));
+    __m128i q1 = _mm256_cvttpd_epi32(_mm256_div_pd(numerator, _mm256_cvtepi32_pd(_mm256_extracti128_si256(z, 1))));
+    __m256i inv_z = _mm256_srai_epi32(_mm256_set_m128i(q1, q0), 8);
+    int small = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_andnot_si256(_mm256_cmpgt_epi32(z, _mm256_set1_epi32(MIN_VECTOR_DEPTH)), mask)));
+    if (small) {
+        fx32 zz[8], values[8];
+        _mm256_storeu_si256((__m256i*)zz, z);
+        _mm256_storeu_si256((__m256i*)values, inv_z);
+        for (int i = 0; i < 8; ++i)
+            if (small & (1 << i)) values[i] = DIV(reciprocal(zz[i]), FX(RECIPROCAL_NUMERATOR));
+        inv_z = _mm256_loadu_si256((__m256i*)values);
+    }
+    return inv_z;
+}
+
+// Texel coordinates, like texel_coordinate()
+__attribute__((target("avx2"))) static __m256i texel_coordinate_avx2(__m256i u, int size_log2, const bool clamped) {
+    __m256i x = _mm256_sra_epi32(u, _mm_cvtsi32_si128(SCALE - size_log2));
+    __m256i last = _mm256_set1_epi32((1 << size_log2) - 1);
+    if (clamped) return _mm256_min_epi32(_mm256_max_epi32(x, _mm256_setzero_si256()), last);
+    return _mm256_andnot_si256(_mm256_srai_epi32(u, 31), _mm256_and_si256(x, last));
+}
+
+// ARGB4444 texels of compressed blocks, like block_texture_texel(), from their endpoints and their indices
+__attribute__((target("avx2"))) static __m256i block_texels_avx2(__m256i endpoints, __m256i indices, __m256i x,
+                                                                 __m256i y) {
+    __m256i c0 = _mm256_and_si256(endpoints, _mm256_set1_epi32(0xFFFF));
+    __m256i c1 = _mm256_srli_epi32(endpoints, 16);
+    __m256i shift = _mm256_slli_epi32(_mm256_or_si256(_mm256_slli_epi32(y, 2), x), 1);
+    __m256i index = _mm256_and_si256(_mm256_srlv_epi32(indices, shift), _mm256_set1_epi32(3));
+    __m256i is_four_colors = _mm256_cmpgt_epi32(c0, c1);
+    __m256i opaque = _mm256_set1_epi32(0xF000);
+
+    __m256i c = select_avx2(_mm256_cmpeq_epi32(index, _mm256_set1_epi32(1)), c1, c0);
+    __m256i endpoint = _mm256_or_si256(
+        _mm256_or_si256(opaque, _mm256_slli_epi32(_mm256_srli_epi32(c, 12), 8)),
+        _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(c, 7), _mm256_set1_epi32(0xF)), 4),
+                        _mm256_and_si256(_mm256_srli_epi32(c, 1), _mm256_set1_epi32(0xF))));
+
+    // index 2: 2/3 c0 + 1/3 c1, index 3: 1/3 c0 + 2/3 c1, or (c0 + c1) / 2 with 3 colors. The thirds of the sums
+    // under 2^15 are exact with a multiplication.
+    __m256i w0 = _mm256_sub_epi32(_mm256_set1_epi32(4), index);
+    __m256i w1 = _mm256_sub_epi32(index, _mm256_set1_epi32(1));
+    __m256i channels = opaque;
+    const int shifts[3] = {11, 5, 0}, masks[3] = {0x1F, 0x3F, 0x1F};
+    const int truncations[3] = {1, 2, 1}, positions[3] = {8, 4, 0};
+    for (int i = 0; i < 3; ++i) {
+        __m256i a = _mm256_and_si256(_mm256_srli_epi32(c0, shifts[i]), _mm256_set1_epi32(masks[i]));
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(c1, shifts[i]), _mm256_set1_epi32(masks[i]));
+        __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(w0, a), _mm256_mullo_epi32(w1, b));
+        __m256i third = _mm256_srli_epi32(_mm256_mullo_epi32(sum, _mm256_set1_epi32(0xAAAB)), 17);
+        __m256i half = _mm256_srli_epi32(_mm256_add_epi32(a, b), 1);
+        __m256i channel = _mm256_srli_epi32(select_avx2(is_four_colors, third, half), truncations[i]);
+        channels = _mm256_or_si256(channels, _mm256_slli_epi32(channel, positions[i]));
+    }
+
+    __m256i texel = select_avx2(_mm256_cmpgt_epi32(_mm256_set1_epi32(2), index), endpoint, channels);
+    __m256i is_transparent = _mm256_andnot_si256(is_four_colors, _mm256_cmpeq_epi32(index, _mm256_set1_epi32(3)));
+    return _mm256_andnot_si256(is_transparent, texel);
+}
+
+// ARGB4444 texels of the pixels of a mask, like texture_sample_color(). The texels are gathered in the 32-bit words
+// which end with them, or start with the first one, so that no byte out of the texels is read, and the blocks with
+// their endpoints and their indices. A texture of a single texel is sampled by the scalar shaders.
+__attribute__((target("avx2"))) static __m256i texture_sample_avx2(const sw_texture_t* texture, __m256i u,
+                                                                   __m256i v, __m256i mask, const bool clamp_s,
+                                                                   const bool clamp_t) {
+    __m256i x = texel_coordinate_avx2(u, texture->width_log2, clamp_s);
+    __m256i y = texel_coordinate_avx2(v, texture->height_log2, clamp_t);
+    __m128i tile_width_log2 = _mm_cvtsi32_si128(texture->tile_width_log2);
+    __m128i tile_height_log2 = _mm_cvtsi32_si128(texture->tile_height_log2);
+    __m256i x_in_tile = _mm256_and_si256(x, _mm256_set1_epi32((1 << texture->tile_width_log2) - 1));
+    __m256i y_in_tile = _mm256_and_si256(y, _mm256_set1_epi32((1 << texture->tile_height_log2) - 1));
+    __m256i tile_y = _mm256_srl_epi32(y, tile_height_log2);
+    __m256i tile_x = _mm256_srl_epi32(x, tile_width_log2);
+
+    if (texture->compressed) {
+        __m256i block = _mm256_or_si256(
+            _mm256_sll_epi32(tile_y, _mm_cvtsi32_si128(texture->width_log2 - texture->tile_width_log2)), tile_x);
+        __m256i word = _mm256_slli_epi32(block, 2);
+        const int* blocks = (const int*)texture->texels;
+        __m256i endpoints = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), blocks, word, mask, 2);
+        __m256i indices = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), blocks,
+                                                      _mm256_add_epi32(word, _mm256_set1_epi32(2)), mask, 2);
+        return block_texels_avx2(endpoints, indices, x_in_tile, y_in_tile);
+    }
+
+    __m256i index = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_sll_epi32(tile_y, _mm_cvtsi32_si128(texture->width_log2 + texture->tile_height_log2)),
+            _mm256_sll_epi32(tile_x, _mm_cvtsi32_si128(texture->tile_width_log2 + texture->tile_height_log2))),
+        _mm256_or_si256(_mm256_sll_epi32(y_in_tile, tile_width_log2), x_in_tile));
+    __m256i is_after_first = _mm256_cmpgt_epi32(index, _mm256_setzero_si256());
+    __m256i offset = _mm256_slli_epi32(_mm256_add_epi32(index, is_after_first), 1);
+    __m256i texels = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)texture->texels, offset, mask, 1);
+    texels = _mm256_srlv_epi32(texels, _mm256_and_si256(is_after_first, _mm256_set1_epi32(16)));
+    return _mm256_and_si256(texels, _mm256_set1_epi32(0xFFFF));
+}
+
+// Channels of the 4-bit channels n of texels, with the table of the scalar shaders
+__attribute__((target("avx2"))) static __m256i texel_channels_avx2(__m256i n) {
+    __m256i low = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)&g_texel_channels[0]), n);
+    __m256i high = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)&g_texel_channels[8]), n);
+    return select_avx2(_mm256_srai_epi32(_mm256_slli_epi32(n, 28), 31), high, low);
+}
+
+// RGB565 colors of the pixels of a mask, like shade(), the colors which the scalar shaders discard are cleared from
+// the mask
+__attribute__((target("avx2"))) static __m256i shade_avx2(const sw_fragment_state_t* state, __m256i attrs[6],
+                                                          __m256i* mask) {
+    __m256i u = attrs[1], v = attrs[2], r = attrs[3], g = attrs[4], b = attrs[5];
+    if (state->persp_correct) {
+        __m256i inv_z = inv_z_avx2(attrs[0], *mask);
+        if (state->texture) {
+            u = mul_avx2(u, inv_z);
+            v = mul_avx2(v, inv_z);
+        }
+        r = mul_avx2(r, inv_z);
+        g = mul_avx2(g, inv_z);
+        b = mul_avx2(b, inv_z);
+    }
+
+    if (state->texture) {
+        __m256i texels = texture_sample_avx2(&state->sampler, u, v, *mask, state->clamp_s, state->clamp_t);
+        __m256i nibble = _mm256_set1_epi32(0xF);
+        if (state->alpha_test)
+            *mask = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(_mm256_srli_epi32(texels, 12), _mm256_setzero_si256()), *mask);
+        r = mul_avx2(r, texel_channels_avx2(_mm256_and_si256(_mm256_srli_epi32(texels, 8), nibble)));
+        g = mul_avx2(g, texel_channels_avx2(_mm256_and_si256(_mm256_srli_epi32(texels, 4), nibble)));
+        b = mul_avx2(b, texel_channels_avx2(_mm256_and_si256(texels, nibble)));
+    }
+
+    __m256i rr = _mm256_srai_epi32(mul_avx2(r, _mm256_set1_epi32(FX(31.0f))), SCALE);
+    __m256i gg = _mm256_srai_epi32(mul_avx2(g, _mm256_set1_epi32(FX(63.0f))), SCALE);
+    __m256i bb = _mm256_srai_epi32(mul_avx2(b, _mm256_set1_epi32(FX(31.0f))), SCALE);
+    __m256i color = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(rr, 11), _mm256_slli_epi32(gg, 5)), bb);
+    *mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), color), *mask);
+    return color;
+}
+
+// The 16 low bits of 8 values in the order of the pixels, in the low half
+__attribute__((target("avx2"))) static __m128i pack16_avx2(__m256i a) {
+    a = _mm256_and_si256(a, _mm256_set1_epi32(0xFFFF));
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(a, a), 0x08));
+}
+
+// Store the 16-bit values of the pixels of a mask to count pixels
+__attribute__((target("avx2"))) static void store16_avx2(uint16_t* p, __m256i values, __m256i mask, int count) {
+    if (count == 8) {
+        __m128i old = _mm_loadu_si128((__m128i*)p);
+        _mm_storeu_si128((__m128i*)p, _mm_blendv_epi8(old, pack16_avx2(values), pack16_avx2(mask)));
+    } else {
+        uint16_t vv[8];
+        _mm_storeu_si128((__m128i*)vv, pack16_avx2(values));
+        int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+        for (int i = 0; i < count; ++i)
+            if (lanes & (1 << i)) p[i] = vv[i];
+    }
+}
+
+__attribute__((target("avx2"))) static void draw_span_avx2(const sw_fragment_state_t* state,
+                                                           const sw_target_t* target, const sw_span_t* span) {
+    uint32_t start[6], step[6];
+    span_attributes(state, span, start, step);
+    // like draw_span(), the colors of a triangle of constant color are shaded once when they are not stepped
+    bool is_flat = state->constant_color && !state->persp_correct && !state->texture && span->dr == FX(0.0f) &&
+                   span->dg == FX(0.0f) && span->db == FX(0.0f);
+    __m256i flat_color =
+        _mm256_set1_epi32(is_flat ? shade(state, span->z, 0, 0, span->r, span->g, span->b, false, false, false, false) : 0);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i z = _mm256_add_epi32(_mm256_set1_epi32(start[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(step[0])));
+    __m256i z_step = _mm256_set1_epi32(8 * step[0]);
+
+    int depth_index = span->y * target->fb_width + span->x;
+    fx32* depth = target->depth_buffer16 ? NULL : &target->depth_buffer[depth_index];
+    uint16_t* depth16 = target->depth_buffer16 ? &target->depth_buffer16[depth_index] : NULL;
+    uint16_t* colors = target->color_buffer ? &target->color_buffer[span->y * target->color_pitch + span->x] : NULL;
+    for (int x = 0; x < span->count; x += 8, z = _mm256_add_epi32(z, z_step)) {
+        // the pixels past the end of the span are neither loaded nor stored
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(span->count - x), lane);
+        __m256i mask = valid;
+        int count = span->count - x < 8 ? span->count - x : 8;
+        if (state->depth_test) {
+            __m256i d;
+            if (depth16) {
+                // zero extended, compared with the 16 low bits of the depths
+                __m128i d16;
+                if (count == 8) {
+                    d16 = _mm_loadu_si128((__m128i*)&depth16[x]);
+                } else {
+                    uint16_t dd[8] = {0};
+                    for (int i = 0; i < count; ++i) dd[i] = depth16[x + i];
+                    d16 = _mm_loadu_si128((__m128i*)dd);
+                }
+                d = _mm256_cvtepu16_epi32(d16);
+                mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(_mm256_and_si256(z, _mm256_set1_epi32(0xFFFF)), d));
+            } else {
+                d = _mm256_maskload_epi32(&depth[x], valid);
+                mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(z, d));
+            }
+        }
+        if (_mm256_testz_si256(mask, mask)) continue;
+
+        __m256i color;
+        if (is_flat) {
+            color = flat_color;
+            mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), color), mask);
         } else {
-            u = wrap(u);
+            __m256i attrs[6];
+            attrs[0] = z;
+            for (int i = 1; i < 6; ++i)
+                attrs[i] = _mm256_add_epi32(_mm256_set1_epi32(start[i] + (uint32_t)x * step[i]),
+                                            _mm256_mullo_epi32(lane, _mm256_set1_epi32(step[i])));
+            color = shade_avx2(state, attrs, &mask);
         }
-        
-        if (clamp_t) {
-            v = clamp(v);
+
+        if (colors) {
+            store16_avx2(&colors[x], color, mask, count);
         } else {
-            v = wrap(v);
+            int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+            int cc[8];
+            _mm256_storeu_si256((__m256i*)cc, color);
+            for (int i = 0; i < count; ++i)
+                if (lanes & (1 << i)) target->draw_pixel_fn(span->x + x + i, span->y, cc[i]);
         }
 
-        color_t sample = texture_sample_color(texture, u, v);
-        r = MUL(r, sample.r);
-        g = MUL(g, sample.g);
-        b = MUL(b, sample.b);
+        if (depth16) {
+            store16_avx2(&depth16[x], z, mask, count);
+        } else {
+            _mm256_maskstore_epi32(&depth[x], mask, z);
+        }
+    }
+}
 
-        int rr = INT(MUL(r, FX(31.0f)));
-        int gg = INT(MUL(g, FX(63.0f)));
-        int bb = INT(MUL(b, FX(31.0f)));
+#endif  // SW_SIMD
 
-        (*draw_pixel_fn)(x, y, rr << 11 | gg << 5 | bb);
+sw_simd_t sw_set_simd(sw_simd_t simd) {
+#if SW_SIMD
+    __builtin_cpu_init();
+    if (simd == SW_SIMD_AVX2 && !__builtin_cpu_supports("avx2")) simd = SW_SIMD_SSE2;
+    if (simd == SW_SIMD_SSE2 && !__builtin_cpu_supports("sse2")) simd = SW_SIMD_NONE;
+#else
+    simd = SW_SIMD_NONE;
+#endif
+    g_simd = simd;
+    return simd;
+}
 
-        // write to depth buffer
-        depth_buffer[depth_index] = z;
+bool sw_set_texel_divisions(bool enabled) {
+    bool previous = g_texel_divisions;
+    g_texel_divisions = enabled;
+    return previous;
+}
+
+bool sw_set_alpha_test(bool enabled) {
+    bool previous = g_alpha_test;
+    g_alpha_test = enabled;
+    return previous;
+}
+
+int sw_set_persp_subdivision(int n) {
+    int previous_log2 = g_persp_subdivision_log2;
+    g_persp_subdivision_log2 = 0;
+    if (n == 8 || n == 16 || n == 32) {
+        while ((1 << g_persp_subdivision_log2) < n) g_persp_subdivision_log2++;
     }
-}
\ No newline at end of file
+    if (g_persp_subdivision_log2 != previous_log2) sw_touch_render_state();
+    return previous_log2 ? 1 << previous_log2 : 0;
+}
+
+unsigned sw_render_state_generation() { return g_render_state_generation; }
+
+void sw_touch_render_state() { g_render_state_generation++; }
+
+sw_span_shader_t sw_select_span_shader(const sw_fragment_state_t* state, const sw_target_t* target) {
+    if (state->persp_subdivision > 0) return select_subdivided_span_shader(state, target);
+#if SW_SIMD
+    bool is_single_texel = state->texture && !state->sampler.compressed &&
+                           state->sampler.width_log2 == 0 && state->sampler.height_log2 == 0;
+    if (g_simd == SW_SIMD_AVX2 && !g_texture_cache_stats_enabled && !g_texel_divisions && !is_single_texel)
+        return draw_span_avx2;
+#endif
+    return select_scalar_span_shader(state, target);
+}
@@ -0,0 +1,103 @@
+// sw_present.c
+// Copyright (c) 2021-2026 Daniel Cliche
+// SPDX-License-Identifier: MIT
+
+#include "sw_rasterizer.h"
+
+// SSE2 and AVX2 conversions
+#ifndef SW_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SW_SIMD 1
+#else
+#define SW_SIMD 0
+#endif
+#endif
+
+#if SW_SIMD
+#include <immintrin.h>
+#endif
+
+// (c * 527 + 23) >> 6 and (c * 259 + 33) >> 6 are the rounded expansions of 5 and 6 bits to 8 bits, they stay
+// within 16 bits
+static inline uint32_t convert_pixel(uint16_t c) {
+    uint32_t r = ((c >> 11) * 527 + 23) >> 6;
+    uint32_t g = (((c >> 5) & 0x3F) * 259 + 33) >> 6;
+    uint32_t b = ((c & 0x1F) * 527 + 23) >> 6;
+    return 0xFF000000 | r << 16 | g << 8 | b;
+}
+
+static void convert_row(const uint16_t* src, uint32_t* dst, int count) {
+    for (int i = 0; i < count; ++i) dst[i] = convert_pixel(src[i]);
+}
+
+#if SW_SIMD
+
+__attribute__((target("sse2"))) static void convert_row_sse2(const uint16_t* src, uint32_t* dst, int count) {
+    const __m128i mask5 = _mm_set1_epi16(0x1F), mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mul5 = _mm_set1_epi16(527), mul6 = _mm_set1_epi16(259);
+    const __m128i round5 = _mm_set1_epi16(23), round6 = _mm_set1_epi16(33);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i*)&src[i]);
+        __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(c, 11), mul5), round5), 6);
+        __m128i g =
+            _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(c, 5), mask6), mul6), round6), 6);
+        __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(c, mask5), mul5), round5), 6);
+        // low halves are G:B and high halves A:R
+        __m128i gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+        __m128i ar = _mm_or_si128(alpha, r);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_unpacklo_epi16(gb, ar));
+        _mm_storeu_si128((__m128i*)&dst[i + 4], _mm_unpackhi_epi16(gb, ar));
+    }
+    convert_row(&src[i], &dst[i], count - i);
+}
+
+__attribute__((target("avx2"))) static void convert_row_avx2(const uint16_t* src, uint32_t* dst, int count) {
+    const __m256i mask5 = _mm256_set1_epi16(0x1F), mask6 = _mm256_set1_epi16(0x3F);
+    const __m256i mul5 = _mm256_set1_epi16(527), mul6 = _mm256_set1_epi16(259);
+    const __m256i round5 = _mm256_set1_epi16(23), round6 = _mm256_set1_epi16(33);
+    const __m256i alpha = _mm256_set1_epi16((short)0xFF00);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // the unpacks work within 128-bit lanes, so the pixels are loaded as 0-3, 8-11 | 4-7, 12-15
+        __m256i c = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)&src[i]), 0xD8);
+        __m256i r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_srli_epi16(c, 11), mul5), round5), 6);
+        __m256i g = _mm256_srli_epi16(
+            _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(c, 5), mask6), mul6), round6), 6);
+        __m256i b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(c, mask5), mul5), round5), 6);
+        __m256i gb = _mm256_or_si256(_mm256_slli_epi16(g, 8), b);
+        __m256i ar = _mm256_or_si256(alpha, r);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_unpacklo_epi16(gb, ar));
+        _mm256_storeu_si256((__m256i*)&dst[i + 8], _mm256_unpackhi_epi16(gb, ar));
+    }
+    convert_row_sse2(&src[i], &dst[i], count - i);
+}
+
+#endif
+
+void sw_convert_rgb565_to_argb8888(const uint16_t* src, int src_pitch, uint32_t* dst, int dst_pitch, int width,
+                                   int height, sw_simd_t simd) {
+#if SW_SIMD
+    __builtin_cpu_init();
+    if (simd == SW_SIMD_AVX2 && !__builtin_cpu_supports("avx2")) simd = SW_SIMD_SSE2;
+    if (simd == SW_SIMD_SSE2 && !__builtin_cpu_supports("sse2")) simd = SW_SIMD_NONE;
+#else
+    simd = SW_SIMD_NONE;
+#endif
+    for (int y = 0; y < height; ++y) {
+        const uint16_t* src_row = &src[y * src_pitch];
+        uint32_t* dst_row = &dst[y * dst_pitch];
+#if SW_SIMD
+        if (simd == SW_SIMD_AVX2) {
+            convert_row_avx2(src_row, dst_row, width);
+            continue;
+        }
+        if (simd == SW_SIMD_SSE2) {
+            convert_row_sse2(src_row, dst_row, width);
+            continue;
+        }
+#endif
+        convert_row(src_row, dst_row, width);
+    }
+}
@@ -10,24 +10,221 @@
 
 typedef void (*draw_pixel_fn_t)(int x, int y, int color);
 
-void sw_init_rasterizer_standard(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn);
+typedef struct sw_depth_tiles sw_depth_tiles_t;
+
+// Render target of a rasterizer, e.g. to render offscreen into a texture. The pixels are written to the RGB565 color
+// buffer if set, with its pitch in pixels, otherwise they are passed to draw_pixel_fn. The depths are written to the
+// 16-bit depth buffer if set, otherwise to depth_buffer. The depth tiles of depth_buffer are optional.
+typedef struct {
+    int fb_width, fb_height;
+    draw_pixel_fn_t draw_pixel_fn;
+    fx32* depth_buffer;
+    uint16_t* depth_buffer16;
+    uint16_t* color_buffer;
+    int color_pitch;
+    sw_depth_tiles_t* depth_tiles;
+} sw_target_t;
+
+// Depth of the 16-bit depth buffer, quantized like the hardware: the 16 low bits of the depth with 14 fractional bits.
+// The depths from 4 wrap around.
+static inline uint16_t sw_depth16(fx32 z) {
+#if FIXED_POINT
+    return (uint16_t)z;
+#else
+    return (uint16_t)(int32_t)(z * (1 << 14));
+#endif
+}
+
+// Hierarchical depth of a depth buffer: the farthest depth of each tile of 8x8 pixels. The rasterizers skip the
+// triangles, then the blocks or spans of a triangle, whose nearest vertex is behind all the pixels of the tiles they
+// overlap, before any interpolation. The depth test only brings the depths nearer, the farthest depth of a tile written
+// with it remains a bound until it is computed again, when the tile is next tested with a refresh. The rasterizers
+// create the depth tiles of their own depth buffer, unless it has 16 bits: its depths wrap around and are not bounded
+// by the ones of the vertices.
+#define SW_DEPTH_TILE_SIZE_LOG2 3
+
+sw_depth_tiles_t* sw_create_depth_tiles(int fb_width, int fb_height);
+void sw_free_depth_tiles(sw_depth_tiles_t* tiles);
+// Reset the tiles of a depth buffer cleared to zero
+void sw_clear_depth_tiles(sw_depth_tiles_t* tiles);
+// Mark the tiles of the pixels x0 to x1 of the row y as written, with or without the depth test
+void sw_mark_depth_tiles(const sw_target_t* target, int x0, int x1, int y, bool depth_test);
+// Whether a triangle whose nearest vertex has depth z fails the depth test at all the pixels of the tiles overlapping
+// the pixels (x0, y0) to (x1, y1). The depths of the fragments may be rounded slightly above z, they are covered by a
+// margin. Without a refresh, the tiles written since their last refresh are tested against their bound, if any.
+bool sw_is_depth_occluded(const sw_target_t* target, int x0, int y0, int x1, int y1, fx32 z, bool refresh);
+
+// The depth buffer has 16 bits per pixel with depth16, like the hardware, 32 bits otherwise
+void sw_init_rasterizer_standard(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn, bool depth16);
 void sw_dispose_rasterizer_standard();
 void sw_clear_depth_buffer_standard();
+// Replace the render target, returns the previous one
+sw_target_t sw_set_target_standard(sw_target_t target);
 
-void sw_init_rasterizer_barycentric(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn);
+void sw_init_rasterizer_barycentric(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn, bool depth16);
 void sw_dispose_rasterizer_barycentric();
 void sw_clear_depth_buffer_barycentric();
+// Replace the render target, returns the previous one
+sw_target_t sw_set_target_barycentric(sw_target_t target);
+
+// Instruction sets of the span shaders and of the presentation. AVX2 shades 8 pixels at once, SSE2 only speeds up
+// the presentation and shades one pixel at a time like SW_SIMD_NONE.
+typedef enum { SW_SIMD_NONE, SW_SIMD_SSE2, SW_SIMD_AVX2 } sw_simd_t;
+
+// Select an instruction set for both rasterizers, limited to the ones supported by the CPU. Returns the selected one.
+// The rasterizers are initialized with the best one.
+sw_simd_t sw_set_simd(sw_simd_t simd);
+
+// Texture sampled by the fragment shaders, with ARGB4444 texels. Its sizes are powers of two, kept as their log2 to
+// address the texels with shifts and masks. The texels are stored in rows of tiles, each a row-major block of texels:
+// a linear texture is a single tile wide and a texel high. The texels of a compressed texture are its blocks, one per
+// tile, see block_texture.h.
+typedef struct {
+    const uint16_t* texels;
+    int width_log2, height_log2;
+    int tile_width_log2, tile_height_log2;
+    bool compressed;
+} sw_texture_t;
+
+// Layouts of the texels: row-major like the texture arrays, or in tiles of 4x4 texels, so that the texels sampled
+// across the rows are close in memory whatever the direction of the traversal, or in blocks of 4x4 texels compressed
+// to 4 bits per texel
+typedef enum { SW_TEXTURE_LINEAR, SW_TEXTURE_TILED, SW_TEXTURE_COMPRESSED } sw_texture_layout_t;
+
+// Bind the texture of the next triangles, the default texture if it or its data is NULL. The state of a triangle keeps
+// its texture, so a texture can be bound per draw. The copy of an uploaded texture is sampled. Returns false, keeping
+// the bound texture, if a size is not a power of two up to 2^14.
+bool sw_bind_texture(const texture_t* texture);
+
+// Textures which can be uploaded at once
+#ifndef SW_MAX_UPLOADED_TEXTURES
+#define SW_MAX_UPLOADED_TEXTURES 64
+#endif
+
+// Copy a texture, the default texture if NULL, in a layout for the sampler, with a mip chain if mipmaps, when it is
+// created or when its texels change. The levels are box filtered down to 1x1, then compressed with the compressed
+// layout. Returns false if the texture is invalid or if there are too many uploaded textures.
+bool sw_upload_texture(const texture_t* texture, sw_texture_layout_t layout, bool mipmaps);
+void sw_free_texture(const texture_t* texture);
+
+// Sample the uploaded textures which have a mip chain at a level selected per triangle, so that a texel covers about a
+// pixel. Disabled by default, the RTL samples the full size textures. Returns the previous setting.
+bool sw_set_mipmapping(bool enabled);
+
+// Count the texel fetches, the misses of a simulated 8-way set associative cache of SW_TEXTURE_CACHE_SIZE bytes with
+// lines of 64 bytes, and the fetches in another DRAM row of SW_TEXTURE_ROW_SIZE bytes than the previous one, like the
+// VRAM rows of the RTL. Disabled by default, the spans are then shaded by the scalar shaders only since the AVX2 lanes
+// fetch without counting, which slows the sampling down. Returns the previous setting.
+#ifndef SW_TEXTURE_CACHE_SIZE
+#define SW_TEXTURE_CACHE_SIZE 32768
+#endif
+
+#ifndef SW_TEXTURE_ROW_SIZE
+#define SW_TEXTURE_ROW_SIZE 1024
+#endif
+
+typedef struct {
+    size_t fetches, misses, row_switches;
+} sw_texture_cache_stats_t;
+
+bool sw_set_texture_cache_stats(bool enabled);
+sw_texture_cache_stats_t sw_get_texture_cache_stats(bool reset);
+
+// Decode the texel channels with a division each instead of a table lookup, like before the table, to measure it.
+// Disabled by default, the spans are then shaded by the scalar shaders only. Returns the previous setting.
+bool sw_set_texel_divisions(bool enabled);
+
+// Discard the fragments of the next triangles whose texel is transparent, without writing their depth, like the RTL
+// with the alpha test bit of OP_DRAW. Disabled by default, the transparent texels are then drawn black. Returns the
+// previous setting.
+bool sw_set_alpha_test(bool enabled);
+
+// Correct the perspective exactly every n pixels of a row, 8, 16 or 32, and interpolate the corrected attributes
+// linearly in between, or correct every pixel if n is 0. The RTL divides every n pixels too, but approximates 1/z with
+// its tangent in between, so the pixels of the two differ slightly in this mode. Returns the previous n.
+int sw_set_persp_subdivision(int n);
+
+// Generation of the settings which change the pixels of the next frames: the uploaded textures, the mipmapping, the
+// perspective subdivision and the rasterizer costs. Their setters increment it when they change a setting, so that a
+// frame whose draws and generation are unchanged can be skipped. The state set per draw, the bound texture and the
+// alpha test, follows from the draws.
+unsigned sw_render_state_generation();
+void sw_touch_render_state();
+
+// Generate a span shader for each combination of render state. This is only worth its code size in builds optimized
+// for speed, otherwise a single shader tests the state of each fragment.
+#ifndef SW_SPECIALIZE_FRAGMENTS
+#if defined(__OPTIMIZE__) && !defined(__OPTIMIZE_SIZE__)
+#define SW_SPECIALIZE_FRAGMENTS 1
+#else
+#define SW_SPECIALIZE_FRAGMENTS 0
+#endif
+#endif
+
+#ifndef ALWAYS_INLINE
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+#endif
+
+typedef struct sw_fragment_state sw_fragment_state_t;
+
+// RGB565 color of a fragment which passed the depth test, -1 if it is discarded by the alpha test
+typedef int (*sw_shade_kernel_t)(const sw_fragment_state_t* state, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b);
+
+// Render state of the fragments of a triangle. The colors are constant when they are the same at the three vertices,
+// the span shaders then skip their steps when the interpolation does not change them. Only the texture has alpha.
+struct sw_fragment_state {
+    bool texture, clamp_s, clamp_t, depth_test, persp_correct;
+    bool alpha_test;  // discard the fragments of the transparent texels, if textured
+    bool constant_color;
+    int persp_subdivision;  // pixels between the exact corrections, 0 if every pixel is corrected
+    unsigned persp_triangle;  // identifies the triangle of the segments of the rows, if subdivided
+    sw_texture_t sampler;   // bound texture, if textured
+
+    // shade kernels specialized for the state, and for fragments already corrected for the perspective with
+    // interpolated colors
+    sw_shade_kernel_t shade, shade_corrected;
+};
+
+// Fragments of a row from x to x + count - 1, within the target. The attributes are given at x with their increments
+// per pixel, perspective divided when the state corrects the perspective. The texture coordinates or the colors are
+// ignored when the state does not use them.
+typedef struct {
+    int x, y, count;
+    fx32 z, u, v, r, g, b;
+    fx32 dz, du, dv, dr, dg, db;
+} sw_span_t;
+
+// Depth test, perspective correction, texture sampling, alpha test and write of the fragments of a span. The
+// attributes are stepped by additions and the depth and color buffers are accessed contiguously.
+typedef void (*sw_span_shader_t)(const sw_fragment_state_t* state, const sw_target_t* target, const sw_span_t* span);
+
+// State of a triangle with its shade kernels
+sw_fragment_state_t sw_fragment_state(bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct,
+                                      fx32 r[3], fx32 g[3], fx32 b[3]);
+// Select the mip level sampled by a triangle from its texels per pixel, with the positions and the texture coordinates
+// of its vertices, perspective divided when the state corrects the perspective
+void sw_select_mip_level(sw_fragment_state_t* state, const fx32 x[3], const fx32 y[3], const fx32 z[3],
+                         const fx32 u[3], const fx32 v[3]);
+// Span shader specialized for a state and the instruction set, selected once per triangle
+sw_span_shader_t sw_select_span_shader(const sw_fragment_state_t* state, const sw_target_t* target);
 
-void sw_fragment_shader(int fb_width, int fb_height, int x, int y, fx32 z, fx32 u, fx32 v, fx32 r, fx32 g, fx32 b, fx32 a, bool clamp_s, bool clamp_t, bool depth_test, bool texture, fx32* depth_buffer, bool persp_correct, draw_pixel_fn_t draw_pixel_fn);
+// Convert a RGB565 frame to ARGB8888 for presentation, with the pitches in pixels. The channels are expanded with
+// rounding, as (c * 255 + 15) / 31 for 5 bits. The instruction set is lowered to what the CPU supports.
+void sw_convert_rgb565_to_argb8888(const uint16_t* src, int src_pitch, uint32_t* dst, int dst_pitch, int width,
+                                   int height, sw_simd_t simd);
 
-void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0, fx32 a0,
-                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1, fx32 a1,
-                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2, fx32 a2,
+void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0,
+                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1,
+                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2,
                       bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct);
 
-void sw_draw_triangle_barycentric(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0, fx32 a0,
-                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1, fx32 a1,
-                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2, fx32 a2,
+void sw_draw_triangle_barycentric(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0,
+                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1,
+                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2,
                       bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct);
 
 #endif  // SW_RASTERIZER_H
\ No newline at end of file
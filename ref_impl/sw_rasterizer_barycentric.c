@@ -18,17 +18,65 @@ static int g_fb_width, g_fb_height;
 static draw_pixel_fn_t g_draw_pixel_fn;
 
 fx32* g_depth_buffer;
+static uint16_t* g_depth_buffer16;
+static sw_depth_tiles_t* g_depth_tiles;
 
-void sw_init_rasterizer_barycentric(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn) {
+static uint16_t* g_color_buffer;
+static int g_color_pitch;
+
+void sw_init_rasterizer_barycentric(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn, bool depth16) {
     g_fb_width = fb_width;
     g_fb_height = fb_height;
-    g_depth_buffer = (fx32*)malloc(fb_width * fb_height * sizeof(fx32));
+    g_depth_buffer = depth16 ? NULL : (fx32*)malloc(fb_width * fb_height * sizeof(fx32));
+    g_depth_buffer16 = depth16 ? (uint16_t*)malloc(fb_width * fb_height * sizeof(uint16_t)) : NULL;
+    g_depth_tiles = depth16 ? NULL : sw_create_depth_tiles(fb_width, fb_height);
     g_draw_pixel_fn = draw_pixel_fn;
+    sw_set_simd(SW_SIMD_AVX2);
+}
+
+void sw_dispose_rasterizer_barycentric() {
+    free(g_depth_buffer);
+    free(g_depth_buffer16);
+    sw_free_depth_tiles(g_depth_tiles);
+}
+
+void sw_clear_depth_buffer_barycentric() {
+    if (g_depth_buffer16)
+        memset(g_depth_buffer16, 0, g_fb_width * g_fb_height * sizeof(uint16_t));
+    else
+        memset(g_depth_buffer, FX(0.0f), g_fb_width * g_fb_height * sizeof(fx32));
+    if (g_depth_tiles) sw_clear_depth_tiles(g_depth_tiles);
 }
 
-void sw_dispose_rasterizer_barycentric() { free(g_depth_buffer); }
+sw_target_t sw_set_target_barycentric(sw_target_t target) {
+    sw_target_t previous = {g_fb_width,       g_fb_height,    g_draw_pixel_fn, g_depth_buffer,
+                            g_depth_buffer16, g_color_buffer, g_color_pitch,   g_depth_tiles};
+    g_fb_width = target.fb_width;
+    g_fb_height = target.fb_height;
+    g_draw_pixel_fn = target.draw_pixel_fn;
+    g_depth_buffer = target.depth_buffer;
+    g_depth_buffer16 = target.depth_buffer16;
+    g_color_buffer = target.color_buffer;
+    g_color_pitch = target.color_pitch;
+    g_depth_tiles = target.depth_tiles;
+    return previous;
+}
+
+#define BLOCK_SIZE 8
 
-void sw_clear_depth_buffer_barycentric() { memset(g_depth_buffer, FX(0.0f), g_fb_width * g_fb_height * sizeof(fx32)); }
+typedef struct {
+    fx32 z[3];
+    fx32 u[3], v[3];
+    fx32 r[3], g[3], b[3];
+    fx32 inv_area;
+    fx32 nearest_z;   // of the vertices
+    bool test_tiles;  // against the depth tiles
+    // increments of the attributes per pixel
+    fx32 dz, du, dv, dr, dg, db;
+    sw_fragment_state_t state;
+    sw_target_t target;
+    sw_span_shader_t shader;
+} triangle_params_t;
 
 static fx32 reciprocal(fx32 x) {
     return x > 0 ? DIV(FX(RECIPROCAL_NUMERATOR), x) : FX(RECIPROCAL_NUMERATOR);
@@ -46,22 +94,63 @@ static int min3(int a, int b, int c) { return min(a, min(b, c)); }
 
 static int max3(int a, int b, int c) { return max(a, max(b, c)); }
 
-void sw_draw_triangle_barycentric(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0, fx32 a0,
-                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1, fx32 a1,
-                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2, fx32 a2,
-                      bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct)
-{
-    fx32 vv0[3] = {x0, y0, z0};
-    fx32 vv1[3] = {x1, y1, z1};
-    fx32 vv2[3] = {x2, y2, z2};
+static fx32 minf4(fx32 a, fx32 b, fx32 c, fx32 d) {
+    fx32 m = a < b ? a : b;
+    m = m < c ? m : c;
+    return m < d ? m : d;
+}
+
+static fx32 maxf4(fx32 a, fx32 b, fx32 c, fx32 d) {
+    fx32 m = a > b ? a : b;
+    m = m > c ? m : c;
+    return m > d ? m : d;
+}
+
+// Increment per pixel of an attribute interpolated with the weights, which are the edge functions scaled by inv_area
+static fx32 gradient(fx32 attr[3], fx32 e_dx[3], fx32 inv_area) {
+    fx32 d = FX(0.0f);
+    for (int i = 0; i < 3; ++i) d += MUL(MUL(e_dx[i], inv_area), attr[i]);
+    return DIV(d, FX(RECIPROCAL_NUMERATOR));
+}
 
-    fx32 c0[4] = {r0, g0, b0, a0};
-    fx32 c1[4] = {r1, g1, b1, a1};
-    fx32 c2[4] = {r2, g2, b2, a2};
+// Span of the covered pixels from x to last_x, with the edge functions e at x. The attributes are interpolated at its
+// first pixel, without the ones unused by the state, and stepped by the span shader.
+static void draw_span(int x, int last_x, int y, fx32 e[3], triangle_params_t* p) {
+    fx32 w0 = DIV(MUL(e[0], p->inv_area), FX(RECIPROCAL_NUMERATOR));
+    fx32 w1 = DIV(MUL(e[1], p->inv_area), FX(RECIPROCAL_NUMERATOR));
+    fx32 w2 = DIV(MUL(e[2], p->inv_area), FX(RECIPROCAL_NUMERATOR));
+
+    sw_span_t span = {0};
+    span.x = x;
+    span.y = y;
+    span.count = last_x - x + 1;
+    span.z = MUL(w0, p->z[0]) + MUL(w1, p->z[1]) + MUL(w2, p->z[2]);
+    span.dz = p->dz;
+    if (p->state.texture) {
+        span.u = MUL(w0, p->u[0]) + MUL(w1, p->u[1]) + MUL(w2, p->u[2]);
+        span.v = MUL(w0, p->v[0]) + MUL(w1, p->v[1]) + MUL(w2, p->v[2]);
+        span.du = p->du;
+        span.dv = p->dv;
+    }
+    span.r = MUL(w0, p->r[0]) + MUL(w1, p->r[1]) + MUL(w2, p->r[2]);
+    span.g = MUL(w0, p->g[0]) + MUL(w1, p->g[1]) + MUL(w2, p->g[2]);
+    span.b = MUL(w0, p->b[0]) + MUL(w1, p->b[1]) + MUL(w2, p->b[2]);
+    span.dr = p->dr;
+    span.dg = p->dg;
+    span.db = p->db;
+
+    p->shader(&p->state, &p->target, &span);
+    if (p->target.depth_tiles) sw_mark_depth_tiles(&p->target, x, last_x, y, p->state.depth_test);
+}
 
-    fx32 t0[3] = {u0, v0, FX(0.0f)};
-    fx32 t1[3] = {u1, v1, FX(0.0f)};
-    fx32 t2[3] = {u2, v2, FX(0.0f)};
+void sw_draw_triangle_barycentric(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, fx32 r0, fx32 g0, fx32 b0,
+                      fx32 x1, fx32 y1, fx32 z1, fx32 u1, fx32 v1, fx32 r1, fx32 g1, fx32 b1,
+                      fx32 x2, fx32 y2, fx32 z2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2,
+                      bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct)
+{
+    fx32 vv0[2] = {x0, y0};
+    fx32 vv1[2] = {x1, y1};
+    fx32 vv2[2] = {x2, y2};
 
     int min_x = min3(INT(x0), INT(x1), INT(x2));
     int min_y = min3(INT(y0), INT(y1), INT(y2));
@@ -72,34 +161,93 @@ void sw_draw_triangle_barycentric(fx32 x0, fx32 y0, fx32 z0, fx32 u0, fx32 v0, f
     min_y = max(min_y, 0);
     max_x = min(max_x, g_fb_width - 1);
     max_y = min(max_y, g_fb_height - 1);
+    if (min_x > max_x || min_y > max_y) return;
+
+    // the triangle is skipped before its setup if it is behind the tiles of its bounding box
+    sw_target_t target = {g_fb_width,       g_fb_height,    g_draw_pixel_fn, g_depth_buffer,
+                          g_depth_buffer16, g_color_buffer, g_color_pitch,   g_depth_tiles};
+    fx32 nearest_z = z0 > z1 ? (z0 > z2 ? z0 : z2) : (z1 > z2 ? z1 : z2);
+    bool test_tiles = depth_test && g_depth_tiles;
+    if (test_tiles && sw_is_depth_occluded(&target, min_x, min_y, max_x, max_y, nearest_z, true)) return;
+
+    // the increments, the state, the target and the shader are set up below
+    triangle_params_t p = {{z0, z1, z2}, {u0, u1, u2}, {v0, v1, v2}, {r0, r1, r2}, {g0, g1, g2}, {b0, b1, b2},
+                           reciprocal(edge_function(vv0, vv1, vv2)), nearest_z, test_tiles, 0, 0, 0, 0, 0, 0, {0}, {0},
+                           NULL};
+    p.state = sw_fragment_state(texture, clamp_s, clamp_t, depth_test, persp_correct, p.r, p.g, p.b);
+    sw_select_mip_level(&p.state, (fx32[3]){x0, x1, x2}, (fx32[3]){y0, y1, y2}, p.z, p.u, p.v);
+    p.target = target;
+    p.shader = sw_select_span_shader(&p.state, &p.target);
+
+    // The edge functions are affine in x and y, they are stepped by their increments per pixel and per row. In fixed
+    // point, a step of FXI(1) adds the exact increment to the product so that the values match a direct evaluation.
+    fx32 origin[2] = {FXI(min_x), FXI(min_y)};
+    fx32 e_origin[3] = {edge_function(vv1, vv2, origin), edge_function(vv2, vv0, origin),
+                        edge_function(vv0, vv1, origin)};
+    fx32 e_dx[3] = {y2 - y1, y0 - y2, y1 - y0};
+    fx32 e_dy[3] = {x1 - x2, x2 - x0, x0 - x1};
+
+    p.dz = gradient(p.z, e_dx, p.inv_area);
+    p.du = gradient(p.u, e_dx, p.inv_area);
+    p.dv = gradient(p.v, e_dx, p.inv_area);
+    p.dr = gradient(p.r, e_dx, p.inv_area);
+    p.dg = gradient(p.g, e_dx, p.inv_area);
+    p.db = gradient(p.b, e_dx, p.inv_area);
+
+    // Blocks of BLOCK_SIZE x BLOCK_SIZE pixels are tested at their corners. The minimum of an edge function over a block
+    // is at one of its corners, the block is skipped if it is outside of an edge and drawn without tests if it is
+    // inside of all of them. It is also skipped if it is behind the depth tiles it overlaps.
+    fx32 e_block_row[3] = {e_origin[0], e_origin[1], e_origin[2]};
+    for (int by = min_y; by <= max_y; by += BLOCK_SIZE) {
+        int last_y = min(by + BLOCK_SIZE - 1, max_y);
+        fx32 e_block[3] = {e_block_row[0], e_block_row[1], e_block_row[2]};
+        for (int bx = min_x; bx <= max_x; bx += BLOCK_SIZE) {
+            int last_x = min(bx + BLOCK_SIZE - 1, max_x);
+
+            bool is_outside = false, is_inside = true;
+            for (int i = 0; i < 3; ++i) {
+                fx32 c00 = e_block[i];
+                fx32 c10 = c00 + (last_x - bx) * e_dx[i];
+                fx32 c01 = c00 + (last_y - by) * e_dy[i];
+                fx32 c11 = c10 + (last_y - by) * e_dy[i];
+                if (maxf4(c00, c10, c01, c11) < FX(0.0f)) is_outside = true;
+                if (minf4(c00, c10, c01, c11) < FX(0.0f)) is_inside = false;
+            }
 
-    fx32 area = edge_function(vv0, vv1, vv2);
-
-    for (int y = min_y; y <= max_y; ++y)
-        for (int x = min_x; x <= max_x; ++x) {
-            fx32 pixel_sample[2] = {FXI(x), FXI(y)};
-            fx32 w0 = edge_function(vv1, vv2, pixel_sample);
-            fx32 w1 = edge_function(vv2, vv0, pixel_sample);
-            fx32 w2 = edge_function(vv0, vv1, pixel_sample);
-            if (w0 >= FX(0.0f) && w1 >= FX(0.0f) && w2 >= FX(0.0f)) {
-                fx32 inv_area = reciprocal(area);
-                w0 = MUL(w0, inv_area);
-                w0 = DIV(w0, FX(RECIPROCAL_NUMERATOR));
-                w1 = MUL(w1, inv_area);
-                w1 = DIV(w1, FX(RECIPROCAL_NUMERATOR));
-                w2 = MUL(w2, inv_area);
-                w2 = DIV(w2, FX(RECIPROCAL_NUMERATOR));
-                fx32 u = MUL(w0, t0[0]) + MUL(w1, t1[0]) + MUL(w2, t2[0]);
-                fx32 v = MUL(w0, t0[1]) + MUL(w1, t1[1]) + MUL(w2, t2[1]);
-                fx32 r = MUL(w0, c0[0]) + MUL(w1, c1[0]) + MUL(w2, c2[0]);
-                fx32 g = MUL(w0, c0[1]) + MUL(w1, c1[1]) + MUL(w2, c2[1]);
-                fx32 b = MUL(w0, c0[2]) + MUL(w1, c1[2]) + MUL(w2, c2[2]);
-                fx32 a = MUL(w0, c0[3]) + MUL(w1, c1[3]) + MUL(w2, c2[3]);
-
-                // Perspective correction
-                fx32 z = MUL(w0, vv0[2]) + MUL(w1, vv1[2]) + MUL(w2, vv2[2]);
-
-                sw_fragment_shader(g_fb_width, g_fb_height, x, y, z, u, v, r, g, b, a, clamp_s, clamp_t, depth_test, texture, g_depth_buffer, persp_correct, g_draw_pixel_fn);
+            // the tiles are refreshed by the triangles, not by each of their blocks
+            bool is_occluded = !is_outside && p.test_tiles &&
+                               sw_is_depth_occluded(&p.target, bx, by, last_x, last_y, p.nearest_z, false);
+
+            if (!is_outside && !is_occluded) {
+                // the covered pixels of a row are contiguous, the triangle is convex
+                fx32 e_row[3] = {e_block[0], e_block[1], e_block[2]};
+                for (int y = by; y <= last_y; ++y) {
+                    if (is_inside) {
+                        draw_span(bx, last_x, y, e_row, &p);
+                    } else {
+                        fx32 e[3] = {e_row[0], e_row[1], e_row[2]};
+                        int first = -1, last = -1;
+                        fx32 e_first[3];
+                        for (int x = bx; x <= last_x; ++x) {
+                            if (e[0] >= FX(0.0f) && e[1] >= FX(0.0f) && e[2] >= FX(0.0f)) {
+                                if (first < 0) {
+                                    first = x;
+                                    for (int i = 0; i < 3; ++i) e_first[i] = e[i];
+                                }
+                                last = x;
+                            } else if (first >= 0) {
+                                break;
+                            }
+                            for (int i = 0; i < 3; ++i) e[i] += e_dx[i];
+                        }
+                        if (first >= 0) draw_span(first, last, y, e_first, &p);
+                    }
+                    for (int i = 0; i < 3; ++i) e_row[i] += e_dy[i];
+                }
             }
+
+            for (int i = 0; i < 3; ++i) e_block[i] += BLOCK_SIZE * e_dx[i];
         }
+        for (int i = 0; i < 3; ++i) e_block_row[i] += BLOCK_SIZE * e_dy[i];
+    }
 }
@@ -12,36 +12,74 @@ static int g_fb_width, g_fb_height;
 static draw_pixel_fn_t g_draw_pixel_fn;
 
 static fx32* g_depth_buffer;
+static uint16_t* g_depth_buffer16;
+static sw_depth_tiles_t* g_depth_tiles;
+static uint16_t* g_color_buffer;
+static int g_color_pitch;
 
 typedef struct {
     int y0, y1, y2;
     int x0, x1;
     fx32 s0, t0, w0;
     fx32 s1, t1, w1;
-    fx32 r0, g0, b0, a0;
-    fx32 r1, g1, b1, a1;
+    fx32 r0, g0, b0;
+    fx32 r1, g1, b1;
     fx32 dax_step, dbx_step;
     fx32 ds0_step, dt0_step, dw0_step;
     fx32 ds1_step, dt1_step, dw1_step;
-    fx32 dr0_step, dg0_step, db0_step, da0_step;
-    fx32 dr1_step, dg1_step, db1_step, da1_step;
+    fx32 dr0_step, dg0_step, db0_step;
+    fx32 dr1_step, dg1_step, db1_step;
     bool bottom_half;
-    bool tex;
-    bool persp_correct;
-    bool clamp_s, clamp_t;
-    bool depth_test;
+    fx32 nearest_w;   // of the vertices
+    bool test_tiles;  // against the depth tiles
+    sw_fragment_state_t state;
+    sw_target_t target;
+    sw_span_shader_t shader;
 } rasterize_triangle_half_params_t;
 
-void sw_init_rasterizer_standard(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn) {
+// attributes at an end of a span
+typedef struct {
+    fx32 s, t, w;
+    fx32 r, g, b;
+} span_end_t;
+
+void sw_init_rasterizer_standard(int fb_width, int fb_height, draw_pixel_fn_t draw_pixel_fn, bool depth16) {
     g_fb_width = fb_width;
     g_fb_height = fb_height;
-    g_depth_buffer = (fx32*)malloc(fb_width * fb_height * sizeof(fx32));
+    g_depth_buffer = depth16 ? NULL : (fx32*)malloc(fb_width * fb_height * sizeof(fx32));
+    g_depth_buffer16 = depth16 ? (uint16_t*)malloc(fb_width * fb_height * sizeof(uint16_t)) : NULL;
+    g_depth_tiles = depth16 ? NULL : sw_create_depth_tiles(fb_width, fb_height);
     g_draw_pixel_fn = draw_pixel_fn;
+    sw_set_simd(SW_SIMD_AVX2);
+}
+
+void sw_dispose_rasterizer_standard() {
+    free(g_depth_buffer);
+    free(g_depth_buffer16);
+    sw_free_depth_tiles(g_depth_tiles);
 }
 
-void sw_dispose_rasterizer_standard() { free(g_depth_buffer); }
+void sw_clear_depth_buffer_standard() {
+    if (g_depth_buffer16)
+        memset(g_depth_buffer16, 0, g_fb_width * g_fb_height * sizeof(uint16_t));
+    else
+        memset(g_depth_buffer, FX(0.0f), g_fb_width * g_fb_height * sizeof(fx32));
+    if (g_depth_tiles) sw_clear_depth_tiles(g_depth_tiles);
+}
 
-void sw_clear_depth_buffer_standard() { memset(g_depth_buffer, FX(0.0f), g_fb_width * g_fb_height * sizeof(fx32)); }
+sw_target_t sw_set_target_standard(sw_target_t target) {
+    sw_target_t previous = {g_fb_width,       g_fb_height,    g_draw_pixel_fn, g_depth_buffer,
+                            g_depth_buffer16, g_color_buffer, g_color_pitch,   g_depth_tiles};
+    g_fb_width = target.fb_width;
+    g_fb_height = target.fb_height;
+    g_draw_pixel_fn = target.draw_pixel_fn;
+    g_depth_buffer = target.depth_buffer;
+    g_depth_buffer16 = target.depth_buffer16;
+    g_color_buffer = target.color_buffer;
+    g_color_pitch = target.color_pitch;
+    g_depth_tiles = target.depth_tiles;
+    return previous;
+}
 
 void swapi(int* a, int* b) {
     int t = *a;
@@ -55,9 +93,54 @@ void swapf(fx32* a, fx32* b) {
     *b = t;
 }
 
+// Spans of at most SPAN_LENGTH pixels, whose first attributes are interpolated between the ends so that the additive
+// steps of the span shader do not drift
+#define SPAN_LENGTH 16
+
+// Row from ax to bx excluded, clipped to the target. The attributes unused by the state of the triangle are not
+// interpolated, nor the spans behind the depth tiles they overlap.
+static void draw_row(int ax, int bx, int y, span_end_t* start, span_end_t* end, rasterize_triangle_half_params_t* p) {
+    if (bx <= ax) return;
+    fx32 tstep = DIV(FX(1.0f), FXI(bx - ax));
+    fx32 n = FXI(bx - ax);
+
+    sw_span_t span = {0};
+    span.y = y;
+    span.dz = DIV(end->w - start->w, n);
+    if (p->state.texture) {
+        span.du = DIV(end->s - start->s, n);
+        span.dv = DIV(end->t - start->t, n);
+    }
+    span.dr = DIV(end->r - start->r, n);
+    span.dg = DIV(end->g - start->g, n);
+    span.db = DIV(end->b - start->b, n);
+
+    int last_x = bx > p->target.fb_width ? p->target.fb_width : bx;
+    for (int x = ax < 0 ? 0 : ax; x < last_x; x += SPAN_LENGTH) {
+        // the steps are integer additions, the interpolation factor of a pixel is a product
+        fx32 tt = (x - ax) * tstep;
+        span.x = x;
+        span.count = last_x - x < SPAN_LENGTH ? last_x - x : SPAN_LENGTH;
+        // the tiles are refreshed by the triangles, not by each of the rows of their pixels
+        if (p->test_tiles && sw_is_depth_occluded(&p->target, x, y, x + span.count - 1, y, p->nearest_w, false))
+            continue;
+        span.z = MUL(FX(1.0f) - tt, start->w) + MUL(tt, end->w);
+        if (p->state.texture) {
+            span.u = MUL(FX(1.0f) - tt, start->s) + MUL(tt, end->s);
+            span.v = MUL(FX(1.0f) - tt, start->t) + MUL(tt, end->t);
+        }
+        span.r = MUL(FX(1.0f) - tt, start->r) + MUL(tt, end->r);
+        span.g = MUL(FX(1.0f) - tt, start->g) + MUL(tt, end->g);
+        span.b = MUL(FX(1.0f) - tt, start->b) + MUL(tt, end->b);
+
+        p->shader(&p->state, &p->target, &span);
+        if (p->target.depth_tiles) sw_mark_depth_tiles(&p->target, x, x + span.count - 1, y, p->state.depth_test);
+    }
+}
+
 void rasterize_triangle_half(bool bottom_half, rasterize_triangle_half_params_t* p) {
     int sy, ey, sx;
-    fx32 ss, st, sw, sr, sg, sb, sa;
+    fx32 ss, st, sw, sr, sg, sb;
 
     if (bottom_half) {
         sy = p->y1;
@@ -69,7 +152,6 @@ void rasterize_triangle_half(bool bottom_half, rasterize_triangle_half_params_t*
         sr = p->r1;
         sg = p->g1;
         sb = p->b1;
-        sa = p->a1;
     } else {
         // top half
         sy = p->y0;
@@ -81,10 +163,12 @@ void rasterize_triangle_half(bool bottom_half, rasterize_triangle_half_params_t*
         sr = p->r0;
         sg = p->g0;
         sb = p->b0;
-        sa = p->a0;
     }
 
     for (int y = sy; y <= ey; y++) {
+        // rows outside of the target
+        if (y < 0 || y >= p->target.fb_height) continue;
+
         int ax = INT(FXI(sx) + MUL(FXI(y - sy), p->dax_step));
         int bx = INT(FXI(p->x0) + MUL(FXI(y - p->y0), p->dbx_step));
 
@@ -99,12 +183,10 @@ void rasterize_triangle_half(bool bottom_half, rasterize_triangle_half_params_t*
         fx32 col_sr = sr + MUL(FXI(y - sy), p->dr0_step);
         fx32 col_sg = sg + MUL(FXI(y - sy), p->dg0_step);
         fx32 col_sb = sb + MUL(FXI(y - sy), p->db0_step);
-        fx32 col_sa = sa + MUL(FXI(y - sy), p->da0_step);
 
         fx32 col_er = p->r0 + MUL(FXI(y - p->y0), p->dr1_step);
         fx32 col_eg = p->g0 + MUL(FXI(y - p->y0), p->dg1_step);
         fx32 col_eb = p->b0 + MUL(FXI(y - p->y0), p->db1_step);
-        fx32 col_ea = p->a0 + MUL(FXI(y - p->y0), p->da1_step);
 
         if (ax > bx) {
             swapi(&ax, &bx);
@@ -115,42 +197,41 @@ void rasterize_triangle_half(bool bottom_half, rasterize_triangle_half_params_t*
             swapf(&col_sr, &col_er);
             swapf(&col_sg, &col_eg);
             swapf(&col_sb, &col_eb);
-            swapf(&col_sa, &col_ea);
         }
 
-        fx32 s = tex_ss;
-        fx32 t = tex_st;
-        fx32 z = tex_sw;
-
-        fx32 r = col_sr;
-        fx32 g = col_sg;
-        fx32 b = col_sb;
-        fx32 a = col_sa;
-
-        fx32 tstep = FXI(bx - ax) > 0 ? DIV(FX(1.0f), FXI(bx - ax)) : 0;
-        fx32 tt = FX(0.0f);
-
-        for (int x = ax; x < bx; x++) {
-            s = MUL(FX(1.0f) - tt, tex_ss) + MUL(tt, tex_es);
-            t = MUL(FX(1.0f) - tt, tex_st) + MUL(tt, tex_et);
-            z = MUL(FX(1.0f) - tt, tex_sw) + MUL(tt, tex_ew);
-
-            r = MUL(FX(1.0f) - tt, col_sr) + MUL(tt, col_er);
-            g = MUL(FX(1.0f) - tt, col_sg) + MUL(tt, col_eg);
-            b = MUL(FX(1.0f) - tt, col_sb) + MUL(tt, col_eb);
-            a = MUL(FX(1.0f) - tt, col_sa) + MUL(tt, col_ea);
-
-            sw_fragment_shader(g_fb_width, g_fb_height, x, y, z, s, t, r, g, b, a, p->clamp_s, p->clamp_t, p->depth_test, p->tex, g_depth_buffer, p->persp_correct, g_draw_pixel_fn);
-
-            tt += tstep;
-        }
+        span_end_t start = {tex_ss, tex_st, tex_sw, col_sr, col_sg, col_sb};
+        span_end_t end = {tex_es, tex_et, tex_ew, col_er, col_eg, col_eb};
+        draw_row(ax, bx, y, &start, &end, p);
     }
 }
 
-void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32 r0, fx32 g0, fx32 b0, fx32 a0,
-                      fx32 x1, fx32 y1, fx32 w1, fx32 s1, fx32 t1, fx32 r1, fx32 g1, fx32 b1, fx32 a1,
-                      fx32 x2, fx32 y2, fx32 w2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2, fx32 a2,
+void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32 r0, fx32 g0, fx32 b0,
+                      fx32 x1, fx32 y1, fx32 w1, fx32 s1, fx32 t1, fx32 r1, fx32 g1, fx32 b1,
+                      fx32 x2, fx32 y2, fx32 w2, fx32 u2, fx32 v2, fx32 r2, fx32 g2, fx32 b2,
                       bool texture, bool clamp_s, bool clamp_t, bool depth_test, bool persp_correct) {
+    // vertices in their original order, for the mip level selection
+    fx32 vx[3] = {x0, x1, x2}, vy[3] = {y0, y1, y2}, vw[3] = {w0, w1, w2}, vs[3] = {s0, s1, u2}, vt[3] = {t0, t1, v2};
+
+    // the triangle is skipped before its setup if it is behind the tiles of its bounding box within the target
+    sw_target_t target = {g_fb_width,       g_fb_height,    g_draw_pixel_fn, g_depth_buffer,
+                          g_depth_buffer16, g_color_buffer, g_color_pitch,   g_depth_tiles};
+    fx32 nearest_w = w0 > w1 ? (w0 > w2 ? w0 : w2) : (w1 > w2 ? w1 : w2);
+    bool test_tiles = depth_test && g_depth_tiles;
+    if (test_tiles) {
+        int min_x = INT(x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2));
+        int min_y = INT(y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2));
+        int max_x = INT(x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2));
+        int max_y = INT(y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2));
+        // one pixel around, for the rounding of the edge steps
+        min_x = min_x > 0 ? min_x - 1 : 0;
+        min_y = min_y > 0 ? min_y - 1 : 0;
+        max_x = max_x < g_fb_width - 1 ? max_x + 1 : g_fb_width - 1;
+        max_y = max_y < g_fb_height - 1 ? max_y + 1 : g_fb_height - 1;
+        if (min_x <= max_x && min_y <= max_y &&
+            sw_is_depth_occluded(&target, min_x, min_y, max_x, max_y, nearest_w, true))
+            return;
+    }
+
     int xx0 = INT(x0);
     int yy0 = INT(y0);
     int xx1 = INT(x1);
@@ -167,7 +248,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
         swapf(&r0, &r1);
         swapf(&g0, &g1);
         swapf(&b0, &b1);
-        swapf(&a0, &a1);
     }
 
     if (yy2 < yy0) {
@@ -179,7 +259,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
         swapf(&r0, &r2);
         swapf(&g0, &g2);
         swapf(&b0, &b2);
-        swapf(&a0, &a2);
     }
 
     if (yy2 < yy1) {
@@ -191,7 +270,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
         swapf(&r1, &r2);
         swapf(&g1, &g2);
         swapf(&b1, &b2);
-        swapf(&a1, &a2);
     }
 
     rasterize_triangle_half_params_t p;
@@ -210,17 +288,17 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     p.r0 = r0;
     p.g0 = g0;
     p.b0 = b0;
-    p.a0 = a0;
     p.r1 = r1;
     p.g1 = g1;
     p.b1 = b1;
-    p.a1 = a1;
+    p.nearest_w = nearest_w;
+    p.test_tiles = test_tiles;
 
-    p.tex = texture;
-    p.persp_correct = persp_correct;
-    p.clamp_s = clamp_s;
-    p.clamp_t = clamp_t;
-    p.depth_test = depth_test;
+    fx32 r[3] = {r0, r1, r2}, g[3] = {g0, g1, g2}, b[3] = {b0, b1, b2};
+    p.state = sw_fragment_state(texture, clamp_s, clamp_t, depth_test, persp_correct, r, g, b);
+    sw_select_mip_level(&p.state, vx, vy, vw, vs, vt);
+    p.target = target;
+    p.shader = sw_select_span_shader(&p.state, &p.target);
 
     // rasterize top half
 
@@ -233,7 +311,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     fx32 dr0 = r1 - r0;
     fx32 dg0 = g1 - g0;
     fx32 db0 = b1 - b0;
-    fx32 da0 = a1 - a0;
 
     int dy1 = yy2 - yy0;
     int dx1 = xx2 - xx0;
@@ -244,7 +321,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     fx32 dr1 = r2 - r0;
     fx32 dg1 = g2 - g0;
     fx32 db1 = b2 - b0;
-    fx32 da1 = a2 - a0;
 
     if (dy0) p.dax_step = DIV(FXI(dx0), FXI(abs(dy0)));
     if (dy1) p.dbx_step = DIV(FXI(dx1), FXI(abs(dy1)));
@@ -260,12 +336,10 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     if (dy0) p.dr0_step = DIV(dr0, FXI(abs(dy0)));
     if (dy0) p.dg0_step = DIV(dg0, FXI(abs(dy0)));
     if (dy0) p.db0_step = DIV(db0, FXI(abs(dy0)));
-    if (dy0) p.da0_step = DIV(da0, FXI(abs(dy0)));
 
     if (dy1) p.dr1_step = DIV(dr1, FXI(abs(dy1)));
     if (dy1) p.dg1_step = DIV(dg1, FXI(abs(dy1)));
     if (dy1) p.db1_step = DIV(db1, FXI(abs(dy1)));
-    if (dy1) p.da1_step = DIV(da1, FXI(abs(dy1)));
 
     if (dy0) rasterize_triangle_half(false, &p);
 
@@ -280,7 +354,6 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     dr0 = r2 - r1;
     dg0 = g2 - g1;
     db0 = b2 - b1;
-    da0 = a2 - a1;
 
     if (dy0) p.dax_step = DIV(FXI(dx0), FXI(abs(dy0)));
     if (dy1) p.dbx_step = DIV(FXI(dx1), FXI(abs(dy1)));
@@ -290,11 +363,10 @@ void sw_draw_triangle_standard(fx32 x0, fx32 y0, fx32 w0, fx32 s0, fx32 t0, fx32
     if (dy0) p.dt0_step = DIV(dt0, FXI(abs(dy0)));
     if (dy0) p.dw0_step = DIV(dw0, FXI(abs(dy0)));
 
-    p.dr0_step = FX(0.0f), p.dg0_step = FX(0.0f), p.db0_step = FX(0.0f), p.da0_step = FX(0.0f);
+    p.dr0_step = FX(0.0f), p.dg0_step = FX(0.0f), p.db0_step = FX(0.0f);
     if (dy0) p.dr0_step = DIV(dr0, FXI(abs(dy0)));
     if (dy0) p.dg0_step = DIV(dg0, FXI(abs(dy0)));
     if (dy0) p.db0_step = DIV(db0, FXI(abs(dy0)));
-    if (dy0) p.da0_step = DIV(da0, FXI(abs(dy0)));
 
     if (dy0) rasterize_triangle_half(true, &p);
 }
@@ -53,10 +53,12 @@ module graphite #(
            DRAW_TRIANGLE24, DRAW_TRIANGLE25, DRAW_TRIANGLE28, 
            DRAW_TRIANGLE31, DRAW_TRIANGLE32, DRAW_TRIANGLE35,
            DRAW_TRIANGLE36, DRAW_TRIANGLE37, DRAW_TRIANGLE38, DRAW_TRIANGLE39, DRAW_TRIANGLE40, DRAW_TRIANGLE41,
-           DRAW_TRIANGLE42, DRAW_TRIANGLE43,
+           DRAW_TRIANGLE42, DRAW_TRIANGLE43, DRAW_TRIANGLE44, DRAW_TRIANGLE45,
            DRAW_TRIANGLE48, DRAW_TRIANGLE49, DRAW_TRIANGLE51, DRAW_TRIANGLE52, DRAW_TRIANGLE53,
            DRAW_TRIANGLE54, DRAW_TRIANGLE55, DRAW_TRIANGLE56, DRAW_TRIANGLE57, DRAW_TRIANGLE58, DRAW_TRIANGLE59,
-           DRAW_TRIANGLE60
+           DRAW_TRIANGLE60,
+           DRAW_TEXTURE_BLOCK0, DRAW_TEXTURE_BLOCK1, DRAW_TEXTURE_BLOCK2, DRAW_TEXTURE_BLOCK3, DRAW_TEXTURE_BLOCK4,
+           DRAW_ALPHA_DEPTH0, DRAW_ALPHA_DEPTH1
     } state;
 
     localparam NB_DSP_MULS = 6;
@@ -80,12 +82,35 @@ module graphite #(
     logic [2:0] texture_width_scale;
     logic [2:0] texture_height_scale;
 
+    // Tiled texture layout: the texels are in rows of 4x4 tiles, each a row-major block of 16 texels
+    logic       is_texture_tiled;
+    logic [1:0] texel_y_in_tile;
+
+    // Compressed texture: the texels are in rows of 4x4 blocks of 4 words, two RGB565 endpoints then the 2-bit indices
+    // of the texels, see common/block_texture.h. The last block read is kept for the next texels.
+    logic        is_texture_compressed;
+    logic [15:0] texture_block[4];
+    logic [31:0] texture_block_address;
+    logic        is_texture_block_valid;
+    logic [31:0] texel_block_address;
+
     //
     // Draw triangle
     //
 
     logic is_textured, is_clamp_s, is_clamp_t, is_depth_test, is_perspective_correct;
 
+    // Alpha test: the fragments whose texel has a zero alpha are discarded. Their depth is only written once the texel
+    // is sampled, after the color.
+    logic is_alpha_test;
+
+    // Perspective subdivision: the reciprocal of z is divided every 4 << persp_subdivision pixels of a row, 0 for every
+    // pixel. In between, it is the tangent of 1/z at the last divided z, computed with two multiplications.
+    logic [1:0]  persp_subdivision;
+    logic [5:0]  persp_count;         // pixels since the last division, saturated
+    logic        is_persp_anchor;     // a division was done on the row
+    logic [31:0] persp_anchor_inv_z;  // reciprocal of the last divided z
+
     logic signed [31:0] p0, p1;
     logic signed [31:0] w0, w1, w2;
     logic signed [31:0] inv_area;
@@ -123,6 +148,10 @@ module graphite #(
 
     assign cmd_axis_tready_o = state == WAIT_COMMAND;
 
+    // block of the texel being sampled in DRAW_TRIANGLE52, the blocks of a row of 4 texels are width / 4 blocks of 4
+    // words: (y & ~3) * width / 4 + (x & ~3)
+    assign texel_block_address = texture_address + 32'(dsp_mul_z[0] >> 16) + {30'(dsp_mul_z[1] >> 16), 2'd0};
+
     always_ff @(posedge clk) begin
         if (ce_i) case (state)
             WAIT_COMMAND: begin
@@ -343,6 +372,11 @@ module graphite #(
                         is_perspective_correct <= cmd_axis_tdata_i[4];
                         texture_width_scale    <= cmd_axis_tdata_i[7:5];
                         texture_height_scale   <= cmd_axis_tdata_i[10:8];
+                        persp_subdivision      <= cmd_axis_tdata_i[12:11];
+                        is_texture_tiled       <= cmd_axis_tdata_i[13];
+                        is_texture_compressed  <= cmd_axis_tdata_i[14];
+                        is_alpha_test          <= cmd_axis_tdata_i[0] & cmd_axis_tdata_i[15];
+                        is_texture_block_valid <= 1'b0;
                         vram_mask_o     <= 4'hF;
                         min_x <= min3(12'(vv00 >> 14), 12'(vv10 >> 14), 12'(vv20 >> 14));
                         min_y <= min3(12'(vv01 >> 14), 12'(vv11 >> 14), 12'(vv21 >> 14));
@@ -438,6 +472,7 @@ module graphite #(
                 reciprocal_start <= 1'b0;
                 if (reciprocal_done) begin
                     inv_area <= reciprocal_z;
+                    is_persp_anchor <= 1'b0;
                     x <= min_x;
                     y <= min_y;
                     raster_rel_address <= {20'd0, min_y} * FB_WIDTH + {20'd0, min_x};
@@ -615,7 +650,7 @@ module graphite #(
                     vram_sel_o <= 1'b1;
                     state <= DRAW_TRIANGLE36;
                 end else begin
-                    state <= DRAW_TRIANGLE39;
+                    state <= is_alpha_test ? DRAW_TRIANGLE41 : DRAW_TRIANGLE39;
                 end
             end
 
@@ -631,7 +666,7 @@ module graphite #(
 
             DRAW_TRIANGLE38: begin
                 if (16'(z) > depth) begin
-                    state <= DRAW_TRIANGLE39;
+                    state <= is_alpha_test ? DRAW_TRIANGLE41 : DRAW_TRIANGLE39;
                 end else begin
                     state <= DRAW_TRIANGLE59;
                 end
@@ -650,7 +685,13 @@ module graphite #(
             end
 
             DRAW_TRIANGLE41: begin
-                if (is_perspective_correct) begin
+                if (is_perspective_correct && persp_subdivision != 2'd0 && is_persp_anchor &&
+                    persp_count < (6'd4 << persp_subdivision)) begin
+                    // q = z / anchor z = mul(z << 4, 1/(16 * anchor z))
+                    dsp_mul_p0[0] <= z << 4;
+                    dsp_mul_p1[0] <= persp_anchor_inv_z;
+                    state <= DRAW_TRIANGLE44;
+                end else if (is_perspective_correct) begin
                     // Perspective correction
                     // r = r * 1/z
                     // g = g * 1/z
@@ -668,6 +709,9 @@ module graphite #(
             DRAW_TRIANGLE42: begin
                 reciprocal_start <= 1'b0;
                 if (reciprocal_done) begin
+                    persp_anchor_inv_z <= reciprocal_z;
+                    is_persp_anchor <= 1'b1;
+                    persp_count <= 6'd0;
                     dsp_mul_p0[0] <= r;
                     dsp_mul_p1[0] <= (reciprocal_z << 12);
                     dsp_mul_p0[1] <= g;
@@ -691,6 +735,27 @@ module graphite #(
                 state <= DRAW_TRIANGLE48;
             end
 
+            DRAW_TRIANGLE44: begin
+                // 1/z = 1/anchor z * (2 - q)
+                dsp_mul_p0[0] <= persp_anchor_inv_z;
+                dsp_mul_p1[0] <= (32'd2 << 14) - dsp_mul_z[0][31:0];
+                state <= DRAW_TRIANGLE45;
+            end
+
+            DRAW_TRIANGLE45: begin
+                dsp_mul_p0[0] <= r;
+                dsp_mul_p1[0] <= (dsp_mul_z[0][31:0] << 12);
+                dsp_mul_p0[1] <= g;
+                dsp_mul_p1[1] <= (dsp_mul_z[0][31:0] << 12);
+                dsp_mul_p0[2] <= b;
+                dsp_mul_p1[2] <= (dsp_mul_z[0][31:0] << 12);
+                dsp_mul_p0[3] <= s;
+                dsp_mul_p1[3] <= (dsp_mul_z[0][31:0] << 12);
+                dsp_mul_p0[4] <= t;
+                dsp_mul_p1[4] <= (dsp_mul_z[0][31:0] << 12);
+                state <= DRAW_TRIANGLE43;
+            end
+
             DRAW_TRIANGLE48: begin
                 if (is_textured) begin
                     state <= DRAW_TRIANGLE49;
@@ -710,16 +775,71 @@ module graphite #(
             end
 
             DRAW_TRIANGLE51: begin
-                dsp_mul_p0[0] <= dsp_mul_z[0][31:0] & 32'hFFFFC000;
+                // the first row of the tile or block when tiled or compressed: (y & ~3) * width
+                dsp_mul_p0[0] <= dsp_mul_z[0][31:0] &
+                                 (is_texture_tiled || is_texture_compressed ? 32'hFFFF0000 : 32'hFFFFC000);
                 dsp_mul_p1[0] <= (TEXTURE_WIDTH << texture_width_scale) << 14;
+                texel_y_in_tile <= dsp_mul_z[0][15:14];
                 state <= DRAW_TRIANGLE52;
             end
 
             DRAW_TRIANGLE52: begin
-                vram_sel_o <= 1'b1;
-                vram_wr_o  <= 1'b0;
-                vram_addr_o <= texture_address + 32'(dsp_mul_z[0] >> 14) + 32'(dsp_mul_z[1] >> 14);
-                state <= DRAW_TRIANGLE53;
+                if (is_texture_compressed) begin
+                    if (is_texture_block_valid && texel_block_address == texture_block_address) begin
+                        state <= DRAW_TEXTURE_BLOCK4;
+                    end else begin
+                        vram_sel_o             <= 1'b1;
+                        vram_wr_o              <= 1'b0;
+                        vram_addr_o            <= texel_block_address;
+                        texture_block_address  <= texel_block_address;
+                        state                  <= DRAW_TEXTURE_BLOCK0;
+                    end
+                end else begin
+                    vram_sel_o <= 1'b1;
+                    vram_wr_o  <= 1'b0;
+                    if (is_texture_tiled) begin
+                        // tile of x, then the texel in the tile
+                        vram_addr_o <= texture_address + 32'(dsp_mul_z[0] >> 14) + {28'(dsp_mul_z[1] >> 16), 4'd0} +
+                                       {28'd0, texel_y_in_tile, dsp_mul_z[1][15:14]};
+                    end else begin
+                        vram_addr_o <= texture_address + 32'(dsp_mul_z[0] >> 14) + 32'(dsp_mul_z[1] >> 14);
+                    end
+                    state <= DRAW_TRIANGLE53;
+                end
+            end
+
+            // the words of the block are read back to back
+            DRAW_TEXTURE_BLOCK0: begin
+                texture_block[0] <= vram_data_in_i;
+                vram_addr_o <= texture_block_address + 32'd1;
+                state <= DRAW_TEXTURE_BLOCK1;
+            end
+
+            DRAW_TEXTURE_BLOCK1: begin
+                texture_block[1] <= vram_data_in_i;
+                vram_addr_o <= texture_block_address + 32'd2;
+                state <= DRAW_TEXTURE_BLOCK2;
+            end
+
+            DRAW_TEXTURE_BLOCK2: begin
+                texture_block[2] <= vram_data_in_i;
+                vram_addr_o <= texture_block_address + 32'd3;
+                state <= DRAW_TEXTURE_BLOCK3;
+            end
+
+            DRAW_TEXTURE_BLOCK3: begin
+                vram_sel_o <= 1'b0;
+                texture_block[3] <= vram_data_in_i;
+                is_texture_block_valid <= 1'b1;
+                state <= DRAW_TEXTURE_BLOCK4;
+            end
+
+            DRAW_TEXTURE_BLOCK4: begin
+                // index of the texel (x & 3, y & 3) in the indices of the block
+                sample <= block_texel(texture_block[0], texture_block[1],
+                                      2'(texture_block[texel_y_in_tile[1] ? 3 : 2] >>
+                                         {texel_y_in_tile[0], dsp_mul_z[1][15:14], 1'b0}));
+                state <= DRAW_TRIANGLE54;
             end
 
             DRAW_TRIANGLE53: begin
@@ -733,7 +853,7 @@ module graphite #(
                 // The sample is RGB444, so a conversion is required
                 dsp_mul_p0[0] <= {13'd0, sample[11:8], sample[11], 14'd0};
                 dsp_mul_p1[0] <= r;
-                state <= DRAW_TRIANGLE55;
+                state <= (is_alpha_test && sample[15:12] == 4'd0) ? DRAW_TRIANGLE59 : DRAW_TRIANGLE55;
             end
 
             DRAW_TRIANGLE55: begin
@@ -759,16 +879,34 @@ module graphite #(
             end
 
             DRAW_TRIANGLE58: begin
-                state <= DRAW_TRIANGLE59;
+                state <= is_alpha_test ? DRAW_ALPHA_DEPTH0 : DRAW_TRIANGLE59;
+                vram_sel_o <= 1'b0;
+                vram_wr_o  <= 1'b0;
+            end
+
+            // depth of a fragment which passed the alpha test
+            DRAW_ALPHA_DEPTH0: begin
+                vram_data_out_o <= 16'(z);
+                vram_addr_o <= fb_address + depth_rel_address + 32'(y) * FB_WIDTH + 32'(x);
+                vram_sel_o <= 1'b1;
+                vram_wr_o  <= 1'b1;
+                state <= DRAW_ALPHA_DEPTH1;
+            end
+
+            DRAW_ALPHA_DEPTH1: begin
                 vram_sel_o <= 1'b0;
                 vram_wr_o  <= 1'b0;
+                state <= DRAW_TRIANGLE59;
             end
 
             DRAW_TRIANGLE59: begin
+                if (persp_count != 6'h3F)
+                    persp_count <= persp_count + 1;
                 if (x < max_x) begin
                     x <= x + 1;
                     raster_rel_address <= raster_rel_address + 1;
                 end else begin
+                    is_persp_anchor <= 1'b0;
                     x <= min_x;
                     y <= y + 1;
                     raster_rel_address <= raster_rel_address + {20'd0, (FB_WIDTH[11:0] - max_x) + min_x};
@@ -800,6 +938,11 @@ module graphite #(
             reciprocal_start    <= 1'b0;
             texture_width_scale <= 3'd0;
             texture_height_scale <= 3'd0;
+            is_texture_tiled    <= 1'b0;
+            is_texture_compressed <= 1'b0;
+            is_texture_block_valid <= 1'b0;
+            is_alpha_test       <= 1'b0;
+            persp_subdivision   <= 2'd0;
         end
     end
 
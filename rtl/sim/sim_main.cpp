@@ -4,9 +4,12 @@
 
 #include <SDL.h>
 #include <Vtop.h>
+#include <block_texture.h>
 #include <cube.h>
+#include <dynamic_resolution.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <frame_state.h>
 #include <graphite.h>
 #include <string.h>
 #include <teapot.h>
@@ -23,6 +26,33 @@
 #define WINDOW_SCALE 3
 #define VRAM_SIZE   (16*1024*1024)
 
+// delay of an unchanged frame, during which the simulation is paused
+#define SKIPPED_FRAME_DELAY_MS 10
+
+// clock cycles from the first command of a frame to its swap targeted by the dynamic resolution, e.g. 10 fps at 25 MHz,
+// and the smallest scale of the resolution
+#ifndef DYNAMIC_RESOLUTION_TARGET_CYCLES
+#define DYNAMIC_RESOLUTION_TARGET_CYCLES 2500000
+#endif
+#ifndef DYNAMIC_RESOLUTION_MIN_SCALE
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#endif
+
+// Perspective subdivision of the draw commands: 0 to divide the reciprocal of z at every pixel, otherwise every
+// 4 << g_persp_subdivision pixels (8, 16 or 32)
+static int g_persp_subdivision = 0;
+
+// Layout of the texture in VRAM and of the draw commands: row-major, in rows of 4x4 tiles of texels, or in rows of
+// 4x4 blocks compressed to 4 bits per texel
+enum { TEXTURE_LINEAR, TEXTURE_TILED, TEXTURE_COMPRESSED };
+static const char* g_texture_layout_names[] = {"Linear", "Tiled", "Compressed"};
+static int g_texture_layout = TEXTURE_LINEAR;
+
+// 16-bit words of a row of the VRAM, the texel fetches in another row than the previous one switch rows
+#define VRAM_ROW_SIZE 512
+
+#define TEXTURE_ADDRESS (3 * FB_WIDTH * FB_HEIGHT)
+
 #define OP_SET_X0 0
 #define OP_SET_Y0 1
 #define OP_SET_Z0 2
@@ -149,7 +179,7 @@ static void swap(fx32* a, fx32* b) {
 }
 
 void xd_draw_triangle(vec3d p[3], vec2d t[3], vec3d c[3], texture_t* tex, bool clamp_s, bool clamp_t, int texture_scale_x, int texture_scale_y,
-                      bool depth_test, bool perspective_correct)                      
+                      bool depth_test, bool perspective_correct, bool alpha_test)                      
 {
     struct Command cmd;
 
@@ -304,6 +334,10 @@ void xd_draw_triangle(vec3d p[3], vec2d t[3], vec3d c[3], texture_t* tex, bool c
 
     cmd.param |= texture_scale_x << 5;
     cmd.param |= texture_scale_y << 8;
+    cmd.param |= g_persp_subdivision << 11;
+    cmd.param |= (g_texture_layout == TEXTURE_TILED ? 1 : 0) << 13;
+    cmd.param |= (g_texture_layout == TEXTURE_COMPRESSED ? 1 : 0) << 14;
+    cmd.param |= (alpha_test ? 1 : 0) << 15;
 
     g_commands.push_back(cmd);
 }
@@ -334,9 +368,42 @@ void send_command(const char* s) {
     g_commands.push_back(c);
 }
 
+// Number of different pixels of two frames of width x height pixels with a pitch of FB_WIDTH, the sum of the
+// absolute differences of their RGB565 levels and the maximum difference
+static int compare_frames(const uint16_t* a, const uint16_t* b, int width, int height, long* error, int* max_error) {
+    int nb = 0;
+    *error = 0;
+    *max_error = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            uint16_t ca = a[y * FB_WIDTH + x], cb = b[y * FB_WIDTH + x];
+            if (ca == cb) continue;
+            nb++;
+            int d[3] = {abs((ca >> 11) - (cb >> 11)), abs(((ca >> 5) & 0x3F) - ((cb >> 5) & 0x3F)),
+                        abs((ca & 0x1F) - (cb & 0x1F))};
+            for (int k = 0; k < 3; ++k) {
+                *error += d[k];
+                if (d[k] > *max_error) *max_error = d[k];
+            }
+        }
+    return nb;
+}
+
 void write_texture(uint16_t* vram) {
-    uint32_t tex_addr = 3 * FB_WIDTH * FB_HEIGHT;
-    memcpy(vram + tex_addr, tex, TEXTURE_WIDTH*TEXTURE_HEIGHT*2);
+    uint32_t tex_addr = TEXTURE_ADDRESS;
+    if (g_texture_layout == TEXTURE_LINEAR) {
+        memcpy(vram + tex_addr, tex, TEXTURE_WIDTH*TEXTURE_HEIGHT*2);
+        return;
+    }
+    if (g_texture_layout == TEXTURE_COMPRESSED) {
+        block_texture_encode(tex, TEXTURE_WIDTH, TEXTURE_HEIGHT, vram + tex_addr);
+        return;
+    }
+    // tiles of 4x4 texels in rows, each a row-major block of 16 texels
+    for (int y = 0; y < TEXTURE_HEIGHT; ++y)
+        for (int x = 0; x < TEXTURE_WIDTH; ++x)
+            vram[tex_addr + (((y >> 2) * (TEXTURE_WIDTH >> 2) + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3)] =
+                tex[y * TEXTURE_WIDTH + x];
 }
 
 int main(int argc, char** argv, char** env) {
@@ -387,9 +454,27 @@ int main(int argc, char** argv, char** env) {
     vec3d vec_up = {FX(0.0f), FX(1.0f), FX(0.0f), FX(1.0f)};
     vec3d vec_camera = {FX(0.0f), FX(0.0f), FX(0.0f), FX(1.0f)};
 
-    // Projection matrix
+    // Projection matrix, for the render resolution
     mat4x4 mat_proj = matrix_make_projection(FB_WIDTH, FB_HEIGHT, 60.0f);
 
+    // the frames are rendered at the top left of the framebuffer and upscaled when swapped
+    bool dynamic_resolution_enabled = true;
+    dynamic_resolution_t dynamic_resolution;
+    dynamic_resolution_init(&dynamic_resolution, FB_WIDTH, FB_HEIGHT, DYNAMIC_RESOLUTION_MIN_SCALE,
+                            DYNAMIC_RESOLUTION_TARGET_CYCLES);
+    int width = FB_WIDTH, height = FB_HEIGHT;
+    int frame_width = FB_WIDTH, frame_height = FB_HEIGHT;  // of the frame being rendered
+    uint64_t frame_start_time = 0;
+
+    // last frame drawn with the reciprocal of z divided at every pixel, compared with the frames of the same scene
+    // drawn with the perspective subdivision
+    uint16_t* reference_frame = new uint16_t[FB_WIDTH * FB_HEIGHT];
+    bool is_reference_valid = false;
+    uint64_t reference_cycles = 0;
+    int frame_persp_subdivision = 0;
+    frame_state_t scene_state;
+    frame_state_init(&scene_state);
+
     bool anim = false;
     bool wireframe = false;
     size_t nb_lights = 0;
@@ -400,6 +485,12 @@ int main(int argc, char** argv, char** env) {
     bool perspective_correct = true;
     bool show_depth = false;
 
+    // texture words read for the frame being rendered and the VRAM row switches between them
+    bool show_texture_stats = false;
+    int frame_texture_layout = TEXTURE_LINEAR;
+    uint64_t texture_fetches = 0, texture_row_switches = 0;
+    uint32_t last_texture_row = UINT32_MAX;
+
     light_t lights[5];
     lights[0].direction = {FX(0.0f), FX(0.0f), FX(1.0f), FX(0.0f)};
     lights[0].ambient_color = {FX(0.1f), FX(0.1f), FX(0.1f), FX(1.0f)};
@@ -428,11 +519,26 @@ int main(int argc, char** argv, char** env) {
 
     bool texture_dirty = true;
 
+    frame_state_t frame_state;
+    frame_state_init(&frame_state);
+
     while (!contextp->gotFinish() && !quit) {
         SDL_Event e;
 
+        // the commands of the previous frame are all processed and the graphite core is idle
         if (top->cmd_axis_tready_o && g_commands.size() == 0) {
-            clear();
+            //
+            // render resolution
+            //
+
+            // the dumped commands are drawn by the hardware at the resolution of its framebuffer
+            int next_width = dynamic_resolution_enabled && !dump ? dynamic_resolution.width : FB_WIDTH;
+            int next_height = dynamic_resolution_enabled && !dump ? dynamic_resolution.height : FB_HEIGHT;
+            if (next_width != width || next_height != height) {
+                width = next_width;
+                height = next_height;
+                mat_proj = matrix_make_projection(width, height, 60.0f);
+            }
 
             //
             // camera
@@ -461,18 +567,60 @@ int main(int argc, char** argv, char** env) {
             mat_world = mat_normal = matrix_multiply_matrix(&mat_rot_z, &mat_rot_x);
             mat_world = matrix_multiply_matrix(&mat_world, &mat_trans);
 
-            if (texture_dirty || dump) {
-                write_texture(vram_data);
-                texture_dirty = false;
-            }
+            //
+            // inputs of the frame
+            //
 
-            if (current_model) {
-                // Draw cube
-                texture_t dummy_texture;
-                draw_model(FB_WIDTH, FB_HEIGHT, &vec_camera, current_model, &mat_world, gouraud_shading ? &mat_normal : NULL, &mat_proj, &mat_view, lights, nb_lights,
-                           wireframe, textured ? &dummy_texture : NULL, clamp_s, clamp_t, 3, 6, perspective_correct);
+            frame_state_begin(&frame_state);
+            frame_state_track(&frame_state, &vec_camera, sizeof(vec_camera));
+            frame_state_track(&frame_state, &mat_view, sizeof(mat_view));
+            frame_state_track(&frame_state, &mat_world, sizeof(mat_world));
+            frame_state_track(&frame_state, &mat_normal, sizeof(mat_normal));
+            frame_state_track(&frame_state, &nb_lights, sizeof(nb_lights));
+            frame_state_track(&frame_state, lights, nb_lights * sizeof(light_t));
+            frame_state_track(&frame_state, &current_model, sizeof(current_model));
+            frame_state_track(&frame_state, &wireframe, sizeof(wireframe));
+            frame_state_track(&frame_state, &gouraud_shading, sizeof(gouraud_shading));
+            frame_state_track(&frame_state, &textured, sizeof(textured));
+            frame_state_track(&frame_state, &clamp_s, sizeof(clamp_s));
+            frame_state_track(&frame_state, &clamp_t, sizeof(clamp_t));
+            frame_state_track(&frame_state, &perspective_correct, sizeof(perspective_correct));
+            frame_state_track(&frame_state, &show_depth, sizeof(show_depth));
+            frame_state_track(&frame_state, &width, sizeof(width));
+            frame_state_track(&frame_state, &height, sizeof(height));
+            // the scene is the frame without the perspective subdivision
+            frame_state_begin(&scene_state);
+            frame_state_track(&scene_state, frame_state.data, frame_state.offset);
+            frame_state_track(&frame_state, &g_persp_subdivision, sizeof(g_persp_subdivision));
+            frame_state_track(&frame_state, &g_texture_layout, sizeof(g_texture_layout));
+            bool frame_changed = frame_state_end(&frame_state);
+            if (frame_state_end(&scene_state)) is_reference_valid = false;
+
+            // the commands are dumped from a rendered frame
+            if (frame_changed || dump) {
+                clear();
+
+                if (texture_dirty || dump) {
+                    write_texture(vram_data);
+                    texture_dirty = false;
+                }
 
-                swap();
+                if (current_model) {
+                    // Draw cube
+                    texture_t dummy_texture;
+                    draw_model(width, height, &vec_camera, current_model, &mat_world, gouraud_shading ? &mat_normal : NULL, &mat_proj, &mat_view, lights, nb_lights,
+                               wireframe, textured ? &dummy_texture : NULL, clamp_s, clamp_t, 3, 6, perspective_correct);
+
+                    swap();
+
+                    frame_width = width;
+                    frame_height = height;
+                    frame_persp_subdivision = g_persp_subdivision;
+                    frame_texture_layout = g_texture_layout;
+                    texture_fetches = texture_row_switches = 0;
+                    last_texture_row = UINT32_MAX;
+                    frame_start_time = contextp->time();
+                }
             }
 
             if (dump) {
@@ -542,9 +690,33 @@ int main(int argc, char** argv, char** env) {
                         case SDL_SCANCODE_P:
                             perspective_correct = !perspective_correct;
                             break;                            
+                        case SDL_SCANCODE_O:
+                            g_persp_subdivision = (g_persp_subdivision + 1) % 4;
+                            if (g_persp_subdivision == 0) {
+                                printf("Perspective correction at every pixel\n");
+                            } else {
+                                printf("Perspective correction every %d pixels\n", 4 << g_persp_subdivision);
+                            }
+                            break;
                         case SDL_SCANCODE_F1:
                             show_depth = !show_depth;
                             break;
+                        case SDL_SCANCODE_F2:
+                            show_texture_stats = !show_texture_stats;
+                            break;
+                        case SDL_SCANCODE_Y:
+                            g_texture_layout = (g_texture_layout + 1) % 3;
+                            texture_dirty = true;
+                            printf("%s texture\n", g_texture_layout_names[g_texture_layout]);
+                            break;
+                        case SDL_SCANCODE_R:
+                            dynamic_resolution_enabled = !dynamic_resolution_enabled;
+                            if (dynamic_resolution_enabled) {
+                                printf("Dynamic resolution\n");
+                            } else {
+                                printf("Fixed resolution\n");
+                            }
+                            break;
                         default:
                             break;
                     }
@@ -563,6 +735,19 @@ int main(int argc, char** argv, char** env) {
             if (state[SDL_SCANCODE_D]) yaw += 2.0f * elapsed_time;
             if (state[SDL_SCANCODE_LEFTBRACKET]) show_depth_value -= 1000;
             if (state[SDL_SCANCODE_RIGHTBRACKET]) show_depth_value += 1000;
+
+            // present the previous framebuffer again without simulating the unchanged frame
+            if (!frame_changed && g_commands.size() == 0) {
+                int draw_w, draw_h;
+                SDL_GL_GetDrawableSize(window, &draw_w, &draw_h);
+
+                SDL_Rect vga_r = {0, 0, draw_w, draw_h};
+                SDL_RenderCopy(renderer, texture, NULL, &vga_r);
+
+                SDL_RenderPresent(renderer);
+                SDL_Delay(SKIPPED_FRAME_DELAY_MS);
+                continue;
+            }
         }
 
         if (top->cmd_axis_tready_o) {
@@ -579,6 +764,12 @@ int main(int argc, char** argv, char** env) {
 
                 if (top->vram_wr_o) {
                     vram_data[top->vram_addr_o] = top->vram_data_out_o;
+                } else if (top->vram_addr_o >= TEXTURE_ADDRESS &&
+                           top->vram_addr_o < TEXTURE_ADDRESS + TEXTURE_WIDTH * TEXTURE_HEIGHT) {
+                    uint32_t row = top->vram_addr_o / VRAM_ROW_SIZE;
+                    texture_fetches++;
+                    if (row != last_texture_row) texture_row_switches++;
+                    last_texture_row = row;
                 }
                 top->vram_data_in_i = vram_data[top->vram_addr_o];
             } else {
@@ -610,11 +801,40 @@ int main(int argc, char** argv, char** env) {
                         ++d;
                     }
 
-            } else {
+            } else if (frame_width == FB_WIDTH && frame_height == FB_HEIGHT) {
                 memcpy(p, vram_data + top->front_addr_o, FB_WIDTH * FB_HEIGHT * 2);
+            } else {
+                dynamic_resolution_upscale(vram_data + top->front_addr_o, frame_width, frame_height, FB_WIDTH,
+                                           (uint16_t*)p, FB_WIDTH, FB_HEIGHT, FB_WIDTH);
             }
             SDL_UnlockTexture(texture);
 
+            // two time units per clock cycle
+            uint64_t frame_cycles = (contextp->time() - frame_start_time) / 2;
+            if (dynamic_resolution_enabled) dynamic_resolution_update(&dynamic_resolution, (float)frame_cycles);
+
+            const uint16_t* frame = vram_data + top->front_addr_o;
+            if (frame_persp_subdivision == 0) {
+                memcpy(reference_frame, frame, FB_WIDTH * FB_HEIGHT * 2);
+                reference_cycles = frame_cycles;
+                is_reference_valid = true;
+            } else if (is_reference_valid) {
+                long error;
+                int max_error;
+                int nb = compare_frames(reference_frame, frame, frame_width, frame_height, &error, &max_error);
+                printf("Perspective subdivision %d: %llu cycles (%.2fx), %d pixels differ, mean error %.4f, "
+                       "max error %d\n",
+                       4 << frame_persp_subdivision, (unsigned long long)frame_cycles,
+                       (double)reference_cycles / (double)frame_cycles, nb,
+                       (double)error / (3.0 * frame_width * frame_height), max_error);
+            }
+            if (show_texture_stats && texture_fetches > 0) {
+                printf("%s texture: %llu texture reads, %llu VRAM row switches (%.1f%%), %llu cycles\n",
+                       g_texture_layout_names[frame_texture_layout], (unsigned long long)texture_fetches,
+                       (unsigned long long)texture_row_switches, 100.0 * texture_row_switches / texture_fetches,
+                       (unsigned long long)frame_cycles);
+            }
+
             int draw_w, draw_h;
             SDL_GL_GetDrawableSize(window, &draw_w, &draw_h);
 
@@ -630,6 +850,10 @@ int main(int argc, char** argv, char** env) {
 
     top->final();
 
+    frame_state_free(&frame_state);
+    frame_state_free(&scene_state);
+    delete[] reference_frame;
+
     delete top;
 
     SDL_DestroyTexture(texture);
@@ -1,15 +1,113 @@
-
 import sys
 import os
 from PIL import Image
 
-if len(sys.argv) != 3:
-    print('Usage: python {} image.png array.c'.format(sys.argv[0]))
+# Block compression at 4 bits per texel, like block_texture_encode() in common/block_texture.c: blocks of 4x4 texels
+# in rows, each two RGB565 endpoints then the 2-bit indices of its texels in rows
+
+
+def is_transparent(texel):
+    return (texel >> 12) < 8
+
+
+def endpoint(texel):
+    r = (texel >> 8) & 0xF
+    g = (texel >> 4) & 0xF
+    b = texel & 0xF
+    return ((r << 1) | (r >> 3)) << 11 | ((g << 2) | (g >> 2)) << 5 | ((b << 1) | (b >> 3))
+
+
+def distance(a, b):
+    return sum((((a >> shift) & 0xF) - ((b >> shift) & 0xF)) ** 2 for shift in (0, 4, 8))
+
+
+def decode(c0, c1, index):
+    if index < 2:
+        c = c1 if index else c0
+        return 0xF000 | (c >> 12) << 8 | ((c >> 7) & 0xF) << 4 | ((c >> 1) & 0xF)
+    if c0 <= c1 and index == 3:
+        return 0
+    channels = []
+    for shift, mask in ((11, 0x1F), (5, 0x3F), (0, 0x1F)):
+        a = (c0 >> shift) & mask
+        b = (c1 >> shift) & mask
+        if c0 > c1:
+            channels.append(((4 - index) * a + (index - 1) * b) // 3)
+        else:
+            channels.append((a + b) >> 1)
+    return 0xF000 | (channels[0] >> 1) << 8 | (channels[1] >> 2) << 4 | (channels[2] >> 1)
+
+
+def encode_indices(texels, c0, c1):
+    colors = [decode(c0, c1, i) for i in range(4)]
+    indices = 0
+    total = 0
+    for i, texel in enumerate(texels):
+        index = 3
+        if not is_transparent(texel):
+            best = None
+            for j, color in enumerate(colors):
+                if is_transparent(color):
+                    continue
+                d = distance(texel, color)
+                if best is None or d < best:
+                    best = d
+                    index = j
+            total += best
+        indices |= index << (2 * i)
+    return total, [c0, c1, indices & 0xFFFF, indices >> 16]
+
+
+def encode_block(texels):
+    opaque = [t for t in texels if not is_transparent(t)]
+    if not opaque:
+        return [0, 0, 0xFFFF, 0xFFFF]
+    has_transparent = len(opaque) < len(texels)
+
+    # the two most distant colors and the corners of the bounding box of the colors
+    most_distant = (opaque[0], opaque[0])
+    max_distance = 0
+    for i in range(len(opaque)):
+        for j in range(i + 1, len(opaque)):
+            d = distance(opaque[i], opaque[j])
+            if d > max_distance:
+                max_distance = d
+                most_distant = (opaque[i], opaque[j])
+    low = 0xF000
+    high = 0xF000
+    for shift in (0, 4, 8):
+        low |= min((t >> shift) & 0xF for t in opaque) << shift
+        high |= max((t >> shift) & 0xF for t in opaque) << shift
+
+    best = None
+    for ends in (most_distant, (low, high)):
+        e0, e1 = sorted((endpoint(ends[0]), endpoint(ends[1])))
+        candidate = encode_indices(texels, e0, e1) if has_transparent else encode_indices(texels, e1, e0)
+        if best is None or candidate[0] < best[0]:
+            best = candidate
+    return best[1]
+
+
+def compress(texels, width, height):
+    blocks = []
+    for by in range(0, height, 4):
+        for bx in range(0, width, 4):
+            # the padding repeats the last column and row
+            blocks += encode_block([texels[min(by + y, height - 1) * width + min(bx + x, width - 1)]
+                                    for y in range(4) for x in range(4)])
+    return blocks
+
+
+args = [arg for arg in sys.argv[1:] if arg != '--compressed']
+compressed = len(args) < len(sys.argv) - 1
+
+if len(args) != 2:
+    print('Usage: python {} [--compressed] image.png array.c'.format(sys.argv[0]))
     sys.exit(1)
 
-im = Image.open(sys.argv[1])
+im = Image.open(args[0])
 
-with open(sys.argv[2], 'w') as f:
+with open(args[1], 'w') as f:
     while True:
         rgb_im = im.convert('RGBA')
         size = rgb_im.size
@@ -23,9 +121,11 @@ with open(sys.argv[2], 'w') as f:
                 g = rgba[1] >> 4
                 b = rgba[2] >> 4
                 array.append(a << 12 | r << 8 | g << 4 | b)
+        if compressed:
+            array = compress(array, size[0], size[1])
 
         f.write('#include <stdint.h>\n\n')
-        f.write('uint16_t {}[] = {{'.format(os.path.splitext(os.path.basename(sys.argv[1]))[0]))
+        f.write('uint16_t {}[] = {{'.format(os.path.splitext(os.path.basename(args[0]))[0]))
         f.write(str(array)[1:-1])
         f.write('};\n')
 
@@ -0,0 +1,240 @@
+import mmap
+import os
+import shutil
+import struct
+import sys
+import tempfile
+
+# Convert an OBJ file to a chunked mesh for common/mesh_stream.c. The faces are split recursively along the largest
+# axis of their centroids until each chunk holds at most max_faces faces, so that the chunks are spatially coherent.
+#
+# The mesh may not fit in memory: the attributes and the faces are spilled to temporary files in a first pass over
+# the OBJ, the attributes are then read back through memory maps and the faces are split from file to file. Only the
+# faces of one chunk are held in memory at a time.
+
+MAGIC = b'GCMS'
+VERSION = 1
+HEADER_SIZE = 4 + 3 * 4 + 6 * 4
+CHUNK_ENTRY_SIZE = 8 + 6 * 4 + 6 * 4
+
+VERTEX = struct.Struct('<3f')
+TEXCOORD = struct.Struct('<2f')
+COLOR = struct.Struct('<4f')
+NORMAL = struct.Struct('<3f')
+# vertex, texcoord and normal indices of the 3 corners, then the centroid
+FACE = struct.Struct('<9i3f')
+
+# bins of the histogram of the centroids from which the median of a split is estimated
+NB_BINS = 1024
+
+
+def parse_index(s):
+    return int(s) - 1 if s else -1
+
+
+class Attributes:
+    # attribute arrays in temporary files, read back through memory maps
+    def __init__(self, directory):
+        self.files = {name: open(os.path.join(directory, name), 'w+b')
+                      for name in ('vertices', 'texcoords', 'colors', 'normals')}
+        self.counts = {name: 0 for name in self.files}
+        self.maps = {}
+
+    def append(self, name, record, values):
+        self.files[name].write(record.pack(*values))
+        self.counts[name] += 1
+
+    def map(self):
+        for name, f in self.files.items():
+            f.flush()
+            if self.counts[name]:
+                self.maps[name] = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    def get(self, name, record, i):
+        return record.unpack_from(self.maps[name], i * record.size)
+
+    def close(self):
+        for m in self.maps.values():
+            m.close()
+        for f in self.files.values():
+            f.close()
+
+
+def read_obj(path, attributes, faces_file):
+    # the faces are written without their centroids, the vertices are not all known yet
+    nb_faces = 0
+    with open(path, 'r') as f:
+        for line in f:
+            words = line.split()
+            if len(words) == 0:
+                continue
+            if words[0] == "v":
+                attributes.append('vertices', VERTEX, [float(words[1]), float(words[2]), float(words[3])])
+                # vertex color hack
+                if len(words) > 4:
+                    alpha = float(words[7]) if len(words) > 7 else 1.0
+                    attributes.append('colors', COLOR,
+                                      [float(words[4]), float(words[5]), float(words[6]), alpha])
+            elif words[0] == "vt":
+                attributes.append('texcoords', TEXCOORD, [float(words[1]), float(words[2])])
+            elif words[0] == "vn":
+                attributes.append('normals', NORMAL, [float(words[1]), float(words[2]), float(words[3])])
+            elif words[0] == "f":
+                w = [(word.split('/') + ['', ''])[:3] for word in words[1:4]]
+                faces_file.write(FACE.pack(*([parse_index(w[i][j]) for j in (0, 1, 2) for i in range(3)] +
+                                             [0.0, 0.0, 0.0])))
+                nb_faces += 1
+    return nb_faces
+
+
+def read_faces(f):
+    f.seek(0)
+    while True:
+        data = f.read(FACE.size * 4096)
+        if not data:
+            return
+        for offset in range(0, len(data), FACE.size):
+            yield FACE.unpack_from(data, offset)
+
+
+def add_centroids(attributes, src, dst):
+    for face in read_faces(src):
+        vs = [attributes.get('vertices', VERTEX, i) for i in face[0:3]]
+        centroid = [sum(v[a] for v in vs) / 3.0 for a in range(3)]
+        dst.write(FACE.pack(*(list(face[:9]) + centroid)))
+
+
+def bounds(points):
+    lo = [float('inf')] * 3
+    hi = [float('-inf')] * 3
+    for p in points:
+        for i in range(3):
+            lo[i] = min(lo[i], p[i])
+            hi[i] = max(hi[i], p[i])
+    return lo + hi
+
+
+def split_file(f, nb_faces, directory):
+    # the faces of a file in two halves along the largest axis of their centroids, at the median estimated from a
+    # histogram, or in file order if the centroids cannot be told apart
+    b = bounds(face[9:12] for face in read_faces(f))
+    axis = max(range(3), key=lambda i: b[i + 3] - b[i])
+    lo, extent = b[axis], b[axis + 3] - b[axis]
+    if extent > 0.0:
+        histogram = [0] * NB_BINS
+        for face in read_faces(f):
+            histogram[min(int((face[9 + axis] - lo) / extent * NB_BINS), NB_BINS - 1)] += 1
+        below, split_bin = 0, 0
+        while split_bin < NB_BINS - 1 and below + histogram[split_bin] <= nb_faces // 2:
+            below += histogram[split_bin]
+            split_bin += 1
+        if below == 0:
+            # the first bin holds more than half of the faces
+            below, split_bin = histogram[0], 1
+        if below < nb_faces:
+            in_first_half = lambda face, n: min(int((face[9 + axis] - lo) / extent * NB_BINS), NB_BINS - 1) < split_bin
+        else:
+            extent = 0.0
+    if extent <= 0.0:
+        below = nb_faces // 2
+        in_first_half = lambda face, n: n < below
+
+    halves = [tempfile.TemporaryFile(dir=directory), tempfile.TemporaryFile(dir=directory)]
+    for n, face in enumerate(read_faces(f)):
+        halves[0 if in_first_half(face, n) else 1].write(FACE.pack(*face))
+    return (halves[0], below), (halves[1], nb_faces - below)
+
+
+def remap(indices, attributes, name, record):
+    # returns the local array and the index map of the attribute
+    local = {}
+    for i in indices:
+        if i >= 0 and i not in local:
+            local[i] = len(local)
+    return [attributes.get(name, record, i) for i in local], local
+
+
+def build_chunk(fs, attributes):
+    has_colors = attributes.counts['colors'] > 0
+    chunk_vertices, vmap = remap([i for f in fs for i in f[0:3]], attributes, 'vertices', VERTEX)
+    chunk_texcoords, tmap = remap([i for f in fs for i in f[3:6]], attributes, 'texcoords', TEXCOORD)
+    chunk_colors, cmap = (remap([i for f in fs for i in f[0:3]], attributes, 'colors', COLOR) if has_colors
+                          else ([], {}))
+    chunk_normals, nmap = remap([i for f in fs for i in f[6:9]], attributes, 'normals', NORMAL)
+
+    data = bytearray()
+    for v in chunk_vertices:
+        data += VERTEX.pack(*v)
+    for t in chunk_texcoords:
+        data += TEXCOORD.pack(*t)
+    for c in chunk_colors:
+        data += COLOR.pack(*c)
+    for n in chunk_normals:
+        data += NORMAL.pack(*n)
+    for f in fs:
+        indices = [vmap[i] for i in f[0:3]]
+        tex_indices = [tmap.get(i, -1) for i in f[3:6]]
+        col_indices = [cmap.get(i, -1) for i in f[0:3]]
+        norm_indices = [nmap.get(i, -1) for i in f[6:9]]
+        data += struct.pack('<12i', *(indices + tex_indices + col_indices + norm_indices))
+
+    counts = [len(chunk_vertices), len(chunk_texcoords), len(chunk_colors), len(chunk_normals), len(fs)]
+    return counts, bounds(chunk_vertices), data
+
+
+def main(argv):
+    if len(argv) < 2:
+        print("Usage: obj2chunks.py <objfile> <chunked mesh> [max faces per chunk]")
+        exit(0)
+    if not os.path.exists(argv[0]):
+        print("{} does not exist".format(argv[0]))
+        exit(-1)
+    max_faces = int(argv[2]) if len(argv) > 2 else 4096
+
+    directory = tempfile.mkdtemp(dir=os.path.dirname(os.path.abspath(argv[1])))
+    try:
+        attributes = Attributes(directory)
+        with tempfile.TemporaryFile(dir=directory) as raw_faces:
+            nb_faces = read_obj(argv[0], attributes, raw_faces)
+            attributes.map()
+            faces = tempfile.TemporaryFile(dir=directory)
+            add_centroids(attributes, raw_faces, faces)
+
+        # the chunks are written to a temporary file as they are built, the table is written before them
+        entries = []
+        with tempfile.TemporaryFile(dir=directory) as chunk_data:
+            stack = [(faces, nb_faces)]
+            while stack:
+                f, n = stack.pop()
+                if n <= max_faces:
+                    if n > 0:
+                        counts, b, data = build_chunk(list(read_faces(f)), attributes)
+                        entries.append((counts, b, len(data)))
+                        chunk_data.write(data)
+                    f.close()
+                    continue
+                first, second = split_file(f, n, directory)
+                f.close()
+                # the second half is pushed first so that the chunks are written in spatial order
+                stack.append(second)
+                stack.append(first)
+
+            mesh_bounds = bounds(attributes.get('vertices', VERTEX, i) for i in range(attributes.counts['vertices']))
+            with open(argv[1], 'wb') as f:
+                f.write(MAGIC + struct.pack('<3I', VERSION, len(entries), 0) + struct.pack('<6f', *mesh_bounds))
+                offset = HEADER_SIZE + len(entries) * CHUNK_ENTRY_SIZE
+                for counts, b, size in entries:
+                    f.write(struct.pack('<Q6I', offset, *(counts + [0])) + struct.pack('<6f', *b))
+                    offset += size
+                chunk_data.seek(0)
+                shutil.copyfileobj(chunk_data, f)
+        attributes.close()
+    finally:
+        shutil.rmtree(directory, ignore_errors=True)
+
+    print("{} faces in {} chunks".format(nb_faces, len(entries)))
+    exit(0)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])